@@ -0,0 +1,37 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <M7/ECS.h>
+#include <M7/M7_ECS.h>
+
+enum RenderBatches {
+    Opaque
+};
+
+typedef struct BenchConfig {
+    int width, height;
+    int parallelism;
+    int frames, warmup;
+    float delta;
+    int shadow_size;
+    int placements;
+    char *simd;
+    char *output;
+    char *dump;
+    char *trace;
+    bool stats;
+    bool gouraud;
+} BenchConfig;
+
+typedef struct CameraPath {
+    char *name;
+    void (*place)(float t, int scale, vec3 *pos, mat3x3 *basis);
+} CameraPath;
+
+extern CameraPath camera_paths[];
+extern size_t ncamera_paths;
+
+ECS *BenchScene_Create(BenchConfig *config, int scale);
+ECS_Handle *BenchScene_GetCamera(ECS *ecs);
+
+#endif /* BENCH_H */
@@ -0,0 +1,58 @@
+#include <SDL3/SDL.h>
+#include <M7/Math/linalg.h>
+
+#include "Bench.h"
+
+/* Center of the demo cell grid, where the teapots sit */
+static const vec3 focus = {{ 0, -150, 600 }};
+
+static mat3x3 LookAt(vec3 pos, vec3 target) {
+    vec3 z = vec3_normalize(vec3_sub(target, pos));
+    vec3 x = vec3_normalize(vec3_cross(vec3_j, z));
+    vec3 y = vec3_cross(z, x);
+
+    return (mat3x3) { .x = x, .y = y, .z = z };
+}
+
+/* Full circle around the scene at a fixed height */
+static void Orbit(float t, int scale, vec3 *pos, mat3x3 *basis) {
+    float radius = 700 * scale;
+    float angle = t * 2 * SDL_PI_F;
+
+    *pos = vec3_add(focus, (vec3){{ -SDL_sinf(angle) * radius, 200, -SDL_cosf(angle) * radius }});
+    *basis = LookAt(*pos, focus);
+}
+
+/* Straight approach from outside the scene up to the central teapot */
+static void Dolly(float t, int scale, vec3 *pos, mat3x3 *basis) {
+    float start = -600 * scale;
+    float end = -250;
+
+    *pos = vec3_add(focus, (vec3){{ 0, 60, start + (end - start) * t }});
+    *basis = LookAt(*pos, vec3_add(*pos, (vec3){{ 0, -100, 1000 }}));
+}
+
+/* Low pass across the floor with the camera panning to keep the scene in view */
+static void Flyby(float t, int scale, vec3 *pos, mat3x3 *basis) {
+    float span = 1000 * scale;
+
+    *pos = vec3_add(focus, (vec3){{ (t - 0.5f) * 2 * span, 80, -400 * scale }});
+    *basis = LookAt(*pos, focus);
+}
+
+/* Fixed view over the scene, where nothing moves between frames */
+static void Still(float t, int scale, vec3 *pos, mat3x3 *basis) {
+    (void)t;
+
+    *pos = vec3_add(focus, (vec3){{ 0, 200, -700 * scale }});
+    *basis = LookAt(*pos, focus);
+}
+
+CameraPath camera_paths[] = {
+    { "orbit", Orbit },
+    { "dolly", Dolly },
+    { "flyby", Flyby },
+    { "still", Still }
+};
+
+size_t ncamera_paths = SDL_arraysize(camera_paths);
@@ -0,0 +1,257 @@
+#include <SDL3/SDL.h>
+#include <M7/ECS.h>
+#include <M7/M7_ECS.h>
+#include <M7/Math/linalg.h>
+
+#include "Bench.h"
+
+#define CELL_SPACING  500
+
+#define LIGHT_FLAGS  ( M7_RASTERIZER_CULL_BACKFACE | M7_RASTERIZER_TEST_DEPTH | M7_RASTERIZER_WRITE_DEPTH )
+
+/* The four point lights of a cell, drawn as placements of one sphere model that sits at the first of them */
+static void AddLights(ECS_Handle *world, vec3 center, int shadow_size) {
+    vec3 pos = vec3_add(center, (vec3){{ -150, 35, -200 }});
+
+    ECS_Entity_AddChildren(world, {
+        ECS_Components(
+            { M7_Components.Position, &pos },
+            { M7_Components.Basis, (mat3x3 []){mat3x3_identity} },
+            { M7_Components.MeshPrimitive, nullptr },
+            { M7_Components.Sphere, &(M7_Sphere) { .radius=32, .nrings=16, .ring_precision=16 } },
+            { M7_Components.Model, &(M7_ModelArgs) { .get_mesh = M7_Sphere_GetMesh }},
+            { M7_Components.XformComposer, &(M7_XformComposer){M7_XformComposeDefault} },
+            { M7_Components.PointLight, &(M7_PointLight) { .col={{ 1.0, 0.8, 0.2 }}, .energy=20000, .shadow_size=shadow_size } }
+        ),
+        ECS_Children(
+            {ECS_Components(
+                { M7_Components.SolidColor, &(M7_SolidColor) { .r=1, .g=1, .b=1 }},
+                { M7_Components.ModelInstance, &(M7_ModelInstanceArgs) {
+                    .shader_components = (ECS_Component(M7_ShaderComponent) *[]) { M7_Components.SolidColor },
+                    .nshaders = 1,
+                    .render_batch = Opaque,
+                    .flags = LIGHT_FLAGS
+                }}
+            )},
+            {ECS_Components(
+                { M7_Components.Position, &(vec3){{ 300, 0, 0 }} },
+                { M7_Components.Basis, (mat3x3 []){mat3x3_identity} },
+                { M7_Components.XformComposer, &(M7_XformComposer){M7_XformComposeDefault} },
+                { M7_Components.Placement, nullptr },
+                { M7_Components.PointLight, &(M7_PointLight) { .col={{ 0.2, 1.0, 0.5 }}, .energy=20000, .shadow_size=shadow_size } }
+            )},
+            {ECS_Components(
+                { M7_Components.Position, &(vec3){{ 0, 0, 400 }} },
+                { M7_Components.Basis, (mat3x3 []){mat3x3_identity} },
+                { M7_Components.XformComposer, &(M7_XformComposer){M7_XformComposeDefault} },
+                { M7_Components.Placement, nullptr },
+                { M7_Components.PointLight, &(M7_PointLight) { .col={{ 1.0, 0.2, 0.1 }}, .energy=20000, .shadow_size=shadow_size } }
+            )},
+            {ECS_Components(
+                { M7_Components.Position, &(vec3){{ 300, 0, 400 }} },
+                { M7_Components.Basis, (mat3x3 []){mat3x3_identity} },
+                { M7_Components.XformComposer, &(M7_XformComposer){M7_XformComposeDefault} },
+                { M7_Components.Placement, nullptr },
+                { M7_Components.PointLight, &(M7_PointLight) { .col={{ 0.9, 0.2, 1.0 }}, .energy=20000, .shadow_size=shadow_size } }
+            )}
+        )
+    });
+}
+
+/* One demo scene cell: a teapot surrounded by four point lights */
+static void AddCell(ECS_Handle *world, vec3 center, BenchConfig *config) {
+    ECS_Entity_AddChildren(world, {
+        ECS_Components(
+            { M7_Components.Position, &center },
+            { M7_Components.Basis, (mat3x3 []){mat3x3_identity} },
+            { M7_Components.MeshPrimitive, nullptr },
+            { M7_Components.Teapot, &(M7_Teapot) { .scale=50 } },
+            { M7_Components.Model, &(M7_ModelArgs) { .get_mesh = M7_Teapot_GetMesh }},
+            { M7_Components.XformComposer, &(M7_XformComposer){M7_XformComposeDefault} }
+        ),
+        ECS_Children({ECS_Components(
+            { M7_Components.SolidColor, &(M7_SolidColor) { .r=1.0, .g=1.0, .b=1.0 } },
+            { M7_Components.Lighting, &(M7_OpticalMedium) { .reflectivity=0.1, .specularity=1.0, .exp=4, .per_vertex=config->gouraud } },
+            { M7_Components.ModelInstance, &(M7_ModelInstanceArgs) {
+                .shader_components = (ECS_Component(M7_ShaderComponent) *[]) { M7_Components.SolidColor, M7_Components.Lighting },
+                .nshaders = 2,
+                .render_batch = Opaque,
+                .flags = M7_RASTERIZER_CULL_BACKFACE
+                       | M7_RASTERIZER_TEST_DEPTH
+                       | M7_RASTERIZER_WRITE_DEPTH
+                       | M7_RASTERIZER_INTERPOLATE_NORMALS
+            }}
+        )})
+    });
+
+    AddLights(world, center, config->shadow_size);
+}
+
+/*
+ * Ring of small spheres around every cell, all placements of one model, so a single geometry is drawn at many
+ * transforms. The model sits at the first sphere and every other placement is relative to it
+ */
+static void AddCrowd(ECS_Handle *world, vec3 *centers, size_t ncenters, BenchConfig *config) {
+    size_t count = ncenters * config->placements;
+    if (!count) return;
+
+    vec3 *offsets = SDL_malloc(sizeof(vec3) * count);
+    ECS_ComponentConstruction (*components)[4] = SDL_malloc(sizeof(ECS_ComponentConstruction [4]) * count);
+    ECS_Construction *children = SDL_malloc(sizeof(ECS_Construction) * count);
+    M7_XformComposer composer = M7_XformComposeDefault;
+
+    for (size_t i = 0; i < count; ++i) {
+        float angle = 2 * SDL_PI_F * (i % config->placements) / config->placements;
+        offsets[i] = vec3_add(centers[i / config->placements], (vec3){{ SDL_cosf(angle) * 300, 12, SDL_sinf(angle) * 300 }});
+    }
+
+    for (size_t i = 1; i < count; ++i) {
+        offsets[i] = vec3_sub(offsets[i], offsets[0]);
+
+        components[i][0] = (ECS_ComponentConstruction) { M7_Components.Position, offsets + i };
+        components[i][1] = (ECS_ComponentConstruction) { M7_Components.Basis, (void *)&mat3x3_identity };
+        components[i][2] = (ECS_ComponentConstruction) { M7_Components.XformComposer, &composer };
+        components[i][3] = (ECS_ComponentConstruction) { M7_Components.Placement, nullptr };
+        children[i] = (ECS_Construction) { .component_constructions = components[i], .ncomponent_constructions = 4 };
+    }
+
+    /* The first child draws the model rather than placing it */
+    children[0] = (ECS_Construction) {ECS_Components(
+        { M7_Components.SolidColor, &(M7_SolidColor) { .r=0.8, .g=0.8, .b=0.8 } },
+        { M7_Components.Lighting, &(M7_OpticalMedium) { .reflectivity=0.1, .specularity=0.5, .exp=3, .per_vertex=config->gouraud } },
+        { M7_Components.ModelInstance, &(M7_ModelInstanceArgs) {
+            .shader_components = (ECS_Component(M7_ShaderComponent) *[]) { M7_Components.SolidColor, M7_Components.Lighting },
+            .nshaders = 2,
+            .render_batch = Opaque,
+            .flags = M7_RASTERIZER_CULL_BACKFACE
+                   | M7_RASTERIZER_TEST_DEPTH
+                   | M7_RASTERIZER_WRITE_DEPTH
+                   | M7_RASTERIZER_INTERPOLATE_NORMALS
+        }}
+    )};
+
+    ECS_Entity_AddChildren(world, {
+        ECS_Components(
+            { M7_Components.Position, offsets },
+            { M7_Components.Basis, (mat3x3 []){mat3x3_identity} },
+            { M7_Components.MeshPrimitive, nullptr },
+            { M7_Components.Sphere, &(M7_Sphere) { .radius=12, .nrings=8, .ring_precision=8 } },
+            { M7_Components.Model, &(M7_ModelArgs) { .get_mesh = M7_Sphere_GetMesh }},
+            { M7_Components.XformComposer, &composer }
+        ),
+        .children = children,
+        .nchildren = count
+    });
+
+    SDL_free(offsets);
+    SDL_free(components);
+    SDL_free(children);
+}
+
+/*
+ * Scale 1 is the demo scene from main.c. Scale n lays out an n x n grid of
+ * demo cells on a correspondingly larger floor, each ringed by config->placements
+ * spheres of one shared model
+ */
+ECS *BenchScene_Create(BenchConfig *config, int scale) {
+    ECS *ecs = ECS_Create();
+    M7_RegisterToECS(ecs);
+
+    ECS_Handle *root = ECS_GetRoot(ecs);
+
+    ECS_Entity_AttachComponents(root,
+        { M7_Components.TextureBank, nullptr },
+        { M7_Components.MeshBank, nullptr },
+        { M7_Components.Offscreen, &(M7_OffscreenArgs){ .path = config->dump }},
+        { M7_Components.Canvas, &(M7_Canvas){
+            .width = config->width,
+            .height = config->height,
+            .parallelism = config->parallelism
+        }}
+    );
+
+    ECS_Entity_AddChildren(root,
+        { /* Main world */
+            ECS_Components(
+                { M7_Components.World, nullptr },
+                { M7_Components.XformComposer, &(M7_XformComposer){M7_XformComposeDefault}},
+                { M7_Components.LightEnvironment, &(M7_LightEnvironment){ .ambient=0.08, .sky_texture_path="assets/Nalovardo.png" } }
+            ),
+            ECS_Children(
+                { /* Camera */
+                    ECS_Components(
+                        { M7_Components.ParallelProjector, &(M7_ParallelProjector) {
+                            .slope = { .x=0, .y=0 },
+                            .scale = { .x=0.5, .y=0.5 }
+                        }},
+                        { M7_Components.PerspectiveFOV, &(float) { SDL_PI_F / 2 } },
+                        { M7_Components.Rasterizer, &(M7_RasterizerArgs) {
+                            .project = SD_SELECT(M7_ProjectPerspective),
+                            .scan = SD_SELECT(M7_ScanPerspective),
+                            .near = 1,
+                            .parallelism = config->parallelism,
+                            .collect_stats = config->stats,
+                            .sky_background = true
+                        }},
+                        { M7_Components.Position, &(vec3){} },
+                        { M7_Components.Basis, (mat3x3 []){mat3x3_identity} }
+                    )
+                },
+                { /* Floor */
+                    ECS_Components(
+                        { M7_Components.Position, &(vec3){ .y=-150, .z=600 } },
+                        { M7_Components.Basis, (mat3x3 []){mat3x3_rotate(mat3x3_identity, vec3_i, SDL_PI_F / 2)} },
+                        { M7_Components.MeshPrimitive, nullptr },
+                        { M7_Components.Rect, &(M7_Rect) { .width=2000 * scale, .height=2000 * scale } },
+                        { M7_Components.Model, &(M7_ModelArgs) { .get_mesh = M7_Rect_GetMesh, .occluder = true }},
+                        { M7_Components.XformComposer, &(M7_XformComposer){M7_XformComposeDefault} }
+                    ),
+                    ECS_Children({ECS_Components(
+                        { M7_Components.Checkerboard, &(M7_Checkerboard) {
+                            .tiles = 31 * scale,
+                            .r1 = 0.4, .g1 = 0.4, .b1 = 0.8,
+                            .r2 = 1.0, .g2 = 1.0, .b2 = 1.0,
+                        }},
+                        { M7_Components.Lighting, &(M7_OpticalMedium) { .reflectivity=0.4, .specularity=0.4, .exp=4 } },
+                        { M7_Components.ModelInstance, &(M7_ModelInstanceArgs) {
+                            .shader_components = (ECS_Component(M7_ShaderComponent) *[]) { M7_Components.Checkerboard, M7_Components.Lighting },
+                            .nshaders = 2,
+                            .render_batch = Opaque,
+                            .flags = M7_RASTERIZER_CULL_BACKFACE
+                                   | M7_RASTERIZER_TEST_DEPTH
+                                   | M7_RASTERIZER_WRITE_DEPTH
+                        }}
+                    )})
+                }
+            )
+        }
+    );
+
+    ECS_Update(ecs);
+
+    ECS_Handle *world = ECS_Entity_DescendantWithComponent(root, M7_Components.World, false);
+
+    vec3 *centers = SDL_malloc(sizeof(vec3) * scale * scale);
+
+    for (int i = 0; i < scale; ++i) {
+        for (int j = 0; j < scale; ++j) {
+            centers[i * scale + j] = (vec3){{
+                (i - (scale - 1) * 0.5f) * CELL_SPACING,
+                -150,
+                600 + (j - (scale - 1) * 0.5f) * CELL_SPACING
+            }};
+
+            AddCell(world, centers[i * scale + j], config);
+        }
+    }
+
+    AddCrowd(world, centers, scale * scale, config);
+    SDL_free(centers);
+
+    ECS_Update(ecs);
+    return ecs;
+}
+
+ECS_Handle *BenchScene_GetCamera(ECS *ecs) {
+    return ECS_Entity_DescendantWithComponent(ECS_GetRoot(ecs), M7_Components.Rasterizer, false);
+}
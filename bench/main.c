@@ -0,0 +1,343 @@
+#include <SDL3/SDL.h>
+#include <M7/ECS.h>
+#include <M7/M7_ECS.h>
+#include <M7/M7_Profile.h>
+#include <M7/Collections/List.h>
+#include <M7/Math/stride.h>
+#include <stdio.h>
+
+#include "Bench.h"
+
+static char *usage =
+    "usage: bench [options]\n"
+    "  --width <px>          canvas width (960)\n"
+    "  --height <px>         canvas height (540)\n"
+    "  --parallelism <n>     rasterizer and present threads (logical cores)\n"
+    "  --simd <ext>          cap dispatch at avx512f, avx2, sse2, neon or scalar\n"
+    "  --frames <n>          measured frames per run (300)\n"
+    "  --warmup <n>          unmeasured frames before each run (30)\n"
+    "  --delta <s>           fixed update delta (1/60)\n"
+    "  --shadows <px>        point light shadow map face size, none if 0 (0)\n"
+    "  --scales <list>       comma separated scene scales (1)\n"
+    "  --placements <n>      spheres ringing each cell, all placements of one model (0)\n"
+    "  --paths <list>        comma separated camera paths among orbit, dolly, flyby and still (orbit,dolly,flyby)\n"
+    "  --output <file>       JSON output, stdout if omitted\n"
+    "  --dump <pattern>      write measured frames, e.g. frames/%04d.ppm\n"
+    "  --stats               report rasterizer counters, averaged per frame\n"
+    "  --gouraud             light the teapots per vertex\n"
+    "  --trace <file>        Chrome trace of the last frames, needs make PROFILE=1\n";
+
+typedef struct BenchRun {
+    CameraPath *path;
+    int scale;
+    double *frame_ms;
+    double total_ms;
+    M7_ProfileAverages stages;
+    M7_RasterizerCounters counters;
+} BenchRun;
+
+static int CompareDouble(const void *lhs, const void *rhs) {
+    double l = *(const double *)lhs, r = *(const double *)rhs;
+    return (l > r) - (l < r);
+}
+
+/* Nearest rank percentile over sorted samples */
+static double Percentile(double *sorted, int n, double p) {
+    int rank = SDL_ceil(p / 100 * n);
+    return sorted[SDL_clamp(rank - 1, 0, n - 1)];
+}
+
+/* Same frame sequence as SDL_AppIterate, minus the frame cap */
+static void Step(ECS *ecs, double delta) {
+    M7_PROFILE_FRAME_BEGIN();
+    ECS_SystemGroup_Process(M7_SystemGroups.Update, delta);
+
+    {
+        M7_PROFILE_SCOPE(M7_PROFILE_ECS_UPDATE);
+        ECS_Update(ecs);
+    }
+
+    ECS_SystemGroup_Process(M7_SystemGroups.PostUpdate);
+    ECS_SystemGroup_ProcessReverse(M7_SystemGroups.Render);
+    ECS_SystemGroup_Process(M7_SystemGroups.RenderPresent);
+    M7_PROFILE_FRAME_END();
+}
+
+static void Run(BenchConfig *config, BenchRun *run) {
+    ECS *ecs = BenchScene_Create(config, run->scale);
+    ECS_Handle *camera = BenchScene_GetCamera(ecs);
+    M7_Offscreen *offscreen = ECS_Entity_GetComponent(ECS_GetRoot(ecs), M7_Components.Offscreen);
+
+    /* Only measured frames are dumped */
+    char *dump = offscreen->path;
+    offscreen->path = nullptr;
+
+    Uint64 freq = SDL_GetPerformanceFrequency();
+    run->frame_ms = SDL_malloc(sizeof(double) * config->frames);
+    run->total_ms = 0;
+
+    for (int i = -config->warmup; i < config->frames; ++i) {
+        float t = i < 0 ? 0 : (float)i / SDL_max(config->frames - 1, 1);
+        vec3 pos;
+        mat3x3 basis;
+        run->path->place(t, run->scale, &pos, &basis);
+        M7_Entity_SetPosition(camera, pos);
+        M7_Entity_SetBasis(camera, basis);
+
+        if (!i) {
+            offscreen->path = dump;
+            offscreen->frame = 0;
+        }
+
+        Uint64 start = SDL_GetPerformanceCounter();
+        Step(ecs, config->delta);
+        Uint64 end = SDL_GetPerformanceCounter();
+
+        if (i < 0)
+            continue;
+
+        run->frame_ms[i] = (double)(end - start) * 1000 / freq;
+        run->total_ms += run->frame_ms[i];
+
+        M7_RasterizerStats *stats = M7_Rasterizer_GetStats(camera);
+
+        if (stats) {
+            size_t *sum = (size_t *)&run->counters, *frame = (size_t *)&stats->total;
+
+            for (size_t j = 0; j < sizeof(M7_RasterizerCounters) / sizeof(size_t); ++j)
+                sum[j] += frame[j];
+        }
+    }
+
+    run->stages = M7_Profile_GetAverages();
+    ECS_Free(ecs);
+}
+
+static void WriteRun(FILE *out, BenchConfig *config, BenchRun *run) {
+    int n = config->frames;
+    double *sorted = SDL_memcpy(SDL_malloc(sizeof(double) * n), run->frame_ms, sizeof(double) * n);
+    SDL_qsort(sorted, n, sizeof(double), CompareDouble);
+
+    double seconds = run->total_ms / 1000;
+
+    fprintf(out, "    {\n");
+    fprintf(out, "      \"path\": \"%s\",\n", run->path->name);
+    fprintf(out, "      \"scale\": %d,\n", run->scale);
+    fprintf(out, "      \"frames\": %d,\n", n);
+    fprintf(out, "      \"total_ms\": %.4f,\n", run->total_ms);
+    fprintf(out, "      \"mean_ms\": %.4f,\n", run->total_ms / n);
+    fprintf(out, "      \"min_ms\": %.4f,\n", sorted[0]);
+    fprintf(out, "      \"p50_ms\": %.4f,\n", Percentile(sorted, n, 50));
+    fprintf(out, "      \"p90_ms\": %.4f,\n", Percentile(sorted, n, 90));
+    fprintf(out, "      \"p95_ms\": %.4f,\n", Percentile(sorted, n, 95));
+    fprintf(out, "      \"p99_ms\": %.4f,\n", Percentile(sorted, n, 99));
+    fprintf(out, "      \"max_ms\": %.4f,\n", sorted[n - 1]);
+    fprintf(out, "      \"fps\": %.4f,\n", n / seconds);
+    fprintf(out, "      \"mpixels_per_s\": %.4f,\n", (double)config->width * config->height * n / seconds / 1e6);
+
+    if (config->stats) {
+        M7_RasterizerCounters *c = &run->counters;
+        fprintf(out, "      \"counters\": {");
+        fprintf(out, "\"instances\": %.1f, ", (double)c->instances / n);
+        fprintf(out, "\"placements_drawn\": %.1f, ", (double)c->placements_drawn / n);
+        fprintf(out, "\"verts_transformed\": %.1f, ", (double)c->verts_transformed / n);
+        fprintf(out, "\"triangles_submitted\": %.1f, ", (double)c->triangles_submitted / n);
+        fprintf(out, "\"vertex_cache_misses\": %.1f, ", (double)c->vertex_cache_misses / n);
+        fprintf(out, "\"acmr\": %.4f, ", c->triangles_submitted ? (double)c->vertex_cache_misses / c->triangles_submitted : 0.0);
+        fprintf(out, "\"meshlets_frustum_culled\": %.1f, ", (double)c->meshlets_frustum_culled / n);
+        fprintf(out, "\"meshlets_backface_culled\": %.1f, ", (double)c->meshlets_backface_culled / n);
+        fprintf(out, "\"placements_frustum_culled\": %.1f, ", (double)c->placements_frustum_culled / n);
+        fprintf(out, "\"placements_occluded\": %.1f, ", (double)c->placements_occluded / n);
+        fprintf(out, "\"triangles_near_clipped\": %.1f, ", (double)c->triangles_near_clipped / n);
+        fprintf(out, "\"triangles_backface_culled\": %.1f, ", (double)c->triangles_backface_culled / n);
+        fprintf(out, "\"triangles_offscreen_culled\": %.1f, ", (double)c->triangles_offscreen_culled / n);
+        fprintf(out, "\"triangles_rasterized\": %.1f, ", (double)c->triangles_rasterized / n);
+        fprintf(out, "\"blocks_scanned\": %.1f, ", (double)c->blocks_scanned / n);
+        fprintf(out, "\"fragments_shaded\": %.1f, ", (double)c->fragments_shaded / n);
+        fprintf(out, "\"fragments_passed\": %.1f", (double)c->fragments_passed / n);
+        fprintf(out, "},\n");
+    }
+
+    if (run->stages.frames) {
+        fprintf(out, "      \"stage_ms\": {");
+
+        for (int i = 0; i < M7_PROFILE_STAGE_COUNT; ++i)
+            fprintf(out, "%s\"%s\": %.4f", i ? ", " : "", M7_Profile_StageName(i), run->stages.ms[i]);
+
+        fprintf(out, "},\n");
+    }
+
+    fprintf(out, "      \"frame_ms\": [");
+
+    for (int i = 0; i < n; ++i)
+        fprintf(out, "%s%.4f", i ? ", " : "", run->frame_ms[i]);
+
+    fprintf(out, "]\n    }");
+    SDL_free(sorted);
+}
+
+static bool ParseArgs(int argc, char **argv, BenchConfig *config, char **scales, char **paths) {
+    for (int i = 1; i < argc; ++i) {
+        char *arg = argv[i];
+
+        if (!SDL_strcmp(arg, "--help")) return false;
+
+        if (!SDL_strcmp(arg, "--stats")) {
+            config->stats = true;
+            continue;
+        }
+
+        if (!SDL_strcmp(arg, "--gouraud")) {
+            config->gouraud = true;
+            continue;
+        }
+
+        if (i + 1 >= argc) {
+            fprintf(stderr, "missing value for %s\n", arg);
+            return false;
+        }
+
+        char *val = argv[++i];
+
+        if (!SDL_strcmp(arg, "--width"))             config->width = SDL_atoi(val);
+        else if (!SDL_strcmp(arg, "--height"))       config->height = SDL_atoi(val);
+        else if (!SDL_strcmp(arg, "--parallelism"))  config->parallelism = SDL_atoi(val);
+        else if (!SDL_strcmp(arg, "--simd"))         config->simd = val;
+        else if (!SDL_strcmp(arg, "--frames"))       config->frames = SDL_atoi(val);
+        else if (!SDL_strcmp(arg, "--warmup"))       config->warmup = SDL_atoi(val);
+        else if (!SDL_strcmp(arg, "--delta"))        config->delta = SDL_atof(val);
+        else if (!SDL_strcmp(arg, "--shadows"))      config->shadow_size = SDL_atoi(val);
+        else if (!SDL_strcmp(arg, "--scales"))       *scales = val;
+        else if (!SDL_strcmp(arg, "--placements"))   config->placements = SDL_atoi(val);
+        else if (!SDL_strcmp(arg, "--paths"))        *paths = val;
+        else if (!SDL_strcmp(arg, "--output"))       config->output = val;
+        else if (!SDL_strcmp(arg, "--dump"))         config->dump = val;
+        else if (!SDL_strcmp(arg, "--trace"))        config->trace = val;
+        else {
+            fprintf(stderr, "unknown option %s\n", arg);
+            return false;
+        }
+    }
+
+    if (config->width <= 0 || config->height <= 0 || config->parallelism <= 0 || config->frames <= 0 || config->warmup < 0 || config->shadow_size < 0 || config->placements < 0) {
+        fprintf(stderr, "invalid configuration\n");
+        return false;
+    }
+
+    return true;
+}
+
+static CameraPath *FindPath(char *name) {
+    for (size_t i = 0; i < ncamera_paths; ++i)
+        if (!SDL_strcmp(camera_paths[i].name, name))
+            return camera_paths + i;
+
+    return nullptr;
+}
+
+int main(int argc, char **argv) {
+    BenchConfig config = {
+        .width = 960,
+        .height = 540,
+        .parallelism = SDL_GetNumLogicalCPUCores(),
+        .frames = 300,
+        .warmup = 30,
+        .delta = 1.0f / 60
+    };
+
+    char *scales = "1", *paths = "orbit,dolly,flyby";
+
+    if (!ParseArgs(argc, argv, &config, &scales, &paths)) {
+        fputs(usage, stderr);
+        return 1;
+    }
+
+    /* Must be set before the first dispatch */
+    if (config.simd) {
+        char *extensions[] = { "avx512f", "avx2", "sse2", "neon", "scalar" };
+        bool known = false;
+
+        for (size_t i = 0; i < SDL_arraysize(extensions); ++i)
+            known |= !SDL_strcmp(config.simd, extensions[i]);
+
+        if (!known) {
+            fprintf(stderr, "unknown SIMD extension %s\n", config.simd);
+            fputs(usage, stderr);
+            return 1;
+        }
+
+        SDL_setenv_unsafe("M7_SIMD", config.simd, 1);
+    }
+
+    /* Caps above what the CPU or build has fall back to the widest variant below them */
+    char *simd = SD_VARIANT_NAME;
+
+    if (config.simd && SDL_strcmp(config.simd, simd))
+        fprintf(stderr, "%s is unavailable, running %s\n", config.simd, simd);
+
+    BenchRun *runs = List_Create(BenchRun);
+    char *scales_copy = SDL_strdup(scales), *paths_copy = SDL_strdup(paths);
+    char *scale_state, *path_state;
+
+    for (char *scale = SDL_strtok_r(scales_copy, ",", &scale_state); scale; scale = SDL_strtok_r(nullptr, ",", &scale_state)) {
+        SDL_strlcpy(paths_copy, paths, SDL_strlen(paths) + 1);
+
+        for (char *name = SDL_strtok_r(paths_copy, ",", &path_state); name; name = SDL_strtok_r(nullptr, ",", &path_state)) {
+            CameraPath *path = FindPath(name);
+
+            if (!path || SDL_atoi(scale) <= 0) {
+                fprintf(stderr, "invalid run %s at scale %s\n", name, scale);
+                return 1;
+            }
+
+            List_Push(runs, ((BenchRun) { .path = path, .scale = SDL_atoi(scale) }));
+        }
+    }
+
+    SDL_free(scales_copy);
+    SDL_free(paths_copy);
+
+    for (size_t i = 0; i < List_Length(runs); ++i) {
+        BenchRun *run = List_GetAddress(runs, i);
+        fprintf(stderr, "%s at scale %d\n", run->path->name, run->scale);
+        Run(&config, run);
+    }
+
+    if (config.trace && !M7_Profile_WriteTrace(config.trace))
+        fprintf(stderr, "no trace written to %s\n", config.trace);
+
+    FILE *out = config.output ? fopen(config.output, "w") : stdout;
+
+    if (!out) {
+        fprintf(stderr, "failed to open %s\n", config.output);
+        return 1;
+    }
+
+    fprintf(out, "{\n");
+    fprintf(out, "  \"width\": %d,\n", config.width);
+    fprintf(out, "  \"height\": %d,\n", config.height);
+    fprintf(out, "  \"parallelism\": %d,\n", config.parallelism);
+    fprintf(out, "  \"simd\": \"%s\",\n", simd);
+    fprintf(out, "  \"simd_cap\": \"%s\",\n", config.simd ? config.simd : "none");
+    fprintf(out, "  \"warmup\": %d,\n", config.warmup);
+    fprintf(out, "  \"delta\": %.6f,\n", config.delta);
+    fprintf(out, "  \"shadows\": %d,\n", config.shadow_size);
+    fprintf(out, "  \"placements\": %d,\n", config.placements);
+    fprintf(out, "  \"gouraud\": %s,\n", config.gouraud ? "true" : "false");
+    fprintf(out, "  \"runs\": [\n");
+
+    for (size_t i = 0; i < List_Length(runs); ++i) {
+        BenchRun *run = List_GetAddress(runs, i);
+        WriteRun(out, &config, run);
+        fprintf(out, i + 1 < List_Length(runs) ? ",\n" : "\n");
+        SDL_free(run->frame_ms);
+    }
+
+    fprintf(out, "  ]\n}\n");
+
+    if (out != stdout) fclose(out);
+
+    List_Free(runs);
+    SDL_Quit();
+    return 0;
+}
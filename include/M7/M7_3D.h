@@ -7,7 +7,53 @@
 #include <M7/Math/linalg.h>
 #include <M7/Math/stride.h>
 
-#define M7_SHADER_DECLARE(name)  SD_DECLARE(sd_vec4, name, void *, state, M7_ShaderParams, fragment)
+#define M7_LIGHT_TILE_SIZE    32
+#define M7_SHADOW_NEAR        1.0f
+#define M7_SHADOW_BIAS        0.02f /* Fraction of occluder depth a receiver may lie behind it and stay lit */
+#define M7_VERTEX_ATTRIBUTES  2
+#define M7_VERTEX_CACHE_SIZE  16 /* Recently used vertices that face ordering and the cache miss counter assume stay cached */
+#define M7_MESHLET_FACES      64
+#define M7_OCCLUSION_WIDTH    256 /* Resolution of the occluder depth buffer, whatever the canvas size */
+#define M7_OCCLUSION_HEIGHT   128
+
+#define M7_SHADER_DECLARE(name)           SD_DECLARE_VOID_RETURN(name, void *, state, M7_FragmentSpan *, span)
+#define M7_SHADER_PREPARER_DECLARE(name)  SD_DECLARE(void *, name, void *, state, void *, uniforms, M7_ShaderFrame *, frame)
+#define M7_VERTEX_SHADER_DECLARE(name)    SD_DECLARE_VOID_RETURN(name, void *, state, M7_VertexSpan *, span)
+
+/*
+ * Defines a shader as an always inlined kernel over one block, plus the exported function pointer target,
+ * which runs the kernel over a whole span in place. Kernels take the block by address so fused pipelines
+ * can keep it in registers
+ */
+#define M7_SHADER_DEFINE(name,state,fragment)                                                                \
+    [[gnu::always_inline]] static inline sd_vec4 name##_Kernel(void *state, M7_ShaderParams *fragment);     \
+                                                                                                             \
+    void SD_VARIANT(name)(void *state, M7_FragmentSpan *span) {                                              \
+        for (size_t i = 0; i < span->length; ++i) {                                                          \
+            M7_ShaderParams block = M7_FragmentSpan_Load(span, i);                                           \
+            span->col[i] = name##_Kernel(state, &block);                                                     \
+        }                                                                                                    \
+    }                                                                                                        \
+                                                                                                             \
+    [[gnu::always_inline]] static inline sd_vec4 name##_Kernel(void *state, M7_ShaderParams *fragment)
+
+/* Defines a single shader running the kernels of up to four defined shaders, with the array of their states as state */
+#define M7_SHADER_FUSE(name,...)                                        \
+    void SD_VARIANT(name)(void *state, M7_FragmentSpan *span) {         \
+        void **states = state;                                          \
+                                                                        \
+        for (size_t i = 0; i < span->length; ++i) {                     \
+            M7_ShaderParams fragment = M7_FragmentSpan_Load(span, i);   \
+            M7_SHADER_STAGES(__VA_ARGS__)                               \
+            span->col[i] = fragment.col;                                \
+        }                                                               \
+    }
+
+#define M7_SHADER_STAGES(...)          __VA_OPT__(M7_SHADER_STAGE1(__VA_ARGS__))
+#define M7_SHADER_STAGE1(shader,...)   fragment.col = shader##_Kernel(states[0], &fragment); __VA_OPT__(M7_SHADER_STAGE2(__VA_ARGS__))
+#define M7_SHADER_STAGE2(shader,...)   fragment.col = shader##_Kernel(states[1], &fragment); __VA_OPT__(M7_SHADER_STAGE3(__VA_ARGS__))
+#define M7_SHADER_STAGE3(shader,...)   fragment.col = shader##_Kernel(states[2], &fragment); __VA_OPT__(M7_SHADER_STAGE4(__VA_ARGS__))
+#define M7_SHADER_STAGE4(shader)       fragment.col = shader##_Kernel(states[3], &fragment);
 
 typedef enum M7_RasterizerFlags {
     M7_RASTERIZER_ALPHA_BLEND         = 1 << 0,
@@ -21,6 +67,9 @@ typedef enum M7_RasterizerFlags {
 } M7_RasterizerFlags;
 
 typedef struct M7_Mesh M7_Mesh;
+typedef struct M7_MeshPrimitive M7_MeshPrimitive;
+typedef struct M7_Placement M7_Placement;
+typedef struct M7_XformNode M7_XformNode;
 typedef struct M7_Sculpture M7_Sculpture;
 typedef struct M7_PolyChain M7_PolyChain;
 typedef struct M7_WorldGeometry M7_WorldGeometry;
@@ -31,10 +80,27 @@ typedef struct M7_ModelInstance M7_ModelInstance;
 typedef struct M7_Rasterizer M7_Rasterizer;
 typedef struct M7_TriangleDraw M7_TriangleDraw;
 typedef struct M7_ShaderParams M7_ShaderParams;
+typedef struct M7_FragmentSpan M7_FragmentSpan;
+typedef struct M7_VertexSpan M7_VertexSpan;
+typedef struct M7_ShaderFrame M7_ShaderFrame;
 
 typedef xform3 (*M7_XformComposer)(ECS_Handle *self, xform3 lhs);
+typedef M7_Mesh *(*M7_MeshParser)(char *path, void *args);
+
+typedef void (*M7_FragmentShader)(void *state, M7_FragmentSpan *span);
+
+/*
+ * Builds the uniform block a shader receives instead of its state, once per frame before rasterization.
+ * Allocates the block when uniforms is null, and returns it
+ */
+typedef void *(*M7_ShaderPreparer)(void *state, void *uniforms, M7_ShaderFrame *frame);
+
+/*
+ * Runs over view space vertices once per frame, after preparers. Reads and writes the instance's vertex
+ * attributes, which are interpolated across faces for the fragment shaders. Shares the fragment shader's state
+ */
+typedef void (*M7_VertexShader)(void *state, M7_VertexSpan *span);
 
-typedef sd_vec4 (*M7_FragmentShader)(void *state, M7_ShaderParams fragment);
 typedef sd_vec2 (*M7_VertexProjector)(ECS_Handle *self, sd_vec3 pos, sd_vec2 midpoint);
 typedef void (*M7_RasterScanner)(ECS_Handle *self, M7_TriangleDraw triangle, M7_RasterizerFlags flags, int (*scanlines)[2], int range[2]);
 
@@ -42,11 +108,52 @@ typedef struct M7_ShaderParams {
     sd_vec4 col;
     sd_vec3 vs, nrml;
     sd_vec2 ts;
-    sd_vec3 vs2ws_xform[3];
+    sd_vec4 attrs[M7_VERTEX_ATTRIBUTES];
+    int x, y; /* Canvas position of the first fragment */
 } M7_ShaderParams;
 
+/* Blocks of one scanline of a triangle, in aligned per-thread buffers that shaders read and write in place */
+typedef struct M7_FragmentSpan {
+    sd_vec4 *col;
+    sd_vec3 *vs, *nrml;
+    sd_vec2 *ts;
+    sd_vec4 *attrs[M7_VERTEX_ATTRIBUTES]; /* Only written for instances with vertex shaders */
+    sd_float *inv_z;
+    int x, y; /* Canvas position of the first fragment */
+    size_t length;
+} M7_FragmentSpan;
+
+static inline M7_ShaderParams M7_FragmentSpan_Load(M7_FragmentSpan *span, size_t i) {
+    M7_ShaderParams params = {
+        .col = span->col[i],
+        .vs = span->vs[i],
+        .nrml = span->nrml[i],
+        .ts = span->ts[i],
+        .x = span->x + (int)i * SD_LENGTH,
+        .y = span->y
+    };
+
+    for (int j = 0; j < M7_VERTEX_ATTRIBUTES; ++j)
+        params.attrs[j] = span->attrs[j][i];
+
+    return params;
+}
+
+/* Blocks of a geometry's view space vertices, with the vertex attributes of one of its instances */
+typedef struct M7_VertexSpan {
+    sd_vec3 *vs, *nrml; /* Normals are null for meshes without them */
+    sd_vec4 *attrs[M7_VERTEX_ATTRIBUTES];
+    size_t length;
+} M7_VertexSpan;
+
+typedef struct M7_ShaderFrame {
+    xform3 vs2ws_xform;
+} M7_ShaderFrame;
+
 typedef struct M7_ShaderComponent {
     M7_FragmentShader callback;
+    M7_ShaderPreparer prepare;
+    M7_VertexShader vertex; /* Null for shaders without a vertex stage */
     void *state;
 } M7_ShaderComponent;
 
@@ -55,7 +162,55 @@ typedef struct M7_MeshFace {
     size_t idx_tverts[3];
 } M7_MeshFace;
 
+/* Faces around each vertex i, from faces[offsets[i]] up to faces[offsets[i + 1]] */
+typedef struct M7_MeshAdjacency {
+    size_t *offsets;
+    size_t *faces;
+    size_t nverts;
+} M7_MeshAdjacency;
+
+typedef struct M7_RasterizerCounters {
+    size_t instances;
+    size_t placements_drawn; /* Summed over instances, each drawn once at every placement left after culling */
+    size_t verts_transformed;
+    size_t triangles_submitted; /* Of the placements left after culling */
+    size_t vertex_cache_misses; /* Of a FIFO cache of M7_VERTEX_CACHE_SIZE vertices, over submitted triangles */
+    size_t meshlets_frustum_culled;
+    size_t meshlets_backface_culled;
+    size_t placements_frustum_culled;
+    size_t placements_occluded;
+    size_t triangles_near_clipped;
+    size_t triangles_backface_culled;
+    size_t triangles_offscreen_culled;
+    size_t triangles_rasterized;
+    size_t blocks_scanned;
+    size_t fragments_shaded;
+    size_t fragments_passed;
+} M7_RasterizerCounters;
+
+/*
+ * Counters of the last rendered frame, per render batch and flag combination.
+ * Vertices are transformed and placements culled once per geometry, so they only appear in the total.
+ * Rasterized triangles include the extra triangles produced by near clipping
+ */
+typedef struct M7_RasterizerStats {
+    M7_RasterizerCounters total;
+    List(M7_RasterizerCounters [M7_RASTERIZER_FLAG_COMBINATIONS]) *batches;
+} M7_RasterizerStats;
+
+/* Nearest face a ray cast hit, with the point and face normal in world space */
+typedef struct M7_RayHit {
+    ECS_Handle *entity; /* Model or Placement the geometry was hit at, or null for geometry registered directly */
+    M7_WorldGeometry *geometry;
+    size_t face;
+    float t; /* Along the ray, in lengths of its direction */
+    vec3 point;
+    vec3 normal;
+} M7_RayHit;
+
 typedef struct M7_TriangleDraw {
+    M7_RasterizerCounters *counters;
+    M7_FragmentSpan *span;
     M7_FragmentShader *shader_pipeline;
     void **shader_states;
     size_t nshaders;
@@ -63,6 +218,8 @@ typedef struct M7_TriangleDraw {
     vec3 vs_nrmls[3];
     vec2 ts_verts[3];
     vec2 ss_verts[3];
+    float attrs[M7_VERTEX_ATTRIBUTES][3][4];
+    bool interpolate_attrs;
 } M7_TriangleDraw;
 
 typedef struct M7_RasterizerArgs {
@@ -70,6 +227,8 @@ typedef struct M7_RasterizerArgs {
     M7_RasterScanner scan;
     float near;
     int parallelism;
+    bool collect_stats;
+    bool sky_background; /* Fill pixels left without depth by geometry with the world's sky */
 } M7_RasterizerArgs;
 
 typedef struct M7_ParallelProjector {
@@ -84,6 +243,7 @@ typedef struct M7_PerspectiveFOV {
 
 typedef struct M7_ModelArgs {
     M7_Mesh *(*get_mesh)(ECS_Handle *self);
+    bool occluder; /* Hides other geometry in the occlusion culling stage. Only suits opaque, solid models */
 } M7_ModelArgs;
 
 typedef struct M7_ModelInstanceArgs {
@@ -95,8 +255,14 @@ typedef struct M7_ModelInstanceArgs {
 
 typedef struct M7_Teapot {
     float scale;
+    int surface; /* Which of the teapot surface assets to load */
 } M7_Teapot;
 
+typedef struct M7_MeshFile {
+    char *path; /* .obj, .ply or .norm */
+    float scale;
+} M7_MeshFile;
+
 typedef struct M7_Torus {
     size_t outer_precision, inner_precision;
     float outer_radius, inner_radius;
@@ -131,16 +297,53 @@ typedef struct M7_TextureMap {
     float scale;
 } M7_TextureMap;
 
+/*
+ * Depths around a point light, in the face layout of cubemap textures. Each texel holds the nearest
+ * distance along its face's axis. Maps are only re-rendered when marked stale
+ */
+typedef struct M7_ShadowMap {
+    float *depth; /* Six faces of width rows, allocated on first render */
+    int width;
+    int stride; /* Floats from one row to the next, padded out to whole vectors */
+    vec3 ws_pos; /* World space position of the light when rendered */
+    size_t generation; /* World geometry generation when rendered */
+    bool stale;
+} M7_ShadowMap;
+
 typedef struct M7_ActiveLight {
     float energy;
+    float radius; /* Unbounded if 0 */
     vec3 col;
     vec3 pos;
+    vec3 world_pos; /* Relative to the world, as composed down its hierarchy */
+    M7_ShadowMap *shadow; /* Null for lights without shadows */
+    M7_Placement *emitter; /* Placement of the light's own model, which casts no shadow from it */
 } M7_ActiveLight;
 
+/*
+ * Lights reaching each M7_LIGHT_TILE_SIZE square of the canvas, rebuilt by the rasterizer every frame.
+ * The lights of tile i are [offsets[i], offsets[i + 1]) of the SoA arrays
+ */
+typedef struct M7_LightTiles {
+    int width, height;
+    size_t *offsets;
+    size_t capacity;
+
+    struct {
+        float *x, *y, *z;
+        float *r, *g, *b;
+        float *energy;
+        float *rcp_sqr_radius;
+        M7_ShadowMap **shadow;
+    } lights;
+} M7_LightTiles;
+
 typedef struct M7_LightEnvironment {
     char *sky_texture_path;
     M7_Texture *sky;
+    M7_CubemapChain *sky_chain; /* Prefiltered levels of the sky for glossy reflections */
     List(M7_ActiveLight *) *lights;
+    M7_LightTiles tiles;
     float ambient;
 } M7_LightEnvironment;
 
@@ -149,6 +352,8 @@ typedef struct M7_PointLight {
     M7_ActiveLight *active;
     vec3 col;
     float energy;
+    float radius; /* Distance at which the light fades out, unbounded inverse square falloff if 0 */
+    int shadow_size; /* Face width of the light's shadow map, no shadows if 0 */
 } M7_PointLight;
 
 typedef struct M7_OpticalMedium {
@@ -156,22 +361,35 @@ typedef struct M7_OpticalMedium {
     float reflectivity;
     float specularity;
     int exp;
+    bool per_vertex; /* Light vertices and interpolate the result across faces, as in Gouraud shading */
 } M7_OpticalMedium;
 
 M7_SHADER_DECLARE(M7_ShadeSolidColor)
 M7_SHADER_DECLARE(M7_ShadeCheckerboard)
 M7_SHADER_DECLARE(M7_ShadeTextureMap)
 M7_SHADER_DECLARE(M7_ShadeLighting)
+M7_SHADER_DECLARE(M7_ShadeVertexLighting)
 M7_SHADER_DECLARE(M7_ShadeSky)
 
+M7_SHADER_PREPARER_DECLARE(M7_PrepareSolidColor)
+M7_SHADER_PREPARER_DECLARE(M7_PrepareCheckerboard)
+M7_SHADER_PREPARER_DECLARE(M7_PrepareLighting)
+M7_SHADER_PREPARER_DECLARE(M7_PrepareSky)
+
+M7_VERTEX_SHADER_DECLARE(M7_LightVertices)
+
 M7_Mesh *M7_Teapot_GetMesh(ECS_Handle *self);
+M7_Mesh *M7_MeshFile_GetMesh(ECS_Handle *self);
 M7_Mesh *M7_Torus_GetMesh(ECS_Handle *self);
 M7_Mesh *M7_Sphere_GetMesh(ECS_Handle *self);
 M7_Mesh *M7_Rect_GetMesh(ECS_Handle *self);
 M7_Mesh *M7_Cubemap_GetMesh(ECS_Handle *self);
 
 xform3 M7_Entity_GetXform(ECS_Handle *self);
-void M7_Entity_Xform(ECS_Handle *self, xform3 lhs);
+void M7_Entity_InvalidateXform(ECS_Handle *self);
+/* Position and Basis are written through these, so the world knows to compose the entity again */
+void M7_Entity_SetPosition(ECS_Handle *self, vec3 position);
+void M7_Entity_SetBasis(ECS_Handle *self, mat3x3 basis);
 
 xform3 M7_XformComposeDefault(ECS_Handle *self, xform3 lhs);
 xform3 M7_XformComposeBillboard(ECS_Handle *self, xform3 lhs);
@@ -179,7 +397,17 @@ xform3 M7_XformComposeCubemap(ECS_Handle *self, xform3 lhs);
 xform3 M7_XformComposeAbsolute(ECS_Handle *self, xform3 lhs);
 
 SD_DECLARE(M7_Mesh *, M7_Mesh_Create, vec3 *, ws_verts, vec3 *, ws_nrmls, vec2 *, ts_verts, M7_MeshFace *, faces, size_t, nverts, size_t, nts_verts, size_t, nfaces)
+SD_DECLARE(M7_Mesh *, M7_Mesh_Load, char *, path, M7_MeshParser, parse, void *, args, Uint32, key)
 void M7_Mesh_Free(M7_Mesh *mesh);
+size_t M7_Mesh_Weld(vec3 *verts, vec3 *nrmls, M7_MeshFace *faces, size_t nverts, size_t nfaces);
+void M7_Mesh_SmoothNormals(vec3 *verts, vec3 *nrmls, M7_MeshFace *faces, size_t nverts, size_t nfaces, M7_MeshAdjacency *adjacency);
+M7_MeshAdjacency *M7_MeshAdjacency_Create(M7_MeshFace *faces, size_t nverts, size_t nfaces);
+void M7_MeshAdjacency_Free(M7_MeshAdjacency *adjacency);
+void M7_Mesh_OptimizeOrder(M7_MeshFace *faces, size_t nverts, size_t nfaces);
+void M7_Mesh_RenumberVertices(M7_MeshFace *faces, size_t nverts, size_t nfaces, size_t *remap);
+M7_Mesh *M7_Mesh_ParseNorm(char *path, void *args);
+M7_Mesh *M7_Mesh_ParseOBJ(char *path, void *args);
+M7_Mesh *M7_Mesh_ParsePLY(char *path, void *args);
 
 void M7_Sculpture_JoinPolyChains(M7_Sculpture *sculpture, M7_PolyChain *pc1, M7_PolyChain *pc2);
 M7_PolyChain *M7_Sculpture_Vertex(M7_Sculpture *sculpture, vec3 pos);
@@ -189,11 +417,15 @@ M7_Sculpture *M7_Sculpture_Create(void);
 void M7_Sculpture_Free(M7_Sculpture *sculpture);
 
 SD_DECLARE(M7_WorldGeometry *, M7_World_RegisterGeometry, ECS_Handle *, self, M7_Mesh *, mesh)
+SD_DECLARE(bool, M7_World_Raycast, ECS_Handle *, self, vec3, origin, vec3, direction, float, max_t, M7_RayHit *, hit)
+SD_DECLARE(bool, M7_World_SegmentBlocked, ECS_Handle *, self, vec3, from, vec3, to)
 
 void M7_RenderInstance_Free(M7_RenderInstance *instance);
 
-M7_RenderInstance *M7_WorldGeometry_Instance(M7_WorldGeometry *geometry, M7_FragmentShader *shader_pipeline, void **shader_states, size_t nshaders, size_t render_batch, M7_RasterizerFlags flags);
+M7_RenderInstance *M7_WorldGeometry_Instance(M7_WorldGeometry *geometry, M7_FragmentShader *shader_pipeline, M7_ShaderPreparer *shader_preparers, M7_VertexShader *vertex_shaders, void **shader_states, size_t nshaders, size_t render_batch, M7_RasterizerFlags flags);
 void M7_WorldGeometry_Free(M7_WorldGeometry *geometry);
+M7_Placement *M7_WorldGeometry_Place(M7_WorldGeometry *geometry);
+void M7_WorldGeometry_Unplace(M7_WorldGeometry *geometry, M7_Placement *placement);
 
 SD_DECLARE(sd_vec2, M7_ProjectParallel, ECS_Handle *, self, sd_vec3, point, sd_vec2, midpoint)
 SD_DECLARE_VOID_RETURN(M7_ScanLinear, ECS_Handle *, self, M7_TriangleDraw, triangle, M7_RasterizerFlags, flags, int (*)[2], scanlines, int [2], range)
@@ -201,6 +433,7 @@ SD_DECLARE_VOID_RETURN(M7_ScanLinear, ECS_Handle *, self, M7_TriangleDraw, trian
 SD_DECLARE(sd_vec2, M7_ProjectPerspective, ECS_Handle *, self, sd_vec3, point, sd_vec2, midpoint)
 SD_DECLARE_VOID_RETURN(M7_ScanPerspective, ECS_Handle *, self, M7_TriangleDraw, triangle, M7_RasterizerFlags, flags, int (*)[2], scanlines, int [2], range)
 
+M7_RasterizerStats *M7_Rasterizer_GetStats(ECS_Handle *self);
 void M7_PerspectiveFOV_Set(ECS_Handle *self, float fov);
 
 #endif /* M7_3D_H */
@@ -17,6 +17,18 @@ typedef struct M7_ViewportArgs {
     int width, height;
 } M7_ViewportArgs;
 
+typedef struct M7_Offscreen {
+    uint32_t *pixels;
+    char *path;
+    int width, height;
+    int frame;
+} M7_Offscreen;
+
+/* Pixels are sized after the canvas on the same entity */
+typedef struct M7_OffscreenArgs {
+    char *path;
+} M7_OffscreenArgs;
+
 typedef struct M7_Canvas {
     ECS_Handle *vp;
     sd_vec3 *color;
@@ -31,6 +43,18 @@ typedef struct M7_Texture {
     int unit;
 } M7_Texture;
 
+#define M7_CUBEMAP_CHAIN_LEVELS     12
+#define M7_CUBEMAP_CHAIN_MIN_WIDTH  4
+
+typedef struct M7_CubemapChain {
+    M7_Texture *levels[M7_CUBEMAP_CHAIN_LEVELS]; /* Level 0 is the source cubemap and is not owned */
+    int nlevels;
+} M7_CubemapChain;
+
+M7_CubemapChain *M7_CubemapChain_Create(M7_Texture *cubemap);
+M7_Texture *M7_CubemapChain_Level(M7_CubemapChain *chain, float angle);
+void M7_CubemapChain_Free(M7_CubemapChain *chain);
+
 static inline sd_vec4 M7_SampleNearest(M7_Texture *texture, sd_vec2 ts) {
     sd_float unit = sd_float_set(texture->unit);
     sd_vec2 pixel_coord = sd_vec2_muls(ts, unit);
@@ -46,8 +70,9 @@ static inline sd_vec4 M7_SampleNearest(M7_Texture *texture, sd_vec2 ts) {
     return sd_vec4_gather(texture->color, pixel_index);
 }
 
-static inline sd_vec4 M7_SampleCubemap(M7_Texture *texture, sd_vec3 dir) {
-    sd_float unit = sd_float_set(texture->width * 0.5f);
+/* Texel index of a direction in a cubemap of the given face width, with faces stacked vertically */
+static inline sd_int M7_CubemapIndex(int width, sd_vec3 dir) {
+    sd_float unit = sd_float_set(width * 0.5f);
     sd_vec3 rcp = sd_vec3_rcp(dir);
 
     sd_vec2 zy = sd_vec2_muls((sd_vec2) { .x=dir.z, .y=dir.y }, sd_float_negate(rcp.x));
@@ -76,17 +101,19 @@ static inline sd_vec4 M7_SampleCubemap(M7_Texture *texture, sd_vec3 dir) {
     sd_vec2 pixel_coord = sd_vec2_mask_blend(sd_vec2_mask_blend(xy, xz, mask_xz), zy, mask_zy);
             pixel_coord = sd_vec2_mul(pixel_coord, flip);
             pixel_coord = sd_vec2_adds(sd_vec2_muls(pixel_coord, unit), unit);
-            pixel_coord = sd_vec2_clamp(pixel_coord, sd_float_zero(), sd_float_set(texture->width - 1));
+            pixel_coord = sd_vec2_clamp(pixel_coord, sd_float_zero(), sd_float_set(width - 1));
 
     sd_int pixel_offset = sd_int_mask_blend(sd_int_mask_blend(idx_xy, idx_xz, mask_xz), idx_zy, mask_zy);
-           pixel_offset = sd_int_mul(pixel_offset, sd_int_set(texture->width * texture->width));
+           pixel_offset = sd_int_mul(pixel_offset, sd_int_set(width * width));
 
-    sd_int pixel_index = sd_int_add(pixel_offset, sd_int_add(sd_int_mul(
+    return sd_int_add(pixel_offset, sd_int_add(sd_int_mul(
         sd_float_to_int(pixel_coord.y),
-        sd_int_set(texture->width)
+        sd_int_set(width)
     ), sd_float_to_int(pixel_coord.x)));
+}
 
-    return sd_vec4_gather(texture->color, pixel_index);
+static inline sd_vec4 M7_SampleCubemap(M7_Texture *texture, sd_vec3 dir) {
+    return sd_vec4_gather(texture->color, M7_CubemapIndex(texture->width, dir));
 }
 
 #endif /* M7_BITMAP_H */
@@ -22,7 +22,8 @@ struct M7_Components {
     ECS_Component(M7_Rasterizer) *Rasterizer;
     ECS_Component(M7_Model) *Model;
     ECS_Component(M7_ModelInstance) *ModelInstance;
-    ECS_Component(M7_XformComposer) *XformComposer;
+    ECS_Component(M7_Placement *) *Placement;
+    ECS_Component(M7_XformNode) *XformComposer;
     ECS_Component(vec3) *Position;
     ECS_Component(mat3x3) *Basis;
     ECS_Component(M7_ParallelProjector) *ParallelProjector;
@@ -39,8 +40,10 @@ struct M7_Components {
     ECS_Component(M7_ShaderComponent) *Sky;
 
     /* 3D primitives */
-    ECS_Component(M7_Mesh *) *MeshPrimitive;
+    ECS_Component(M7_MeshPrimitive) *MeshPrimitive;
+    ECS_Component(M7_ResourceBank(M7_Mesh *)) *MeshBank;
     ECS_Component(M7_Teapot) *Teapot;
+    ECS_Component(M7_MeshFile) *MeshFile;
     ECS_Component(M7_Torus) *Torus;
     ECS_Component(M7_Sphere) *Sphere;
     ECS_Component(M7_Rect) *Rect;
@@ -48,6 +51,7 @@ struct M7_Components {
 
     /* Bitmap */
     ECS_Component(M7_Viewport) *Viewport;
+    ECS_Component(M7_Offscreen) *Offscreen;
     ECS_Component(M7_Canvas) *Canvas;
     ECS_Component(M7_ResourceBank(M7_Texture *)) *TextureBank;
 };
@@ -0,0 +1,95 @@
+/*
+ * Per-stage frame profiler
+ * Instrumentation compiles away unless M7_PROFILE is defined (make PROFILE=1).
+ * Stages are inclusive: a frame contains everything, a draw batch contains
+ * its scans and a scan contains its shading. Scan and shade are too fine
+ * grained for individual events, so they are summed per thread and emitted
+ * as one event per thread per frame
+ */
+
+#ifndef M7_PROFILE_H
+#define M7_PROFILE_H
+
+#include <SDL3/SDL.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#define M7_PROFILE_HISTORY  64
+
+#define M7_PROFILE_CONCAT(a,b)   M7_PROFILE_CONCAT_(a, b)
+#define M7_PROFILE_CONCAT_(a,b)  a##b
+
+#ifdef M7_PROFILE
+
+#define M7_PROFILE_SCOPE(stage)                                                                        \
+    [[gnu::cleanup(M7_Profile_End)]] M7_ProfileScope M7_PROFILE_CONCAT(M7_profile_scope_, __LINE__) =  \
+        M7_Profile_Begin(stage)
+
+#define M7_PROFILE_ACCUMULATE(stage)                                                                          \
+    [[gnu::cleanup(M7_Profile_Accumulate)]] M7_ProfileScope M7_PROFILE_CONCAT(M7_profile_scope_, __LINE__) =  \
+        M7_Profile_Begin(stage)
+
+#define M7_PROFILE_FRAME_BEGIN()  M7_Profile_FrameBegin()
+#define M7_PROFILE_FRAME_END()    M7_Profile_FrameEnd()
+
+#else
+
+#define M7_PROFILE_SCOPE(stage)       ( (void)0 )
+#define M7_PROFILE_ACCUMULATE(stage)  ( (void)0 )
+#define M7_PROFILE_FRAME_BEGIN()      ( (void)0 )
+#define M7_PROFILE_FRAME_END()        ( (void)0 )
+
+#endif /* M7_PROFILE */
+
+typedef enum M7_ProfileStage {
+    M7_PROFILE_FRAME,
+    M7_PROFILE_ECS_UPDATE,
+    M7_PROFILE_XFORM,
+    M7_PROFILE_SHADOW,
+    M7_PROFILE_VERTEX,
+    M7_PROFILE_OCCLUSION,
+    M7_PROFILE_RASTERIZE,
+    M7_PROFILE_DRAW_BATCH,
+    M7_PROFILE_SCAN,
+    M7_PROFILE_SHADE,
+    M7_PROFILE_BACKGROUND,
+    M7_PROFILE_PRESENT,
+    M7_PROFILE_STAGE_COUNT
+} M7_ProfileStage;
+
+typedef struct M7_ProfileScope {
+    M7_ProfileStage stage;
+    Uint64 start;
+} M7_ProfileScope;
+
+/* Milliseconds per frame, summed over all threads */
+typedef struct M7_ProfileAverages {
+    double ms[M7_PROFILE_STAGE_COUNT];
+    int frames;
+} M7_ProfileAverages;
+
+static inline Uint64 M7_Profile_Now(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return SDL_GetPerformanceCounter();
+#endif
+}
+
+static inline M7_ProfileScope M7_Profile_Begin(M7_ProfileStage stage) {
+    return (M7_ProfileScope) { stage, M7_Profile_Now() };
+}
+
+void M7_Profile_End(M7_ProfileScope *scope);
+void M7_Profile_Accumulate(M7_ProfileScope *scope);
+
+void M7_Profile_FrameBegin(void);
+void M7_Profile_FrameEnd(void);
+
+const char *M7_Profile_StageName(M7_ProfileStage stage);
+M7_ProfileAverages M7_Profile_GetAverages(void);
+bool M7_Profile_WriteTrace(const char *path);
+
+#endif /* M7_PROFILE_H */
@@ -4,10 +4,12 @@
 #include <M7/ECS.h>
 #include <M7/Collections/Strmap.h>
 
-#define M7_ResourceBank(type)                     type
-#define M7_ResourceBank_Get(self,component,path)  ( (typeof(*component))M7_ResourceBank_GetActual(self, component, path) )
+#define M7_ResourceBank(type)                      type
+#define M7_ResourceBank_Get(self,component,path)   ( (typeof(*component))M7_ResourceBank_GetActual(self, component, path) )
+#define M7_ResourceBank_Find(self,component,path)  ( (typeof(*component))M7_ResourceBank_FindActual(self, component, path) )
 
 #define M7_RESOURCE_PATHLEN  64
+#define M7_CACHE_DIR         "cache"
 
 typedef void *(*M7_ResourceLoad)(ECS_Handle *self, char *path);
 typedef void (*M7_ResourceFree)(ECS_Handle *self, void *data);
@@ -24,6 +26,8 @@ typedef struct M7_ResourceBank {
 } M7_ResourceBank;
 
 void *M7_ResourceBank_GetActual(ECS_Handle *self, void *component, char *path);
+void *M7_ResourceBank_FindActual(ECS_Handle *self, void *component, char *path);
+void M7_ResourceBank_Add(ECS_Handle *self, void *component, char *path, void *data);
 void M7_ResourceBank_Release(ECS_Handle *self, void *component, char *path);
 void M7_ResourceBank_Attach(ECS_Handle *self, ECS_Component(void) *component, M7_ResourceLoad load, M7_ResourceFree free);
 void M7_ResourceBank_Detach(ECS_Handle *self, ECS_Component(void) *component);
@@ -197,6 +197,20 @@ static inline mat3x3 mat3x3_xpose(mat3x3 m) {
     }};
 }
 
+/* Inverse through the adjugate. The matrix must not be singular */
+static inline mat3x3 mat3x3_inverse(mat3x3 m) {
+    vec3 yz = vec3_cross(m.y, m.z);
+    vec3 zx = vec3_cross(m.z, m.x);
+    vec3 xy = vec3_cross(m.x, m.y);
+    float rcp_det = 1 / vec3_dot(m.x, yz);
+
+    return mat3x3_xpose((mat3x3) {
+        .x = vec3_mul(yz, rcp_det),
+        .y = vec3_mul(zx, rcp_det),
+        .z = vec3_mul(xy, rcp_det)
+    });
+}
+
 static inline vec3 xform3_applyv(xform3 x, vec3 v) {
     return vec3_add(mat3x3_mul(x.basis, v), x.translation);
 }
@@ -208,4 +222,9 @@ static inline xform3 xform3_applyx(xform3 lhs, xform3 rhs) {
     };
 }
 
+static inline xform3 xform3_inverse(xform3 x) {
+    mat3x3 inverse = mat3x3_inverse(x.basis);
+    return (xform3) { inverse, vec3_mul(mat3x3_mul(inverse, x.translation), -1) };
+}
+
 #endif /* LINALG_H */
@@ -136,13 +136,44 @@ SD_DEFINE_TYPES(scalar, float, int32_t, bool) // NOLINT(bugprone-sizeof-expressi
 
 #elifdef SD_DISPATCH_DYNAMIC
 
+/*
+ * The M7_SIMD environment variable caps dynamic dispatch at a narrower extension
+ * (avx512f, avx2, sse2, neon or scalar), as long as that variant was built
+ */
+enum {
+    SD_EXTENSION_SCALAR,
+    SD_EXTENSION_SSE2,
+    SD_EXTENSION_NEON = SD_EXTENSION_SSE2,
+    SD_EXTENSION_AVX2,
+    SD_EXTENSION_AVX512F
+};
+
+static inline int sd_dispatch_cap(void) {
+    static int cap = -1;
+
+    if (cap < 0) {
+        const char *name = SDL_getenv("M7_SIMD");
+
+        if (!name || !SDL_strcmp(name, "avx512f")) cap = SD_EXTENSION_AVX512F;
+        else if (!SDL_strcmp(name, "avx2"))        cap = SD_EXTENSION_AVX2;
+        else if (!SDL_strcmp(name, "sse2"))        cap = SD_EXTENSION_SSE2;
+        else if (!SDL_strcmp(name, "neon"))        cap = SD_EXTENSION_NEON;
+        else if (!SDL_strcmp(name, "scalar"))      cap = SD_EXTENSION_SCALAR;
+        else                                       cap = SD_EXTENSION_AVX512F;
+    }
+
+    return cap;
+}
+
+#define SD_HAS(extension)  ( sd_dispatch_cap() >= SD_EXTENSION_##extension && SDL_Has##extension() )
+
 #ifdef __x86_64__
 #ifdef __AVX512F__
 #define SD_SELECT(fnname)  ( fnname##_avx512f )
 #elifdef __AVX2__
-#define SD_SELECT(fnname)  ( SDL_HasAVX512F() ? fnname##_avx512f : fnname##_avx2 )
+#define SD_SELECT(fnname)  ( SD_HAS(AVX512F) ? fnname##_avx512f : fnname##_avx2 )
 #else
-#define SD_SELECT(fnname)  ( SDL_HasAVX512F() ? fnname##_avx512f : SDL_HasAVX2() ? fnname##_avx2 : fnname##_sse2 )
+#define SD_SELECT(fnname)  ( SD_HAS(AVX512F) ? fnname##_avx512f : SD_HAS(AVX2) ? fnname##_avx2 : fnname##_sse2 )
 #endif
 #endif /* __x86_64__ */
 
@@ -150,7 +181,7 @@ SD_DEFINE_TYPES(scalar, float, int32_t, bool) // NOLINT(bugprone-sizeof-expressi
 #ifdef __SSE2__
 #define SD_SELECT(fnname)  ( fnname##_sse2 )
 #else
-#define SD_SELECT(fnname)  ( SDL_HasSSE2() ? fnname##_sse2 : fnname##_scalar )
+#define SD_SELECT(fnname)  ( SD_HAS(SSE2) ? fnname##_sse2 : fnname##_scalar )
 #endif
 #endif /* __i386__ */
 
@@ -162,7 +193,7 @@ SD_DEFINE_TYPES(scalar, float, int32_t, bool) // NOLINT(bugprone-sizeof-expressi
 #ifdef __ARM_NEON
 #define SD_SELECT(fnname)  ( fnname##_neon )
 #else
-#define SD_SELECT(fnname)  ( SDL_HasNEON() ? fnname##_neon : fnname##_scalar )
+#define SD_SELECT(fnname)  ( SD_HAS(NEON) ? fnname##_neon : fnname##_scalar )
 #endif
 #endif /* __arm__ */
 
@@ -172,6 +203,14 @@ SD_DEFINE_TYPES(scalar, float, int32_t, bool) // NOLINT(bugprone-sizeof-expressi
 
 #endif /* SD_DISPATCH */
 
+/* Name of the variant dispatch selects, pasted together by SD_SELECT like any dispatched function */
+#define sd_variant_name_avx512f  "avx512f"
+#define sd_variant_name_avx2     "avx2"
+#define sd_variant_name_sse2     "sse2"
+#define sd_variant_name_neon     "neon"
+#define sd_variant_name_scalar   "scalar"
+#define SD_VARIANT_NAME          SD_SELECT(sd_variant_name)
+
 #define SD_LENGTH  ( sizeof(sd_float) / sizeof(float) )
 #define SD_ALIGN   ( alignof(sd_float) )
 
@@ -372,6 +411,22 @@ static inline sd_mask sd_mask_set(bool b) {
 #endif
 }
 
+static inline int sd_mask_count(sd_mask m) {
+#ifdef __AVX512F__
+    return __builtin_popcount(_mm512_mask2int(m));
+#elifdef __AVX2__
+    return __builtin_popcount(_mm256_movemask_ps(_mm256_castsi256_ps(m)));
+#elifdef __SSE2__
+    return __builtin_popcount(_mm_movemask_ps(_mm_castsi128_ps(m)));
+#elifdef __ARM_NEON
+    uint32x4_t bits = vshrq_n_u32(m, 31);
+    uint32x2_t pairs = vadd_u32(vget_low_u32(bits), vget_high_u32(bits));
+    return vget_lane_u32(vpadd_u32(pairs, pairs), 0);
+#else
+    return m;
+#endif
+}
+
 static inline sd_int sd_int_add(sd_int lhs, sd_int rhs) {
 #ifdef __AVX512F__
     return (sd_int){_mm512_add_epi32(lhs.val, rhs.val)};
@@ -1097,6 +1152,18 @@ static inline sd_vec3 sd_vec3_gather_strided(sd_vec3 *buf, sd_int index) {
     };
 }
 
+static inline sd_vec2 sd_vec2_gather_strided(sd_vec2 *buf, sd_int index) {
+    sd_int sd_qot = sd_int_shr(index, SD_LOG_LENGTH);
+    sd_int sd_rem = sd_int_and(index, sd_int_set(SD_LENGTH - 1));
+    sd_int sd_idx = sd_int_shl(sd_qot, SD_LOG_LENGTH + 1);
+           sd_idx = sd_int_add(sd_idx, sd_rem);
+
+    return (sd_vec2) {
+        .x = sd_float_gather((float *)&buf->x, sd_idx),
+        .y = sd_float_gather((float *)&buf->y, sd_idx)
+    };
+}
+
 static inline sd_vec4 sd_vec4_gather(float *buf, sd_int index) {
     sd_int base = sd_int_shl(index, 2);
 
@@ -12,7 +12,8 @@ void M7_3D_RegisterToECS(ECS *ecs) {
 
     M7_Components.Rasterizer = ECS_RegisterComponent(ecs, M7_Rasterizer, {
         .attach = M7_Rasterizer_Attach,
-        .init = M7_Rasterizer_Init
+        .init = M7_Rasterizer_Init,
+        .free = M7_Rasterizer_Free
     });
 
     M7_Components.Model = ECS_RegisterComponent(ecs, M7_Model, {
@@ -28,14 +29,21 @@ void M7_3D_RegisterToECS(ECS *ecs) {
         .free = M7_ModelInstance_Free
     });
 
-    M7_Components.XformComposer = ECS_RegisterComponent(ecs, M7_XformComposer, {});
-    M7_Components.Position = ECS_RegisterComponent(ecs, vec3, {});
-    M7_Components.Basis = ECS_RegisterComponent(ecs, mat3x3, {});
+    M7_Components.Placement = ECS_RegisterComponent(ecs, M7_Placement *, {
+        .attach = M7_Placement_Attach,
+        .detach = M7_Placement_Detach
+    });
+
+    M7_Components.XformComposer = ECS_RegisterComponent(ecs, M7_XformNode, { .init = M7_XformNode_Init, .attach = M7_Xform_Attach });
+    M7_Components.Position = ECS_RegisterComponent(ecs, vec3, { .attach = M7_Xform_Attach });
+    M7_Components.Basis = ECS_RegisterComponent(ecs, mat3x3, { .attach = M7_Xform_Attach });
     M7_Components.ParallelProjector = ECS_RegisterComponent(ecs, M7_ParallelProjector, {});
     M7_Components.PerspectiveFOV = ECS_RegisterComponent(ecs, M7_PerspectiveFOV, { .init = M7_PerspectiveFOV_Init });
 
-    M7_Components.MeshPrimitive = ECS_RegisterComponent(ecs, M7_Mesh *, { .init = M7_MeshPrimitive_Init, .free = M7_MeshPrimitive_Free });
+    M7_Components.MeshPrimitive = ECS_RegisterComponent(ecs, M7_MeshPrimitive, { .init = M7_MeshPrimitive_Init, .detach = M7_MeshPrimitive_Detach });
+    M7_Components.MeshBank = ECS_RegisterComponent(ecs, M7_ResourceBank, { .attach = M7_MeshBank_Attach, .detach = M7_ResourceBank_Detach });
     M7_Components.Teapot = ECS_RegisterComponent(ecs, M7_Teapot, {});
+    M7_Components.MeshFile = ECS_RegisterComponent(ecs, M7_MeshFile, { .init = M7_MeshFile_Init, .free = M7_MeshFile_Free });
     M7_Components.Torus = ECS_RegisterComponent(ecs, M7_Torus, {});
     M7_Components.Sphere = ECS_RegisterComponent(ecs, M7_Sphere, {});
     M7_Components.Rect = ECS_RegisterComponent(ecs, M7_Rect, {});
@@ -84,5 +92,6 @@ void M7_3D_RegisterToECS(ECS *ecs) {
 
     ECS_SystemGroup_RegisterSystem(M7_SystemGroups.Render, SD_SELECT(M7_Rasterizer_Render), M7_Components.Rasterizer);
     ECS_SystemGroup_RegisterSystem(M7_SystemGroups.OnXform, M7_Model_OnXform, M7_Components.Model);
+    ECS_SystemGroup_RegisterSystem(M7_SystemGroups.OnXform, M7_Placement_OnXform, M7_Components.Placement);
     ECS_SystemGroup_RegisterSystem(M7_SystemGroups.OnXform, M7_PointLight_OnXform, M7_Components.PointLight);
 }
@@ -2,18 +2,51 @@
 #define M7_3D_C_H
 
 #include <M7/M7_3D.h>
+#include <M7/M7_Resource.h>
 #include <M7/Collections/List.h>
 #include <M7/Math/linalg.h>
 #include <M7/Math/stride.h>
 
+/* A run of consecutive faces, bounded for culling before any of them are drawn */
+typedef struct M7_Meshlet {
+    size_t first_face, nfaces;
+    vec3 center;
+    float radius;
+    vec3 cone_axis; /* Every face normal is within the cone around axis with cosine cone_cos */
+    float cone_cos; /* Zero or less if the faces don't fit in a cone narrower than a hemisphere */
+} M7_Meshlet;
+
+#define M7_MESH_BVH_CHUNKS      ((4 + SD_LENGTH - 1) / SD_LENGTH) /* SIMD chunks of child boxes, for at least 4 children */
+#define M7_MESH_BVH_WIDTH       (M7_MESH_BVH_CHUNKS * SD_LENGTH)
+#define M7_MESH_BVH_LEAF_FACES  4
+
+/* Node of a mesh's wide BVH, so a ray tests every child box at once. Unused lanes hold empty boxes */
+typedef struct M7_MeshBVHNode {
+    sd_vec3 min[M7_MESH_BVH_CHUNKS];
+    sd_vec3 max[M7_MESH_BVH_CHUNKS];
+    Uint32 first[M7_MESH_BVH_WIDTH]; /* Node of inner children, or entry of leaf children's first face in bvh_faces */
+    Uint32 count[M7_MESH_BVH_WIDTH]; /* Faces of leaf children, zero for inner children */
+} M7_MeshBVHNode;
+
 typedef struct M7_Mesh {
     sd_vec3 *ws_verts;
     sd_vec3 *ws_nrmls;
     vec2 *ts_verts;
     M7_MeshFace *faces;
-    size_t nverts, nfaces;
+    M7_Meshlet *meshlets;
+    M7_MeshBVHNode *bvh_nodes; /* Rooted at the first node, if the mesh has faces */
+    Uint32 *bvh_faces; /* Faces in the order BVH leaves refer to them */
+    size_t nverts, nts_verts, nfaces, nmeshlets, nbvh_nodes;
+    void *mapping; /* File the arrays point into, if loaded from cache */
+    size_t mapping_size;
 } M7_Mesh;
 
+typedef struct M7_MeshPrimitive {
+    M7_Mesh *mesh;
+    ECS_Handle *bank; /* Mesh bank sharing the mesh under key, or null if the mesh is owned */
+    char key[M7_RESOURCE_PATHLEN];
+} M7_MeshPrimitive;
+
 typedef struct M7_PolyChain {
     size_t *indices;
     size_t nindices;
@@ -25,34 +58,120 @@ typedef struct M7_Sculpture {
     List(M7_PolyChain *) *chains;
 } M7_Sculpture;
 
+typedef struct M7_Placement {
+    M7_WorldGeometry *geometry;
+    ECS_Handle *entity; /* Model or Placement that owns the placement, if any */
+    xform3 world_xform; /* Relative to the world, as composed down its hierarchy */
+    xform3 xform; /* In view space, as of the last view */
+    xform3 ws_xform; /* World space xform, as of the last time the placement was seen to move */
+    size_t version; /* Bumped whenever xform changes */
+    /* What the placement's vertex block was last computed from, so unchanged blocks are not recomputed */
+    size_t transformed_version;
+    M7_Rasterizer *projected_by;
+    size_t projected_version;
+    size_t bvh_leaf; /* Node of the placement in its world's BVH, as of the last build */
+    bool culled; /* Outside the last view or hidden behind occluders in it, and left untransformed */
+} M7_Placement;
+
 typedef struct M7_WorldGeometry {
     M7_World *world;
     List(M7_RenderInstance *) *instances;
+    List(M7_Placement *) *placements; /* Every instance is drawn once at each placement */
     M7_Mesh *mesh;
+    /* Blocks of sd_bounding_size(nverts) vertices per placement, grown by the first vertex pass that needs them */
     sd_vec3 *vs_verts;
     sd_vec3 *vs_nrmls;
     sd_vec2 *ss_verts;
-    xform3 xform;
+    size_t capacity; /* Placements the vertex buffers hold */
+    bool occluder;
+    vec3 bounds_center; /* Bounding sphere of the mesh */
+    float bounds_radius;
 } M7_WorldGeometry;
 
+/* Pipelines that have a fused shader, as X(fused, stages...) */
+#define M7_FUSED_SHADERS(X)                                                             \
+    X(M7_ShadeSolidColorLighting, M7_ShadeSolidColor, M7_ShadeLighting)                 \
+    X(M7_ShadeCheckerboardLighting, M7_ShadeCheckerboard, M7_ShadeLighting)             \
+    X(M7_ShadeTextureMapLighting, M7_ShadeTextureMap, M7_ShadeLighting)                 \
+    X(M7_ShadeSolidColorVertexLighting, M7_ShadeSolidColor, M7_ShadeVertexLighting)     \
+    X(M7_ShadeCheckerboardVertexLighting, M7_ShadeCheckerboard, M7_ShadeVertexLighting) \
+    X(M7_ShadeTextureMapVertexLighting, M7_ShadeTextureMap, M7_ShadeVertexLighting)
+
+#define M7_FUSED_SHADER_DECLARE(name,...)  M7_SHADER_DECLARE(name)
+M7_FUSED_SHADERS(M7_FUSED_SHADER_DECLARE)
+
 typedef struct M7_RenderInstance {
     M7_WorldGeometry *geometry;
     M7_FragmentShader *shader_pipeline;
-    void **shader_states;
+    M7_ShaderPreparer *shader_preparers;
+    M7_VertexShader *vertex_shaders;
+    sd_vec4 *vertex_attrs; /* M7_VERTEX_ATTRIBUTES arrays of vertex blocks per placement, allocated by the first vertex pass */
+    size_t attrs_capacity; /* Placements vertex_attrs holds */
+    bool vertex_stage; /* Whether any shader has a vertex shader */
+    void **shader_sources;
+    void **shader_states; /* Uniform blocks of prepared shaders, sources otherwise */
     size_t nshaders;
+    /* Fused replacement for the whole pipeline, its state is shader_states */
+    M7_FragmentShader fused_shader;
+    void *fused_state;
     size_t render_batch;
     M7_RasterizerFlags flags;
 } M7_RenderInstance;
 
+/* Composition cached between frames, so only entities that move or sit below one that did are composed again */
+typedef struct M7_XformNode {
+    M7_XformComposer compose;
+    xform3 world;
+    bool stale; /* Compose again on the next M7_World_Xform */
+    bool dirty_below; /* Some entity below is stale */
+    bool view_below; /* Some entity below composes with the view, so the subtree is walked every frame */
+} M7_XformNode;
+
+/*
+ * World space bounding box over the placements of a BVH subtree. Nodes are laid out depth first, so the left child
+ * of an inner node directly follows it and every subtree spans 2 * leaves - 1 nodes
+ */
+typedef struct M7_BVHNode {
+    vec3 min, max;
+    size_t parent; /* SIZE_MAX for the root */
+    size_t right; /* Inner nodes only */
+    size_t leaves;
+    M7_Placement *placement; /* Leaves only */
+} M7_BVHNode;
+
+/* Bounds of one of the items a BVH is built over */
+typedef struct M7_BVHPrimitive {
+    vec3 min, max, centroid;
+    size_t index;
+} M7_BVHPrimitive;
+
+typedef struct M7_WorldBVH {
+    M7_BVHNode *nodes;
+    size_t nnodes;
+    size_t generation; /* Of the world when last built */
+    float built_area; /* Root surface area when last built, to rebuild once refits have loosened the tree */
+} M7_WorldBVH;
+
+/* Subtree whose composer depends on the view, and the world space xform it is composed onto */
+typedef struct M7_ViewXform {
+    ECS_Handle *self;
+    xform3 lhs;
+} M7_ViewXform;
+
 typedef struct M7_World {
     List(M7_WorldGeometry *) *geometry;
+    List(M7_ViewXform) *view_xforms; /* Found by the last M7_World_Xform */
     /* List of arrays of Lists of RenderInstance */
     List(List(M7_RenderInstance *) *[M7_RASTERIZER_FLAG_COMBINATIONS]) *render_batches;
+    M7_WorldBVH bvh; /* Over the world space bounds of every placement */
+    size_t generation; /* Advanced whenever geometry is registered or freed */
 } M7_World;
 
 typedef struct M7_Model {
     M7_WorldGeometry *geometry;
+    M7_Placement *placement; /* The model's own */
     M7_Mesh *(*get_mesh)(ECS_Handle *self);
+    bool occluder;
 } M7_Model;
 
 typedef struct M7_ModelInstance {
@@ -63,13 +182,26 @@ typedef struct M7_ModelInstance {
     M7_RasterizerFlags flags;
 } M7_ModelInstance;
 
+/* Everything screen space vertices depend on besides view space ones */
+typedef struct M7_Projection {
+    M7_VertexProjector project;
+    M7_PerspectiveFOV perspective_fov;
+    M7_ParallelProjector parallel;
+    int width, height;
+} M7_Projection;
+
 typedef struct M7_Rasterizer {
     ECS_Handle *world;
     ECS_Handle *target;
     M7_VertexProjector project;
     M7_RasterScanner scan;
+    M7_RasterizerStats *stats;
+    M7_Projection projection; /* As of the last frame */
+    float *occlusion; /* M7_OCCLUSION_WIDTH by M7_OCCLUSION_HEIGHT view space depths, allocated once occluders show up */
+    size_t projection_version; /* Bumped whenever projection changes */
     float near;
     int parallelism;
+    bool sky_background;
 } M7_Rasterizer;
 
 void M7_3D_RegisterToECS(ECS *ecs);
@@ -82,6 +214,13 @@ void M7_LightEnvironment_Free(void *component);
 void M7_PointLight_OnXform(ECS_Handle *self, xform3 composed);
 void M7_PointLight_Attach(ECS_Handle *self, ECS_Component(void) *component);
 void M7_PointLight_Detach(ECS_Handle *self, ECS_Component(void) *component);
+M7_ShadowMap *M7_ShadowMap_Create(int width);
+void M7_ShadowMap_Free(M7_ShadowMap *shadow);
+
+void *M7_MapFile(char *path, size_t *size);
+void M7_UnmapFile(void *data, size_t size);
+void M7_RunParallel(int nworkers, void (*fn)(void *data, int worker), void *data);
+M7_Meshlet *M7_Mesh_BuildMeshlets(vec3 *verts, M7_MeshFace *faces, size_t nfaces, size_t *nmeshlets);
 
 void M7_Lighting_Attach(ECS_Handle *self, ECS_Component(void) *component);
 void M7_Lighting_Init(void *component, void *args);
@@ -93,6 +232,7 @@ void M7_SolidColor_Init(void *component, void *args);
 void M7_Checkerboard_Init(void *component, void *args);
 
 void M7_ShaderComponent_Free(void *component);
+M7_FragmentShader M7_Shader_Fuse(M7_FragmentShader *shader_pipeline, size_t nshaders);
 
 void M7_TextureMap_Attach(ECS_Handle *self, ECS_Component(void) *component);
 void M7_TextureMap_Detach(ECS_Handle *self, ECS_Component(void) *component);
@@ -100,7 +240,10 @@ void M7_TextureMap_Init(void *component, void *args);
 void M7_TextureMap_Free(void *component);
 
 void M7_MeshPrimitive_Init(void *component, void *args);
-void M7_MeshPrimitive_Free(void *component);
+void M7_MeshPrimitive_Detach(ECS_Handle *self, ECS_Component(void) *component);
+void M7_MeshBank_Attach(ECS_Handle *self, ECS_Component(void) *component);
+void M7_MeshFile_Init(void *component, void *args);
+void M7_MeshFile_Free(void *component);
 
 void M7_Model_Update(ECS_Handle *self, double delta);
 void M7_Model_OnXform(ECS_Handle *self, xform3 composed);
@@ -108,6 +251,10 @@ void M7_Model_Attach(ECS_Handle *self, ECS_Component(void) *component);
 void M7_Model_Detach(ECS_Handle *self, ECS_Component(void) *component);
 void M7_Model_Init(void *component, void *args);
 
+void M7_Placement_OnXform(ECS_Handle *self, xform3 composed);
+void M7_Placement_Attach(ECS_Handle *self, ECS_Component(void) *component);
+void M7_Placement_Detach(ECS_Handle *self, ECS_Component(void) *component);
+
 void M7_ModelInstance_Attach(ECS_Handle *self, ECS_Component(void) *component);
 void M7_ModelInstance_Detach(ECS_Handle *self, ECS_Component(void) *component);
 void M7_ModelInstance_Init(void *component, void *args);
@@ -115,11 +262,43 @@ void M7_ModelInstance_Free(void *component);
 
 void M7_World_Init(void *component, void *args);
 void M7_World_Free(void *component);
+void M7_World_Xform(ECS_Handle *self);
+void M7_World_ViewXform(ECS_Handle *self, M7_LightEnvironment *env, xform3 ws2vs_xform, xform3 vs2ws_xform);
+
+void M7_XformNode_Init(void *component, void *args);
+void M7_Xform_Attach(ECS_Handle *self, ECS_Component(void) *component);
+
+size_t M7_BVH_Split(M7_BVHPrimitive *prims, size_t begin, size_t end);
+void M7_WorldBVH_Update(M7_World *world);
+void M7_WorldBVH_Refit(M7_Placement *placement);
+void M7_WorldBVH_QuerySphere(M7_World *world, vec3 center, float radius, List(M7_Placement *) *placements);
+void M7_WorldBVH_Free(M7_WorldBVH *bvh);
 
 SD_DECLARE_VOID_RETURN(M7_Rasterizer_Render, ECS_Handle *, self)
+SD_DECLARE_VOID_RETURN(M7_Mesh_BuildBVH, M7_Mesh *, mesh)
+SD_DECLARE_VOID_RETURN(M7_Rasterizer_Cull, ECS_Handle *, self, M7_World *, world, xform3, ws2vs_xform)
+SD_DECLARE_VOID_RETURN(M7_LightEnvironment_Cull, M7_LightEnvironment *, env, ECS_Handle *, rasterizer)
+SD_DECLARE_VOID_RETURN(M7_LightEnvironment_Shadow, M7_LightEnvironment *, env, M7_World *, world)
 void M7_Rasterizer_Attach(ECS_Handle *self, ECS_Component(void) *component);
 void M7_Rasterizer_Init(void *component, void *args);
+void M7_Rasterizer_Free(void *component);
+bool M7_SphereOutside(M7_Rasterizer *rasterizer, M7_PerspectiveFOV *perspective_fov, vec2 midpoint, int rows[2], vec3 center, float radius);
 
 void M7_PerspectiveFOV_Init(void *component, void *args);
 
+/* Where the view space segment between two points crosses the near plane */
+static inline vec3 intersect_near(vec3 from, vec3 to, float near) {
+    vec3 path = vec3_sub(to, from);
+    vec3 slope = vec3_div(path, path.z);
+    return vec3_add(from, vec3_mul(slope, near - from.z));
+}
+
+/* Object space vertex of a mesh, out of its lanes */
+static inline vec3 M7_Mesh_Vert(M7_Mesh *mesh, size_t i) {
+    sd_vec3_scalar vert_scalar = sd_vec3_arr_get(mesh->ws_verts, i);
+    vec3 vert;
+    SDL_memcpy(&vert, &vert_scalar, sizeof(vec3));
+    return vert;
+}
+
 #endif /* M7_3D_C_H */
@@ -0,0 +1,303 @@
+#include <float.h>
+#include <SDL3/SDL.h>
+#include <M7/Collections/List.h>
+#include <M7/Math/linalg.h>
+
+#include "M7_3D_c.h"
+
+#define BVH_BINS               12
+#define BVH_REBUILD_GROWTH     2.0f /* Root surface area growth over the last build that refitting may leave */
+#define BVH_MIN_TASK_LEAVES    256 /* Fewest leaves worth building on a worker of their own */
+#define BVH_MAX_WORKERS        16
+
+typedef struct BVHBin {
+    vec3 min, max;
+    size_t count;
+} BVHBin;
+
+typedef struct BVHTask {
+    size_t node, parent;
+    size_t begin, end;
+} BVHTask;
+
+typedef struct BVHBuild {
+    M7_BVHNode *nodes;
+    M7_BVHPrimitive *prims;
+    M7_Placement **placements; /* Of the primitives, by index */
+    List(BVHTask) *tasks; /* Subtrees left to the workers, or null while on one */
+    size_t task_leaves;
+    int nworkers;
+} BVHBuild;
+
+static float SurfaceArea(vec3 min, vec3 max) {
+    vec3 extent = vec3_sub(max, min);
+    return 2 * (extent.x * extent.y + extent.y * extent.z + extent.z * extent.x);
+}
+
+static void Grow(vec3 *min, vec3 *max, vec3 other_min, vec3 other_max) {
+    *min = (vec3) {{ SDL_min(min->x, other_min.x), SDL_min(min->y, other_min.y), SDL_min(min->z, other_min.z) }};
+    *max = (vec3) {{ SDL_max(max->x, other_max.x), SDL_max(max->y, other_max.y), SDL_max(max->z, other_max.z) }};
+}
+
+/* World space box around the bounding sphere of a placement's geometry */
+static void PlacementBounds(M7_Placement *placement, vec3 *min, vec3 *max) {
+    mat3x3 basis = placement->world_xform.basis;
+    float scale = SDL_max(vec3_length(basis.x), SDL_max(vec3_length(basis.y), vec3_length(basis.z)));
+    float radius = placement->geometry->bounds_radius * scale;
+    vec3 center = xform3_apply(placement->world_xform, placement->geometry->bounds_center);
+
+    *min = vec3_sub(center, (vec3) {{ radius, radius, radius }});
+    *max = vec3_add(center, (vec3) {{ radius, radius, radius }});
+}
+
+static void Unite(M7_BVHNode *nodes, size_t index) {
+    M7_BVHNode *node = nodes + index;
+    node->min = nodes[index + 1].min;
+    node->max = nodes[index + 1].max;
+    Grow(&node->min, &node->max, nodes[node->right].min, nodes[node->right].max);
+}
+
+/*
+ * Binned SAH split of a range of primitives along the widest axis of their centroids. Partitions the range in place
+ * and returns where the right half starts. Coincident centroids are split down the middle
+ */
+size_t M7_BVH_Split(M7_BVHPrimitive *prims, size_t begin, size_t end) {
+    vec3 min = prims[begin].centroid;
+    vec3 max = prims[begin].centroid;
+
+    for (size_t i = begin + 1; i < end; ++i)
+        Grow(&min, &max, prims[i].centroid, prims[i].centroid);
+
+    vec3 extent = vec3_sub(max, min);
+    int axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : extent.y >= extent.z ? 1 : 2;
+    float axis_min = min.entries[axis];
+    float axis_extent = extent.entries[axis];
+
+    if (axis_extent <= 0)
+        return begin + (end - begin) / 2;
+
+    BVHBin bins[BVH_BINS];
+
+    for (int i = 0; i < BVH_BINS; ++i)
+        bins[i] = (BVHBin) { {{ FLT_MAX, FLT_MAX, FLT_MAX }}, {{ -FLT_MAX, -FLT_MAX, -FLT_MAX }}, 0 };
+
+    float to_bin = BVH_BINS / axis_extent;
+
+    for (size_t i = begin; i < end; ++i) {
+        int bin = SDL_min((int)((prims[i].centroid.entries[axis] - axis_min) * to_bin), BVH_BINS - 1);
+        Grow(&bins[bin].min, &bins[bin].max, prims[i].min, prims[i].max);
+        bins[bin].count += 1;
+    }
+
+    /* Cost of splitting before each bin, sweeping the right halves from the far end */
+    float right_costs[BVH_BINS];
+    vec3 right_min = bins[BVH_BINS - 1].min;
+    vec3 right_max = bins[BVH_BINS - 1].max;
+    size_t right_count = bins[BVH_BINS - 1].count;
+
+    for (int i = BVH_BINS - 1; i > 0; --i) {
+        right_costs[i] = right_count ? SurfaceArea(right_min, right_max) * right_count : 0;
+        Grow(&right_min, &right_max, bins[i - 1].min, bins[i - 1].max);
+        right_count += bins[i - 1].count;
+    }
+
+    vec3 left_min = bins[0].min;
+    vec3 left_max = bins[0].max;
+    size_t left_count = bins[0].count;
+    float best_cost = FLT_MAX;
+    int best_bin = 1;
+
+    for (int i = 1; i < BVH_BINS; ++i) {
+        float cost = (left_count ? SurfaceArea(left_min, left_max) * left_count : 0) + right_costs[i];
+
+        if (cost < best_cost) {
+            best_cost = cost;
+            best_bin = i;
+        }
+
+        Grow(&left_min, &left_max, bins[i].min, bins[i].max);
+        left_count += bins[i].count;
+    }
+
+    size_t mid = begin;
+
+    for (size_t i = begin; i < end; ++i) {
+        int bin = SDL_min((int)((prims[i].centroid.entries[axis] - axis_min) * to_bin), BVH_BINS - 1);
+
+        if (bin < best_bin) {
+            M7_BVHPrimitive swap = prims[i];
+            prims[i] = prims[mid];
+            prims[mid++] = swap;
+        }
+    }
+
+    return mid;
+}
+
+/* Lays out the subtree over a range of primitives from a node on. Inner node bounds are left to Unite */
+static void BuildNode(BVHBuild *build, size_t index, size_t parent, size_t begin, size_t end) {
+    M7_BVHNode *node = build->nodes + index;
+
+    *node = (M7_BVHNode) {
+        .parent = parent,
+        .leaves = end - begin
+    };
+
+    if (end - begin == 1) {
+        node->min = build->prims[begin].min;
+        node->max = build->prims[begin].max;
+        node->placement = build->placements[build->prims[begin].index];
+        node->placement->bvh_leaf = index;
+        return;
+    }
+
+    /* Subtrees small enough go to the workers whole */
+    if (build->tasks && end - begin <= build->task_leaves) {
+        List_Push(build->tasks, ((BVHTask) { index, parent, begin, end }));
+        return;
+    }
+
+    size_t mid = M7_BVH_Split(build->prims, begin, end);
+    node->right = index + 2 * (mid - begin);
+    BuildNode(build, index + 1, index, begin, mid);
+    BuildNode(build, node->right, index, mid, end);
+}
+
+static void BuildTasks(void *data, int worker) {
+    BVHBuild *build = data;
+    BVHBuild serial = { .nodes = build->nodes, .prims = build->prims, .placements = build->placements };
+
+    for (size_t i = worker; i < List_Length(build->tasks); i += build->nworkers) {
+        BVHTask task = List_Get(build->tasks, i);
+        BuildNode(&serial, task.node, task.parent, task.begin, task.end);
+    }
+}
+
+/*
+ * Rebuilds the tree over every placement with binned SAH splits. The top of the tree is split on the calling thread
+ * until the subtrees below are small enough to share out, then those are built on workers in parallel. Each
+ * subtree's node range follows from its leaf count alone, so workers never touch each other's nodes
+ */
+static void Build(M7_World *world) {
+    M7_WorldBVH *bvh = &world->bvh;
+    size_t nprims = 0;
+
+    List_ForEach(world->geometry, wg, nprims += List_Length(wg->placements); );
+
+    M7_BVHPrimitive *prims = SDL_malloc(sizeof(M7_BVHPrimitive) * SDL_max(nprims, 1));
+    M7_Placement **placements = SDL_malloc(sizeof(M7_Placement *) * SDL_max(nprims, 1));
+    size_t i = 0;
+
+    List_ForEach(world->geometry, wg, {
+        List_ForEach(wg->placements, placement, {
+            M7_BVHPrimitive *prim = prims + i;
+            PlacementBounds(placement, &prim->min, &prim->max);
+            prim->centroid = vec3_mul(vec3_add(prim->min, prim->max), 0.5f);
+            prim->index = i;
+            placements[i++] = placement;
+        });
+    });
+
+    SDL_free(bvh->nodes);
+    bvh->nodes = nprims ? SDL_malloc(sizeof(M7_BVHNode) * (2 * nprims - 1)) : nullptr;
+    bvh->nnodes = nprims ? 2 * nprims - 1 : 0;
+    bvh->generation = world->generation;
+
+    if (nprims) {
+        int nworkers = nprims < 2 * BVH_MIN_TASK_LEAVES ? 1 : SDL_clamp(SDL_GetNumLogicalCPUCores(), 1, BVH_MAX_WORKERS);
+
+        BVHBuild build = {
+            .nodes = bvh->nodes,
+            .prims = prims,
+            .placements = placements,
+            .tasks = nworkers > 1 ? List_Create(BVHTask) : nullptr,
+            .task_leaves = SDL_max(nprims / nworkers, BVH_MIN_TASK_LEAVES),
+            .nworkers = nworkers
+        };
+
+        BuildNode(&build, 0, SIZE_MAX, 0, nprims);
+
+        if (build.tasks) {
+            M7_RunParallel(nworkers, BuildTasks, &build);
+            List_Free(build.tasks);
+        }
+
+        /* Children follow their parents, so a backward sweep sees them united first */
+        for (size_t j = bvh->nnodes; j-- > 0;)
+            if (!bvh->nodes[j].placement)
+                Unite(bvh->nodes, j);
+
+        bvh->built_area = SurfaceArea(bvh->nodes[0].min, bvh->nodes[0].max);
+    }
+
+    SDL_free(placements);
+    SDL_free(prims);
+}
+
+/*
+ * Brings a world's BVH up to date with its placements. Placements moving only refit the tree as they go, but
+ * registering, placing or freeing geometry, or refits loosening the tree too far, rebuild it
+ */
+void M7_WorldBVH_Update(M7_World *world) {
+    M7_WorldBVH *bvh = &world->bvh;
+
+    if (bvh->generation != world->generation
+        || (bvh->nnodes && SurfaceArea(bvh->nodes[0].min, bvh->nodes[0].max) > bvh->built_area * BVH_REBUILD_GROWTH))
+        Build(world);
+}
+
+/* Fits a placement's leaf to where it was moved, and its ancestors up to the first that still holds it as is */
+void M7_WorldBVH_Refit(M7_Placement *placement) {
+    M7_World *world = placement->geometry->world;
+    M7_WorldBVH *bvh = &world->bvh;
+
+    /* Placements since the last build aren't in the tree, which the next update rebuilds anyway */
+    if (bvh->generation != world->generation)
+        return;
+
+    M7_BVHNode *leaf = bvh->nodes + placement->bvh_leaf;
+    PlacementBounds(placement, &leaf->min, &leaf->max);
+
+    for (size_t index = leaf->parent; index != SIZE_MAX; index = bvh->nodes[index].parent) {
+        M7_BVHNode *node = bvh->nodes + index;
+        vec3 min = node->min;
+        vec3 max = node->max;
+        Unite(bvh->nodes, index);
+
+        if (!SDL_memcmp(&min, &node->min, sizeof(vec3)) && !SDL_memcmp(&max, &node->max, sizeof(vec3)))
+            break;
+    }
+}
+
+/* Appends the placements whose bounds may come within a world space sphere */
+void M7_WorldBVH_QuerySphere(M7_World *world, vec3 center, float radius, List(M7_Placement *) *placements) {
+    M7_WorldBVH *bvh = &world->bvh;
+    size_t index = 0;
+
+    /* Depth first, skipping past whole subtrees that miss */
+    while (index < bvh->nnodes) {
+        M7_BVHNode *node = bvh->nodes + index;
+
+        vec3 nearest = {{
+            SDL_clamp(center.x, node->min.x, node->max.x),
+            SDL_clamp(center.y, node->min.y, node->max.y),
+            SDL_clamp(center.z, node->min.z, node->max.z)
+        }};
+
+        vec3 offset = vec3_sub(nearest, center);
+
+        if (vec3_dot(offset, offset) > radius * radius) {
+            index += 2 * node->leaves - 1;
+            continue;
+        }
+
+        if (node->placement)
+            List_Push(placements, node->placement);
+
+        index += 1;
+    }
+}
+
+void M7_WorldBVH_Free(M7_WorldBVH *bvh) {
+    SDL_free(bvh->nodes);
+}
@@ -7,52 +7,85 @@
 
 #include "M7_3D_c.h"
 
+/*
+ * Faces are ordered for vertex reuse and grouped into meshlets, see M7_Mesh_OptimizeOrder and M7_Mesh_BuildMeshlets,
+ * then vertices are renumbered to match. A BVH over the faces is built for ray casts
+ */
 M7_Mesh *SD_VARIANT(M7_Mesh_Create)(vec3 *ws_verts, vec3 *ws_nrmls, vec2 *ts_verts, M7_MeshFace *faces, size_t nverts, size_t nts_verts, size_t nfaces) {
     M7_Mesh *mesh = SDL_malloc(sizeof(M7_Mesh));
     sd_vec3 *vbuf = SDL_aligned_alloc(SD_ALIGN, sizeof(sd_vec3) * sd_bounding_size(nverts));
     sd_vec3 *nbuf = ws_nrmls ? SDL_aligned_alloc(SD_ALIGN, sizeof(sd_vec3) * sd_bounding_size(nverts)) : nullptr;
+    M7_MeshFace *fbuf = SDL_memcpy(SDL_malloc(sizeof(M7_MeshFace) * nfaces), faces, sizeof(M7_MeshFace) * nfaces);
+    size_t *remap = SDL_malloc(sizeof(size_t) * SDL_max(nverts, 1));
+    size_t nmeshlets;
+
+    M7_Mesh_OptimizeOrder(fbuf, nverts, nfaces);
+    M7_Meshlet *meshlets = M7_Mesh_BuildMeshlets(ws_verts, fbuf, nfaces, &nmeshlets);
+    M7_Mesh_RenumberVertices(fbuf, nverts, nfaces, remap);
 
     for (size_t i = 0; i < nverts; ++i)
-        sd_vec3_arr_set(vbuf, i, ws_verts[i].x, ws_verts[i].y, ws_verts[i].z);
+        sd_vec3_arr_set(vbuf, remap[i], ws_verts[i].x, ws_verts[i].y, ws_verts[i].z);
 
     if (nbuf)
         for (size_t i = 0; i < nverts; ++i)
-            sd_vec3_arr_set(nbuf, i, ws_nrmls[i].x, ws_nrmls[i].y, ws_nrmls[i].z);
+            sd_vec3_arr_set(nbuf, remap[i], ws_nrmls[i].x, ws_nrmls[i].y, ws_nrmls[i].z);
+
+    SDL_free(remap);
 
     *mesh = (M7_Mesh) {
         .ws_verts = vbuf,
         .ws_nrmls = nbuf,
         .ts_verts = nts_verts ? SDL_memcpy(SDL_malloc(sizeof(vec2) * nts_verts), ts_verts, sizeof(vec2) * nts_verts) : nullptr,
-        .faces = SDL_memcpy(SDL_malloc(sizeof(M7_MeshFace) * nfaces), faces, sizeof(M7_MeshFace) * nfaces),
+        .faces = fbuf,
+        .meshlets = meshlets,
         .nverts = nverts,
-        .nfaces = nfaces
+        .nts_verts = nts_verts,
+        .nfaces = nfaces,
+        .nmeshlets = nmeshlets
     };
 
+    SD_VARIANT(M7_Mesh_BuildBVH)(mesh);
     return mesh;
 }
 
+/* Registers geometry with one placement at the origin */
 M7_WorldGeometry *SD_VARIANT(M7_World_RegisterGeometry)(ECS_Handle *self, M7_Mesh *mesh) {
     M7_World *world = ECS_Entity_GetComponent(self, M7_Components.World);
     M7_WorldGeometry *geometry = SDL_malloc(sizeof(M7_WorldGeometry));
-    size_t sd_count = sd_bounding_size(mesh->nverts);
+
+    /* Bounding sphere around the center of the mesh's bounding box */
+    vec3 min = mesh->nverts ? M7_Mesh_Vert(mesh, 0) : vec3_zero;
+    vec3 max = min;
+
+    for (size_t i = 1; i < mesh->nverts; ++i) {
+        vec3 vert = M7_Mesh_Vert(mesh, i);
+        min = (vec3) {{ SDL_min(min.x, vert.x), SDL_min(min.y, vert.y), SDL_min(min.z, vert.z) }};
+        max = (vec3) {{ SDL_max(max.x, vert.x), SDL_max(max.y, vert.y), SDL_max(max.z, vert.z) }};
+    }
+
+    vec3 center = vec3_mul(vec3_add(min, max), 0.5f);
+    float radius = 0;
+
+    for (size_t i = 0; i < mesh->nverts; ++i)
+        radius = SDL_max(radius, vec3_length(vec3_sub(M7_Mesh_Vert(mesh, i), center)));
 
     *geometry = (M7_WorldGeometry) {
         .world = world,
         .instances = List_Create(M7_RenderInstance *),
+        .placements = List_Create(M7_Placement *),
         .mesh = mesh,
-        .vs_verts = SDL_aligned_alloc(SD_ALIGN, sizeof(sd_vec3) * sd_count),
-        .vs_nrmls = mesh->ws_nrmls ? SDL_aligned_alloc(SD_ALIGN, sizeof(sd_vec3) * sd_count) : nullptr,
-        .ss_verts = SDL_aligned_alloc(SD_ALIGN, sizeof(sd_vec2) * sd_count),
-        .xform = { mat3x3_identity, vec3_zero }
+        .bounds_center = center,
+        .bounds_radius = radius
     };
 
     List_Push(world->geometry, geometry);
+    M7_WorldGeometry_Place(geometry);
     return geometry;
 }
 
 #ifndef SD_SRC_VARIANT
 
-M7_RenderInstance *M7_WorldGeometry_Instance(M7_WorldGeometry *geometry, M7_FragmentShader *shader_pipeline, void **shader_states, size_t nshaders, size_t render_batch, M7_RasterizerFlags flags) {
+M7_RenderInstance *M7_WorldGeometry_Instance(M7_WorldGeometry *geometry, M7_FragmentShader *shader_pipeline, M7_ShaderPreparer *shader_preparers, M7_VertexShader *vertex_shaders, void **shader_states, size_t nshaders, size_t render_batch, M7_RasterizerFlags flags) {
     M7_World *world = geometry->world;
 
     if (List_Length(world->render_batches) < render_batch + 1) {
@@ -74,20 +107,73 @@ M7_RenderInstance *M7_WorldGeometry_Instance(M7_WorldGeometry *geometry, M7_Frag
     *instance = (M7_RenderInstance) {
         .geometry = geometry,
         .shader_pipeline = SDL_memcpy(SDL_malloc(sizeof(M7_FragmentShader) * nshaders), shader_pipeline, sizeof(M7_FragmentShader) * nshaders),
+        .shader_preparers = SDL_calloc(nshaders, sizeof(M7_ShaderPreparer)),
+        .vertex_shaders = SDL_calloc(nshaders, sizeof(M7_VertexShader)),
+        .shader_sources = SDL_memcpy(SDL_malloc(sizeof(void *) * nshaders), shader_states, sizeof(void *) * nshaders),
         .shader_states = SDL_memcpy(SDL_malloc(sizeof(void *) * nshaders), shader_states, sizeof(void *) * nshaders),
         .nshaders = nshaders,
+        .fused_shader = M7_Shader_Fuse(shader_pipeline, nshaders),
         .render_batch = render_batch,
         .flags = flags
     };
 
+    instance->fused_state = instance->shader_states;
+
+    /* Uniform blocks are allocated by the first prepare */
+    if (shader_preparers) {
+        for (size_t i = 0; i < nshaders; ++i) {
+            instance->shader_preparers[i] = shader_preparers[i];
+
+            if (shader_preparers[i])
+                instance->shader_states[i] = nullptr;
+        }
+    }
+
+    if (vertex_shaders) {
+        for (size_t i = 0; i < nshaders; ++i) {
+            instance->vertex_shaders[i] = vertex_shaders[i];
+            instance->vertex_stage |= vertex_shaders[i] != nullptr;
+        }
+    }
+
     List_Push(flag_batches[flags], instance);
     List_Push(geometry->instances, instance);
     return instance;
 }
 
+/* Adds a placement at the origin, drawing every instance of the geometry once more */
+M7_Placement *M7_WorldGeometry_Place(M7_WorldGeometry *geometry) {
+    M7_Placement *placement = SDL_malloc(sizeof(M7_Placement));
+
+    *placement = (M7_Placement) {
+        .geometry = geometry,
+        .world_xform = { mat3x3_identity, vec3_zero },
+        .xform = { mat3x3_identity, vec3_zero },
+        .ws_xform = { mat3x3_identity, vec3_zero },
+        .version = 1
+    };
+
+    List_Push(geometry->placements, placement);
+    geometry->world->generation += 1;
+    return placement;
+}
+
+void M7_WorldGeometry_Unplace(M7_WorldGeometry *geometry, M7_Placement *placement) {
+    List_RemoveWhere(geometry->placements, placed, placed == placement);
+    geometry->world->generation += 1;
+    SDL_free(placement);
+
+    /* Later placements shift into other vertex blocks */
+    List_ForEach(geometry->placements, placed, {
+        placed->transformed_version = 0;
+        placed->projected_by = nullptr;
+    });
+}
+
 void M7_Model_OnXform(ECS_Handle *self, xform3 composed) {
     M7_Model *model = ECS_Entity_GetComponent(self, M7_Components.Model);
-    model->geometry->xform = composed;
+    model->placement->world_xform = composed;
+    M7_WorldBVH_Refit(model->placement);
 }
 
 void M7_Model_Attach(ECS_Handle *self, ECS_Component(void) *component) {
@@ -95,6 +181,25 @@ void M7_Model_Attach(ECS_Handle *self, ECS_Component(void) *component) {
     ECS_Handle *world = ECS_Entity_AncestorWithComponent(self, M7_Components.World, false);
     M7_Mesh *mesh = mdl->get_mesh(self);
     mdl->geometry = M7_World_RegisterGeometry(world, mesh);
+    mdl->placement = List_Get(mdl->geometry->placements, 0);
+    mdl->placement->entity = self;
+    mdl->geometry->occluder = mdl->occluder;
+    M7_Entity_InvalidateXform(self);
+}
+
+void M7_Placement_OnXform(ECS_Handle *self, xform3 composed) {
+    M7_Placement **placement = ECS_Entity_GetComponent(self, M7_Components.Placement);
+    (*placement)->world_xform = composed;
+    M7_WorldBVH_Refit(*placement);
+}
+
+/* Placements draw the geometry of the nearest model above them again, with their own xform */
+void M7_Placement_Attach(ECS_Handle *self, ECS_Component(void) *component) {
+    M7_Placement **placement = ECS_Entity_GetComponent(self, component);
+    ECS_Handle *mdl = ECS_Entity_AncestorWithComponent(self, M7_Components.Model, false);
+    *placement = M7_WorldGeometry_Place(ECS_Entity_GetComponent(mdl, M7_Components.Model)->geometry);
+    (*placement)->entity = self;
+    M7_Entity_InvalidateXform(self);
 }
 
 void M7_ModelInstance_Attach(ECS_Handle *self, ECS_Component(void) *component) {
@@ -103,16 +208,22 @@ void M7_ModelInstance_Attach(ECS_Handle *self, ECS_Component(void) *component) {
     M7_WorldGeometry *geometry = ECS_Entity_GetComponent(mdl, M7_Components.Model)->geometry;
 
     M7_FragmentShader *shader_pipeline = SDL_malloc(sizeof(M7_FragmentShader) * mdlinst->nshaders);
+    M7_ShaderPreparer *shader_preparers = SDL_malloc(sizeof(M7_ShaderPreparer) * mdlinst->nshaders);
+    M7_VertexShader *vertex_shaders = SDL_malloc(sizeof(M7_VertexShader) * mdlinst->nshaders);
     void **shader_states = SDL_malloc(sizeof(void *) * mdlinst->nshaders);
 
     for (size_t i = 0; i < mdlinst->nshaders; ++i) {
         M7_ShaderComponent *shader_component = ECS_Entity_GetComponent(self, mdlinst->shader_components[i]);
         shader_pipeline[i] = shader_component->callback;
+        shader_preparers[i] = shader_component->prepare;
+        vertex_shaders[i] = shader_component->vertex;
         shader_states[i] = shader_component->state;
     }
 
-    mdlinst->instance = M7_WorldGeometry_Instance(geometry, shader_pipeline, shader_states, mdlinst->nshaders, mdlinst->render_batch, mdlinst->flags);
+    mdlinst->instance = M7_WorldGeometry_Instance(geometry, shader_pipeline, shader_preparers, vertex_shaders, shader_states, mdlinst->nshaders, mdlinst->render_batch, mdlinst->flags);
     SDL_free(shader_pipeline);
+    SDL_free(shader_preparers);
+    SDL_free(vertex_shaders);
     SDL_free(shader_states);
 }
 
@@ -126,18 +237,28 @@ void M7_ModelInstance_Detach(ECS_Handle *self, ECS_Component(void) *component) {
     M7_RenderInstance_Free(mdlinst->instance);
 }
 
+void M7_Placement_Detach(ECS_Handle *self, ECS_Component(void) *component) {
+    M7_Placement **placement = ECS_Entity_GetComponent(self, component);
+    ECS_Handle *mdl = ECS_Entity_AncestorWithComponent(self, M7_Components.Model, false);
+    M7_WorldGeometry_Unplace(ECS_Entity_GetComponent(mdl, M7_Components.Model)->geometry, *placement);
+}
+
 void M7_World_Init(void *component, void *args) {
     (void)args;
 
     M7_World *world = component;
     world->geometry = List_Create(M7_WorldGeometry *);
+    world->view_xforms = List_Create(M7_ViewXform);
     world->render_batches = List_Create(List(M7_RenderInstance *) *[M7_RASTERIZER_FLAG_COMBINATIONS]);
+    world->bvh = (M7_WorldBVH) {};
+    world->generation = 0;
 }
 
 void M7_Model_Init(void *component, void *args) {
     M7_Model *mdl = component;
     M7_ModelArgs *mdl_args = args;
     mdl->get_mesh = mdl_args->get_mesh;
+    mdl->occluder = mdl_args->occluder;
 }
 
 void M7_ModelInstance_Init(void *component, void *args) {
@@ -159,13 +280,26 @@ void M7_ModelInstance_Free(void *component) {
     SDL_free(mdlinst->shader_components);
 }
 
+static void FreeShaders(M7_RenderInstance *instance) {
+    for (size_t i = 0; i < instance->nshaders; ++i)
+        if (instance->shader_preparers[i])
+            SDL_aligned_free(instance->shader_states[i]);
+
+    SDL_free(instance->shader_pipeline);
+    SDL_free(instance->shader_preparers);
+    SDL_free(instance->vertex_shaders);
+    SDL_aligned_free(instance->vertex_attrs);
+    SDL_free(instance->shader_sources);
+    SDL_free(instance->shader_states);
+}
+
 void M7_RenderInstance_Free(M7_RenderInstance *instance) {
     M7_World *world = instance->geometry->world;
 
     List(M7_RenderInstance *) *flag_batch = List_Get(world->render_batches, instance->render_batch)[instance->flags];
     List_RemoveWhere(flag_batch, instanced, instanced == instance);
     List_RemoveWhere(instance->geometry->instances, instanced, instanced == instance);
-    List_Free(instance->shader_pipeline);
+    FreeShaders(instance);
     SDL_free(instance);
 }
 
@@ -176,9 +310,14 @@ void M7_WorldGeometry_Free(M7_WorldGeometry *geometry) {
     List_Free(geometry->instances);
 
     List_RemoveWhere(world->geometry, registered, registered == geometry);
+    world->generation += 1;
 
+    List_ForEach(geometry->placements, placement, SDL_free(placement); );
+    List_Free(geometry->placements);
     SDL_aligned_free(geometry->vs_verts);
     SDL_aligned_free(geometry->vs_nrmls);
+    SDL_aligned_free(geometry->ss_verts);
+    SDL_free(geometry);
 }
 
 void M7_World_Free(void *component) {
@@ -186,12 +325,17 @@ void M7_World_Free(void *component) {
 
     List_ForEach(world->geometry, geometry, {
         List_Free(geometry->instances);
+        List_ForEach(geometry->placements, placement, SDL_free(placement); );
+        List_Free(geometry->placements);
         SDL_aligned_free(geometry->vs_verts);
         SDL_aligned_free(geometry->vs_nrmls);
+        SDL_aligned_free(geometry->ss_verts);
         SDL_free(geometry);
     });
 
     List_Free(world->geometry);
+    List_Free(world->view_xforms);
+    M7_WorldBVH_Free(&world->bvh);
 
     for (size_t i = 0; i < List_Length(world->render_batches); ++i) {
         for (int j = 0; j < M7_RASTERIZER_FLAG_COMBINATIONS; ++j) {
@@ -201,7 +345,7 @@ void M7_World_Free(void *component) {
                 continue;
 
             List_ForEach(flag_batch, instance, { 
-                List_Free(instance->shader_pipeline);
+                FreeShaders(instance);
                 SDL_free(instance);
             });
 
@@ -213,10 +357,19 @@ void M7_World_Free(void *component) {
 }
 
 void M7_Mesh_Free(M7_Mesh *mesh) {
-    SDL_aligned_free(mesh->ws_verts);
-    SDL_aligned_free(mesh->ws_nrmls);
-    SDL_free(mesh->ts_verts);
-    SDL_free(mesh->faces);
+    if (mesh->mapping) {
+        M7_UnmapFile(mesh->mapping, mesh->mapping_size);
+    } else {
+        SDL_aligned_free(mesh->ws_verts);
+        SDL_aligned_free(mesh->ws_nrmls);
+        SDL_free(mesh->ts_verts);
+        SDL_free(mesh->faces);
+        SDL_free(mesh->meshlets);
+        SDL_aligned_free(mesh->bvh_nodes);
+        SDL_free(mesh->bvh_faces);
+    }
+
+    SDL_free(mesh);
 }
 
 #endif /* SD_SRC_VARIANT */
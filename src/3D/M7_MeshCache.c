@@ -0,0 +1,267 @@
+#include <SDL3/SDL.h>
+#include <M7/ECS.h>
+#include <M7/M7_ECS.h>
+#include <M7/M7_Resource.h>
+#include <M7/Math/linalg.h>
+#include <M7/Math/stride.h>
+
+#include "M7_3D_c.h"
+
+#ifndef SDL_PLATFORM_WINDOWS
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#define MESH_MAGIC    0x434D374D /* "M7MC" */
+#define MESH_VERSION  5
+#define MAP_ALIGN     64 /* Widest SIMD variant alignment, for buffers standing in for mappings */
+
+/* Followed by the mesh arrays, each starting on an SD_ALIGN boundary */
+typedef struct MeshHeader {
+    Uint32 magic;
+    Uint32 version;
+    Uint32 sd_length;
+    Uint32 face_size;
+    Uint32 key;
+    Uint32 crc; /* Of everything after the header */
+    Uint64 source_size;
+    Sint64 source_mtime;
+    Uint64 nverts, nts_verts, nfaces, nmeshlets, nbvh_nodes;
+    Uint32 has_nrmls;
+    Uint32 meshlet_size;
+    Uint32 bvh_node_size;
+    Uint32 bvh_leaf_faces;
+} MeshHeader;
+
+enum MeshSections {
+    SECTION_VERTS,
+    SECTION_NRMLS,
+    SECTION_TS_VERTS,
+    SECTION_FACES,
+    SECTION_MESHLETS,
+    SECTION_BVH_NODES,
+    SECTION_BVH_FACES,
+    SECTION_END
+};
+
+static size_t AlignOffset(size_t offset) {
+    return (offset + SD_ALIGN - 1) / SD_ALIGN * SD_ALIGN;
+}
+
+static void Layout(MeshHeader *header, size_t offsets[SECTION_END + 1]) {
+    size_t sizes[SECTION_END] = {
+        [SECTION_VERTS] = sizeof(sd_vec3) * sd_bounding_size(header->nverts),
+        [SECTION_NRMLS] = header->has_nrmls ? sizeof(sd_vec3) * sd_bounding_size(header->nverts) : 0,
+        [SECTION_TS_VERTS] = sizeof(vec2) * header->nts_verts,
+        [SECTION_FACES] = sizeof(M7_MeshFace) * header->nfaces,
+        [SECTION_MESHLETS] = sizeof(M7_Meshlet) * header->nmeshlets,
+        [SECTION_BVH_NODES] = sizeof(M7_MeshBVHNode) * header->nbvh_nodes,
+        [SECTION_BVH_FACES] = header->nbvh_nodes ? sizeof(Uint32) * header->nfaces : 0
+    };
+
+    offsets[0] = AlignOffset(sizeof(MeshHeader));
+
+    for (int i = 0; i < SECTION_END; ++i)
+        offsets[i + 1] = AlignOffset(offsets[i] + sizes[i]);
+}
+
+static bool MapCache(char *path, MeshHeader *expected, M7_Mesh *mesh) {
+    size_t size;
+    Uint8 *data = M7_MapFile(path, &size);
+
+    if (!data)
+        return false;
+
+    MeshHeader header;
+    size_t offsets[SECTION_END + 1];
+    bool valid = size >= sizeof(MeshHeader);
+
+    if (valid) {
+        SDL_memcpy(&header, data, sizeof(MeshHeader));
+        expected->crc = header.crc;
+        expected->nverts = header.nverts;
+        expected->nts_verts = header.nts_verts;
+        expected->nfaces = header.nfaces;
+        expected->nmeshlets = header.nmeshlets;
+        expected->nbvh_nodes = header.nbvh_nodes;
+        expected->has_nrmls = header.has_nrmls;
+        valid = !SDL_memcmp(&header, expected, sizeof(MeshHeader));
+    }
+
+    if (valid) {
+        Layout(&header, offsets);
+        valid = size == offsets[SECTION_END] && SDL_crc32(0, data + offsets[0], size - offsets[0]) == header.crc;
+    }
+
+    if (!valid) {
+        M7_UnmapFile(data, size);
+        return false;
+    }
+
+    *mesh = (M7_Mesh) {
+        .ws_verts = (sd_vec3 *)(data + offsets[SECTION_VERTS]),
+        .ws_nrmls = header.has_nrmls ? (sd_vec3 *)(data + offsets[SECTION_NRMLS]) : nullptr,
+        .ts_verts = header.nts_verts ? (vec2 *)(data + offsets[SECTION_TS_VERTS]) : nullptr,
+        .faces = (M7_MeshFace *)(data + offsets[SECTION_FACES]),
+        .meshlets = (M7_Meshlet *)(data + offsets[SECTION_MESHLETS]),
+        .bvh_nodes = header.nbvh_nodes ? (M7_MeshBVHNode *)(data + offsets[SECTION_BVH_NODES]) : nullptr,
+        .bvh_faces = header.nbvh_nodes ? (Uint32 *)(data + offsets[SECTION_BVH_FACES]) : nullptr,
+        .nverts = header.nverts,
+        .nts_verts = header.nts_verts,
+        .nfaces = header.nfaces,
+        .nmeshlets = header.nmeshlets,
+        .nbvh_nodes = header.nbvh_nodes,
+        .mapping = data,
+        .mapping_size = size
+    };
+
+    return true;
+}
+
+static void WriteCache(char *path, MeshHeader *header, M7_Mesh *mesh) {
+    size_t offsets[SECTION_END + 1];
+    header->nverts = mesh->nverts;
+    header->nts_verts = mesh->nts_verts;
+    header->nfaces = mesh->nfaces;
+    header->nmeshlets = mesh->nmeshlets;
+    header->nbvh_nodes = mesh->nbvh_nodes;
+    header->has_nrmls = mesh->ws_nrmls != nullptr;
+    Layout(header, offsets);
+
+    Uint8 *data = SDL_calloc(1, offsets[SECTION_END]);
+    SDL_memcpy(data + offsets[SECTION_VERTS], mesh->ws_verts, offsets[SECTION_VERTS + 1] - offsets[SECTION_VERTS]);
+
+    if (mesh->ws_nrmls)
+        SDL_memcpy(data + offsets[SECTION_NRMLS], mesh->ws_nrmls, sizeof(sd_vec3) * sd_bounding_size(mesh->nverts));
+
+    if (mesh->ts_verts)
+        SDL_memcpy(data + offsets[SECTION_TS_VERTS], mesh->ts_verts, sizeof(vec2) * mesh->nts_verts);
+
+    SDL_memcpy(data + offsets[SECTION_FACES], mesh->faces, sizeof(M7_MeshFace) * mesh->nfaces);
+    SDL_memcpy(data + offsets[SECTION_MESHLETS], mesh->meshlets, sizeof(M7_Meshlet) * mesh->nmeshlets);
+
+    if (mesh->nbvh_nodes) {
+        SDL_memcpy(data + offsets[SECTION_BVH_NODES], mesh->bvh_nodes, sizeof(M7_MeshBVHNode) * mesh->nbvh_nodes);
+        SDL_memcpy(data + offsets[SECTION_BVH_FACES], mesh->bvh_faces, sizeof(Uint32) * mesh->nfaces);
+    }
+
+    header->crc = SDL_crc32(0, data + offsets[0], offsets[SECTION_END] - offsets[0]);
+    SDL_memcpy(data, header, sizeof(MeshHeader));
+
+    SDL_CreateDirectory(M7_CACHE_DIR);
+    SDL_IOStream *io = SDL_IOFromFile(path, "wb");
+
+    if (!io) {
+        SDL_Log("Failed to open %s: %s", path, SDL_GetError());
+        SDL_free(data);
+        return;
+    }
+
+    if (SDL_WriteIO(io, data, offsets[SECTION_END]) != offsets[SECTION_END])
+        SDL_Log("Failed to write %s: %s", path, SDL_GetError());
+
+    SDL_CloseIO(io);
+    SDL_free(data);
+}
+
+/*
+ * Loads a mesh from its binary cache in M7_CACHE_DIR, in the stride layout of the selected SIMD variant. The cache
+ * is mapped and used in place. When it's missing, or its checksum or the source's size or modification time
+ * don't match, the source is parsed and the cache rewritten. Key distinguishes meshes parsed from the same source
+ * with different args
+ */
+M7_Mesh *SD_VARIANT(M7_Mesh_Load)(char *path, M7_MeshParser parse, void *args, Uint32 key) {
+    SDL_PathInfo info;
+
+    if (!SDL_GetPathInfo(path, &info)) {
+        SDL_Log("Failed to stat %s: %s", path, SDL_GetError());
+        return parse(path, args);
+    }
+
+    MeshHeader header = {
+        .magic = MESH_MAGIC,
+        .version = MESH_VERSION,
+        .sd_length = SD_LENGTH,
+        .face_size = sizeof(M7_MeshFace),
+        .meshlet_size = sizeof(M7_Meshlet),
+        .bvh_node_size = sizeof(M7_MeshBVHNode),
+        .bvh_leaf_faces = M7_MESH_BVH_LEAF_FACES,
+        .key = key,
+        .source_size = info.size,
+        .source_mtime = info.modify_time
+    };
+
+    Uint32 name = SDL_crc32(SDL_crc32(0, path, SDL_strlen(path)), &key, sizeof(key));
+    char *cache_path;
+    SDL_asprintf(&cache_path, "%s/mesh_%08x_%d.bin", M7_CACHE_DIR, name, SD_LENGTH);
+
+    M7_Mesh *mesh = SDL_malloc(sizeof(M7_Mesh));
+
+    if (!MapCache(cache_path, &header, mesh)) {
+        SDL_free(mesh);
+        mesh = parse(path, args);
+
+        if (mesh)
+            WriteCache(cache_path, &header, mesh);
+    }
+
+    SDL_free(cache_path);
+    return mesh;
+}
+
+#ifndef SD_SRC_VARIANT
+
+/* Maps a file copy on write, or reads it into an aligned buffer where mapping isn't available */
+void *M7_MapFile(char *path, size_t *size) {
+#ifndef SDL_PLATFORM_WINDOWS
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+
+    if (fd < 0)
+        return nullptr;
+
+    if (fstat(fd, &st) || !st.st_size) {
+        close(fd);
+        return nullptr;
+    }
+
+    void *data = mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (data == MAP_FAILED)
+        return nullptr;
+
+    *size = st.st_size;
+    return data;
+#else
+    SDL_IOStream *io = SDL_IOFromFile(path, "rb");
+
+    if (!io)
+        return nullptr;
+
+    Sint64 length = SDL_GetIOSize(io);
+    void *data = length > 0 ? SDL_aligned_alloc(MAP_ALIGN, length) : nullptr;
+
+    if (data && SDL_ReadIO(io, data, length) != (size_t)length) {
+        SDL_aligned_free(data);
+        data = nullptr;
+    }
+
+    SDL_CloseIO(io);
+    *size = length;
+    return data;
+#endif
+}
+
+void M7_UnmapFile(void *data, size_t size) {
+#ifndef SDL_PLATFORM_WINDOWS
+    munmap(data, size);
+#else
+    (void)size;
+    SDL_aligned_free(data);
+#endif
+}
+
+#endif /* SD_SRC_VARIANT */
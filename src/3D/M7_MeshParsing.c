@@ -0,0 +1,841 @@
+#include <SDL3/SDL.h>
+#include <M7/ECS.h>
+#include <M7/M7_ECS.h>
+#include <M7/Math/linalg.h>
+
+#include "M7_3D_c.h"
+
+#define TEXT_MIN_CHUNK    (1 << 16) /* Bytes below which text isn't split further between workers */
+#define TEXT_MAX_CHUNKS   64
+#define TEXT_COUNTS       4
+#define PLY_MAX_ELEMENTS  16
+#define PLY_MAX_COLUMNS   32
+#define INDEX_NONE        SIZE_MAX
+
+/*
+ * Files are parsed in line aligned chunks, one per worker. A counting pass sizes each chunk's share of the
+ * output, the counts are turned into offsets, and a parsing pass writes every chunk's elements in place
+ */
+typedef struct TextChunk {
+    char *begin, *end;
+    size_t counts[TEXT_COUNTS]; /* Elements found by the counting pass, then the chunk's offsets into the output */
+    bool malformed;
+} TextChunk;
+
+typedef struct TextParse {
+    TextChunk chunks[TEXT_MAX_CHUNKS];
+    int nchunks;
+    size_t totals[TEXT_COUNTS];
+    void *format;
+} TextParse;
+
+static const double powers_of_ten[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static inline bool IsSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+static inline bool IsDigit(char c) {
+    return (unsigned char)(c - '0') < 10;
+}
+
+static inline char *SkipSpace(char *p, char *end) {
+    while (p < end && IsSpace(*p))
+        ++p;
+
+    return p;
+}
+
+static inline char *SkipToken(char *p, char *end) {
+    while (p < end && !IsSpace(*p) && *p != '\n')
+        ++p;
+
+    return p;
+}
+
+static inline char *NextLine(char *p, char *end) {
+    while (p < end && *p++ != '\n');
+    return p;
+}
+
+static inline bool AtLineEnd(char *p, char *end) {
+    return p == end || *p == '\n';
+}
+
+/* Whether the token at p is exactly word */
+static bool TokenIs(char *p, char *end, char *word) {
+    char *token_end = SkipToken(p, end);
+    size_t length = SDL_strlen(word);
+    return (size_t)(token_end - p) == length && !SDL_memcmp(p, word, length);
+}
+
+/* Each parser returns the character after the number, or p itself when there's no number at p */
+static char *ParseUint(char *p, char *end, size_t *out) {
+    char *digits = p;
+    size_t value = 0;
+
+    for (; p < end && IsDigit(*p); ++p)
+        value = value * 10 + (*p - '0');
+
+    *out = value;
+    return p == digits ? digits : p;
+}
+
+static char *ParseInt(char *p, char *end, long long *out) {
+    char *start = p;
+    bool negative = p < end && *p == '-';
+
+    if (p < end && (*p == '-' || *p == '+'))
+        ++p;
+
+    size_t value;
+    char *after = ParseUint(p, end, &value);
+
+    if (after == p)
+        return start;
+
+    *out = negative ? -(long long)value : (long long)value;
+    return after;
+}
+
+/*
+ * Decimal floats, exact as long as the significant digits fit a double's mantissa and the exponent a power
+ * of ten a double holds exactly. Other values are within a rounding of the nearest float
+ */
+static char *ParseFloat(char *p, char *end, float *out) {
+    char *start = p;
+    bool negative = p < end && *p == '-';
+
+    if (p < end && (*p == '-' || *p == '+'))
+        ++p;
+
+    Uint64 mantissa = 0;
+    int exp10 = 0;
+    int ndigits = 0;
+
+    for (; p < end && IsDigit(*p); ++p, ++ndigits) {
+        if (mantissa < 100000000000000000ULL)
+            mantissa = mantissa * 10 + (*p - '0');
+        else
+            ++exp10;
+    }
+
+    if (p < end && *p == '.') {
+        for (++p; p < end && IsDigit(*p); ++p, ++ndigits) {
+            if (mantissa < 100000000000000000ULL) {
+                mantissa = mantissa * 10 + (*p - '0');
+                --exp10;
+            }
+        }
+    }
+
+    if (!ndigits)
+        return start;
+
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        long long exp;
+        char *after = ParseInt(p + 1, end, &exp);
+
+        if (after != p + 1) {
+            exp10 += SDL_clamp(exp, -1000, 1000);
+            p = after;
+        }
+    }
+
+    double value = (double)mantissa;
+
+    if (mantissa < (1ULL << 53) && exp10 >= -22 && exp10 <= 22)
+        value = exp10 < 0 ? value / powers_of_ten[-exp10] : value * powers_of_ten[exp10];
+    else if (mantissa)
+        value *= SDL_pow(10, exp10);
+
+    *out = negative ? -value : value;
+    return p;
+}
+
+/* Splits text into line aligned chunks of at least TEXT_MIN_CHUNK bytes, at most one per logical core */
+static void SplitText(TextParse *parse, char *begin, char *end) {
+    size_t size = end - begin;
+    size_t nchunks = SDL_min(size / TEXT_MIN_CHUNK, (size_t)SDL_GetNumLogicalCPUCores());
+    parse->nchunks = SDL_clamp(nchunks, 1, TEXT_MAX_CHUNKS);
+
+    char *chunk_begin = begin;
+
+    for (int i = 0; i < parse->nchunks; ++i) {
+        char *chunk_end = i + 1 < parse->nchunks ? NextLine(begin + size * (i + 1) / parse->nchunks, end) : end;
+        parse->chunks[i] = (TextChunk) { .begin = chunk_begin, .end = chunk_end };
+        chunk_begin = chunk_end;
+    }
+}
+
+/* Runs a pass over every chunk in parallel, returning whether all of them were well formed */
+static bool RunPass(TextParse *parse, void (*pass)(void *data, int chunk)) {
+    M7_RunParallel(parse->nchunks, pass, parse);
+
+    for (int i = 0; i < parse->nchunks; ++i)
+        if (parse->chunks[i].malformed)
+            return false;
+
+    return true;
+}
+
+/* Turns each chunk's counts into offsets, after those of the chunks before it */
+static void PrefixCounts(TextParse *parse) {
+    for (int j = 0; j < TEXT_COUNTS; ++j) {
+        size_t offset = 0;
+
+        for (int i = 0; i < parse->nchunks; ++i) {
+            size_t count = parse->chunks[i].counts[j];
+            parse->chunks[i].counts[j] = offset;
+            offset += count;
+        }
+
+        parse->totals[j] = offset;
+    }
+}
+
+static float Scale(void *args) {
+    return args ? *(float *)args : 1;
+}
+
+static char *MapText(char *path, size_t *size) {
+    char *text = M7_MapFile(path, size);
+
+    if (!text)
+        SDL_Log("Failed to open %s", path);
+
+    return text;
+}
+
+static M7_Mesh *Malformed(char *path) {
+    SDL_Log("Malformed mesh %s", path);
+    return nullptr;
+}
+
+/* .norm: a triangle count, then per vertex of each triangle, a position and a normal */
+static void CountNorm(void *data, int chunk) {
+    TextChunk *c = ((TextParse *)data)->chunks + chunk;
+
+    for (char *p = SkipSpace(c->begin, c->end); p < c->end; p = SkipSpace(p, c->end)) {
+        if (*p == '\n') {
+            ++p;
+            continue;
+        }
+
+        p = SkipToken(p, c->end);
+        c->counts[0] += 1;
+    }
+}
+
+static void ParseNorm(void *data, int chunk) {
+    TextParse *parse = data;
+    TextChunk *c = parse->chunks + chunk;
+    float *vals = (float *)parse->format + c->counts[0];
+
+    for (char *p = SkipSpace(c->begin, c->end); p < c->end; p = SkipSpace(p, c->end)) {
+        if (*p == '\n') {
+            ++p;
+            continue;
+        }
+
+        char *after = ParseFloat(p, c->end, vals++);
+
+        if (after == p || !(after == c->end || IsSpace(*after) || *after == '\n')) {
+            c->malformed = true;
+            return;
+        }
+
+        p = after;
+    }
+}
+
+/* Parses a .norm file. Args point to a scale for positions, or are null */
+M7_Mesh *M7_Mesh_ParseNorm(char *path, void *args) {
+    size_t size;
+    char *text = MapText(path, &size);
+
+    if (!text)
+        return nullptr;
+
+    char *end = text + size;
+    size_t nfaces;
+    char *header = SkipSpace(text, end);
+    char *body = ParseUint(header, end, &nfaces);
+
+    TextParse parse = {};
+    SplitText(&parse, NextLine(body, end), end);
+
+    if (body == header || !RunPass(&parse, CountNorm)) {
+        M7_UnmapFile(text, size);
+        return Malformed(path);
+    }
+
+    PrefixCounts(&parse);
+    float *vals = SDL_malloc(sizeof(float) * SDL_max(parse.totals[0], 1));
+    parse.format = vals;
+
+    if (parse.totals[0] != nfaces * 18 || !RunPass(&parse, ParseNorm)) {
+        SDL_free(vals);
+        M7_UnmapFile(text, size);
+        return Malformed(path);
+    }
+
+    M7_UnmapFile(text, size);
+
+    float scale = Scale(args);
+    vec3 *verts = SDL_malloc(sizeof(vec3) * SDL_max(nfaces * 3, 1));
+    vec3 *nrmls = SDL_malloc(sizeof(vec3) * SDL_max(nfaces * 3, 1));
+    M7_MeshFace *faces = SDL_malloc(sizeof(M7_MeshFace) * SDL_max(nfaces, 1));
+
+    for (size_t i = 0; i < nfaces * 3; ++i) {
+        float *vert = vals + i * 6;
+        verts[i] = vec3_mul((vec3) {{ vert[0], vert[1], vert[2] }}, scale);
+        nrmls[i] = vec3_normalize((vec3) {{ vert[3], vert[4], vert[5] }});
+    }
+
+    for (size_t i = 0; i < nfaces; ++i)
+        faces[i] = (M7_MeshFace) { .idx_verts = { i * 3 + 0, i * 3 + 1, i * 3 + 2 } };
+
+    /* Faces are stored with their own copies of shared vertices */
+    size_t nverts = M7_Mesh_Weld(verts, nrmls, faces, nfaces * 3, nfaces);
+    M7_Mesh *mesh = M7_Mesh_Create(verts, nrmls, nullptr, faces, nverts, 0, nfaces);
+
+    SDL_free(vals);
+    SDL_free(verts);
+    SDL_free(nrmls);
+    SDL_free(faces);
+    return mesh;
+}
+
+/* .obj: positions, texture coordinates, normals and polygons, which are split into triangle fans */
+enum ObjCounts {
+    OBJ_VERTS,
+    OBJ_TS_VERTS,
+    OBJ_NRMLS,
+    OBJ_TRIANGLES
+};
+
+typedef struct ObjFormat {
+    vec3 *verts, *nrmls;
+    vec2 *ts_verts;
+    size_t (*corners)[3][3]; /* Position, texture coordinate and normal index of each triangle corner */
+} ObjFormat;
+
+static void CountObj(void *data, int chunk) {
+    TextChunk *c = ((TextParse *)data)->chunks + chunk;
+
+    for (char *p = c->begin; p < c->end; p = NextLine(p, c->end)) {
+        p = SkipSpace(p, c->end);
+
+        if (TokenIs(p, c->end, "v"))
+            c->counts[OBJ_VERTS] += 1;
+        else if (TokenIs(p, c->end, "vt"))
+            c->counts[OBJ_TS_VERTS] += 1;
+        else if (TokenIs(p, c->end, "vn"))
+            c->counts[OBJ_NRMLS] += 1;
+        else if (TokenIs(p, c->end, "f")) {
+            size_t ncorners = 0;
+
+            for (p = SkipSpace(SkipToken(p, c->end), c->end); !AtLineEnd(p, c->end); p = SkipSpace(SkipToken(p, c->end), c->end))
+                ncorners += 1;
+
+            if (ncorners < 3) {
+                c->malformed = true;
+                return;
+            }
+
+            c->counts[OBJ_TRIANGLES] += ncorners - 2;
+        }
+    }
+}
+
+/* Resolves a 1 based or negative, relative OBJ index against the count of elements so far */
+static bool ObjIndex(long long index, size_t count, size_t *out) {
+    if (index > 0)
+        *out = index - 1;
+    else if (index < 0 && (size_t)-index <= count)
+        *out = count + index;
+    else
+        return false;
+
+    return true;
+}
+
+static char *ParseObjCorner(char *p, char *end, size_t counts[TEXT_COUNTS], size_t corner[3]) {
+    static const int kinds[3] = { OBJ_VERTS, OBJ_TS_VERTS, OBJ_NRMLS };
+    corner[0] = corner[1] = corner[2] = INDEX_NONE;
+
+    for (int i = 0; i < 3; ++i) {
+        long long index;
+        char *after = ParseInt(p, end, &index);
+
+        if (after != p) {
+            if (!ObjIndex(index, counts[kinds[i]], corner + i))
+                return nullptr;
+
+            p = after;
+        } else if (!i) {
+            return nullptr;
+        }
+
+        if (p == end || *p != '/')
+            break;
+
+        ++p;
+    }
+
+    return p;
+}
+
+static void ParseObj(void *data, int chunk) {
+    TextParse *parse = data;
+    TextChunk *c = parse->chunks + chunk;
+    ObjFormat *obj = parse->format;
+    size_t *cursors = c->counts;
+
+    for (char *p = c->begin; p < c->end; p = NextLine(p, c->end)) {
+        p = SkipSpace(p, c->end);
+        float vals[3] = {};
+        int nvals = 0;
+
+        if (TokenIs(p, c->end, "v") || TokenIs(p, c->end, "vt") || TokenIs(p, c->end, "vn")) {
+            char *token = p;
+
+            for (p = SkipSpace(SkipToken(p, c->end), c->end); nvals < 3 && !AtLineEnd(p, c->end); p = SkipSpace(p, c->end)) {
+                char *after = ParseFloat(p, c->end, vals + nvals++);
+
+                if (after == p) {
+                    c->malformed = true;
+                    return;
+                }
+
+                p = after;
+            }
+
+            if (token[1] == 't')
+                obj->ts_verts[cursors[OBJ_TS_VERTS]++] = (vec2) {{ vals[0], vals[1] }};
+            else if (token[1] == 'n')
+                obj->nrmls[cursors[OBJ_NRMLS]++] = (vec3) {{ vals[0], vals[1], vals[2] }};
+            else
+                obj->verts[cursors[OBJ_VERTS]++] = (vec3) {{ vals[0], vals[1], vals[2] }};
+        } else if (TokenIs(p, c->end, "f")) {
+            size_t first[3], prev[3], curr[3];
+            size_t ncorners = 0;
+
+            for (p = SkipSpace(SkipToken(p, c->end), c->end); !AtLineEnd(p, c->end); p = SkipSpace(p, c->end)) {
+                p = ParseObjCorner(p, c->end, cursors, curr);
+
+                if (!p || !(p == c->end || IsSpace(*p) || *p == '\n')) {
+                    c->malformed = true;
+                    return;
+                }
+
+                if (ncorners >= 2) {
+                    size_t (*triangle)[3] = obj->corners[cursors[OBJ_TRIANGLES]++];
+                    SDL_memcpy(triangle[0], first, sizeof(first));
+                    SDL_memcpy(triangle[1], prev, sizeof(prev));
+                    SDL_memcpy(triangle[2], curr, sizeof(curr));
+                }
+
+                if (!ncorners++)
+                    SDL_memcpy(first, curr, sizeof(curr));
+
+                SDL_memcpy(prev, curr, sizeof(curr));
+            }
+        }
+    }
+}
+
+/*
+ * Parses a Wavefront .obj file. Corners sharing a position and normal share a vertex, texture coordinates
+ * are indexed separately. Args point to a scale for positions, or are null
+ */
+M7_Mesh *M7_Mesh_ParseOBJ(char *path, void *args) {
+    size_t size;
+    char *text = MapText(path, &size);
+
+    if (!text)
+        return nullptr;
+
+    TextParse parse = {};
+    SplitText(&parse, text, text + size);
+
+    if (!RunPass(&parse, CountObj)) {
+        M7_UnmapFile(text, size);
+        return Malformed(path);
+    }
+
+    PrefixCounts(&parse);
+
+    ObjFormat obj = {
+        .verts = SDL_malloc(sizeof(vec3) * SDL_max(parse.totals[OBJ_VERTS], 1)),
+        .nrmls = SDL_malloc(sizeof(vec3) * SDL_max(parse.totals[OBJ_NRMLS], 1)),
+        .ts_verts = SDL_malloc(sizeof(vec2) * SDL_max(parse.totals[OBJ_TS_VERTS], 1)),
+        .corners = SDL_malloc(sizeof(size_t [3][3]) * SDL_max(parse.totals[OBJ_TRIANGLES], 1))
+    };
+
+    parse.format = &obj;
+    bool valid = RunPass(&parse, ParseObj);
+    M7_UnmapFile(text, size);
+
+    size_t nfaces = parse.totals[OBJ_TRIANGLES];
+    size_t nts_verts = parse.totals[OBJ_TS_VERTS];
+    bool missing_nrmls = false;
+    float scale = Scale(args);
+
+    vec3 *verts = SDL_malloc(sizeof(vec3) * SDL_max(nfaces * 3, 1));
+    vec3 *nrmls = SDL_malloc(sizeof(vec3) * SDL_max(nfaces * 3, 1));
+    M7_MeshFace *faces = SDL_malloc(sizeof(M7_MeshFace) * SDL_max(nfaces, 1));
+
+    for (size_t i = 0; valid && i < nfaces; ++i) {
+        for (int j = 0; j < 3; ++j) {
+            size_t *corner = obj.corners[i][j];
+            size_t vert = i * 3 + j;
+
+            if (corner[0] >= parse.totals[OBJ_VERTS] || (corner[1] != INDEX_NONE && corner[1] >= nts_verts) || (corner[2] != INDEX_NONE && corner[2] >= parse.totals[OBJ_NRMLS])) {
+                valid = false;
+                break;
+            }
+
+            verts[vert] = vec3_mul(obj.verts[corner[0]], scale);
+
+            nrmls[vert] = corner[2] != INDEX_NONE ? vec3_normalize(obj.nrmls[corner[2]]) : vec3_zero;
+            missing_nrmls |= corner[2] == INDEX_NONE;
+
+            faces[i].idx_verts[j] = vert;
+            faces[i].idx_tverts[j] = corner[1] != INDEX_NONE ? corner[1] : 0;
+        }
+    }
+
+    M7_Mesh *mesh = nullptr;
+
+    if (valid) {
+        size_t nverts = M7_Mesh_Weld(verts, nrmls, faces, nfaces * 3, nfaces);
+
+        /* Corners without a normal share a zero one, and weld by position alone, then take smooth normals */
+        if (missing_nrmls) {
+            vec3 *smooth = SDL_malloc(sizeof(vec3) * SDL_max(nverts, 1));
+            M7_Mesh_SmoothNormals(verts, smooth, faces, nverts, nfaces, nullptr);
+
+            for (size_t i = 0; i < nverts; ++i)
+                if (!vec3_dot(nrmls[i], nrmls[i]))
+                    nrmls[i] = smooth[i];
+
+            SDL_free(smooth);
+        }
+
+        mesh = M7_Mesh_Create(verts, nrmls, obj.ts_verts, faces, nverts, nts_verts, nfaces);
+    }
+
+    SDL_free(obj.verts);
+    SDL_free(obj.nrmls);
+    SDL_free(obj.ts_verts);
+    SDL_free(obj.corners);
+    SDL_free(verts);
+    SDL_free(nrmls);
+    SDL_free(faces);
+    return mesh ? mesh : Malformed(path);
+}
+
+/* .ply: ASCII vertex and face elements, with optional normals and texture coordinates per vertex */
+enum PlyColumns {
+    PLY_X, PLY_Y, PLY_Z,
+    PLY_NX, PLY_NY, PLY_NZ,
+    PLY_U, PLY_V,
+    PLY_COLUMNS
+};
+
+typedef enum PlyElementKind {
+    PLY_OTHER,
+    PLY_VERTEX,
+    PLY_FACE
+} PlyElementKind;
+
+typedef struct PlyElement {
+    PlyElementKind kind;
+    size_t count;
+} PlyElement;
+
+typedef struct PlyFormat {
+    PlyElement elements[PLY_MAX_ELEMENTS];
+    int nelements;
+    int columns[PLY_COLUMNS]; /* Column of each known vertex property, or -1 */
+    int nvertex_columns;
+    int face_list; /* Column of the vertex index list among face properties */
+    float scale;
+    size_t nverts;
+    vec3 *verts, *nrmls;
+    vec2 *ts_verts;
+    M7_MeshFace *faces;
+} PlyFormat;
+
+static char *ParsePlyHeader(PlyFormat *ply, char *p, char *end) {
+    static const struct { char *name; int column; } names[] = {
+        { "x", PLY_X }, { "y", PLY_Y }, { "z", PLY_Z },
+        { "nx", PLY_NX }, { "ny", PLY_NY }, { "nz", PLY_NZ },
+        { "u", PLY_U }, { "s", PLY_U }, { "texture_u", PLY_U }, { "texture_s", PLY_U },
+        { "v", PLY_V }, { "t", PLY_V }, { "texture_v", PLY_V }, { "texture_t", PLY_V }
+    };
+
+    int nface_columns = 0;
+
+    for (int i = 0; i < PLY_COLUMNS; ++i)
+        ply->columns[i] = -1;
+
+    ply->face_list = -1;
+
+    if (!TokenIs(p, end, "ply"))
+        return nullptr;
+
+    for (p = NextLine(p, end); p < end; p = NextLine(p, end)) {
+        p = SkipSpace(p, end);
+        char *next = SkipSpace(SkipToken(p, end), end);
+
+        if (TokenIs(p, end, "end_header"))
+            return NextLine(p, end);
+
+        if (TokenIs(p, end, "format")) {
+            if (!TokenIs(next, end, "ascii")) {
+                SDL_Log("Only ASCII PLY meshes are supported");
+                return nullptr;
+            }
+        } else if (TokenIs(p, end, "element")) {
+            if (ply->nelements == PLY_MAX_ELEMENTS)
+                return nullptr;
+
+            PlyElement *element = ply->elements + ply->nelements++;
+            element->kind = TokenIs(next, end, "vertex") ? PLY_VERTEX : TokenIs(next, end, "face") ? PLY_FACE : PLY_OTHER;
+
+            next = SkipSpace(SkipToken(next, end), end);
+
+            if (ParseUint(next, end, &element->count) == next)
+                return nullptr;
+        } else if (TokenIs(p, end, "property") && ply->nelements) {
+            PlyElementKind kind = ply->elements[ply->nelements - 1].kind;
+            bool list = TokenIs(next, end, "list");
+
+            /* Skip the types to the name */
+            for (int i = 0; i < (list ? 3 : 1); ++i)
+                next = SkipSpace(SkipToken(next, end), end);
+
+            if (kind == PLY_VERTEX) {
+                if (list || ply->nvertex_columns == PLY_MAX_COLUMNS)
+                    return nullptr;
+
+                for (size_t i = 0; i < SDL_arraysize(names); ++i)
+                    if (TokenIs(next, end, names[i].name))
+                        ply->columns[names[i].column] = ply->nvertex_columns;
+
+                ply->nvertex_columns += 1;
+            } else if (kind == PLY_FACE) {
+                if (list && (TokenIs(next, end, "vertex_indices") || TokenIs(next, end, "vertex_index")))
+                    ply->face_list = nface_columns;
+
+                nface_columns += 1;
+            }
+        }
+    }
+
+    return nullptr;
+}
+
+static void CountPlyVertices(void *data, int chunk) {
+    TextChunk *c = ((TextParse *)data)->chunks + chunk;
+
+    for (char *p = c->begin; p < c->end; p = NextLine(p, c->end))
+        if (!AtLineEnd(SkipSpace(p, c->end), c->end))
+            c->counts[0] += 1;
+}
+
+static void ParsePlyVertices(void *data, int chunk) {
+    TextParse *parse = data;
+    TextChunk *c = parse->chunks + chunk;
+    PlyFormat *ply = parse->format;
+    size_t vert = c->counts[0];
+
+    for (char *p = c->begin; p < c->end; p = NextLine(p, c->end)) {
+        float vals[PLY_MAX_COLUMNS];
+        p = SkipSpace(p, c->end);
+
+        if (AtLineEnd(p, c->end))
+            continue;
+
+        for (int i = 0; i < ply->nvertex_columns; ++i) {
+            char *after = ParseFloat(p, c->end, vals + i);
+
+            if (after == p) {
+                c->malformed = true;
+                return;
+            }
+
+            p = SkipSpace(after, c->end);
+        }
+
+        int *columns = ply->columns;
+        ply->verts[vert] = vec3_mul((vec3) {{ vals[columns[PLY_X]], vals[columns[PLY_Y]], vals[columns[PLY_Z]] }}, ply->scale);
+
+        if (ply->nrmls)
+            ply->nrmls[vert] = vec3_normalize((vec3) {{ vals[columns[PLY_NX]], vals[columns[PLY_NY]], vals[columns[PLY_NZ]] }});
+
+        if (ply->ts_verts)
+            ply->ts_verts[vert] = (vec2) {{ vals[columns[PLY_U]], vals[columns[PLY_V]] }};
+
+        vert += 1;
+    }
+}
+
+/* Skips a face line to its vertex index list, returning the index count */
+static char *PlyFaceList(PlyFormat *ply, char *p, char *end, size_t *count) {
+    for (int i = 0; i < ply->face_list; ++i)
+        p = SkipSpace(SkipToken(p, end), end);
+
+    char *after = ParseUint(p, end, count);
+    return after == p ? nullptr : SkipSpace(after, end);
+}
+
+static void CountPlyFaces(void *data, int chunk) {
+    TextParse *parse = data;
+    TextChunk *c = parse->chunks + chunk;
+
+    for (char *p = c->begin; p < c->end; p = NextLine(p, c->end)) {
+        size_t count;
+        p = SkipSpace(p, c->end);
+
+        if (AtLineEnd(p, c->end))
+            continue;
+
+        if (!PlyFaceList(parse->format, p, c->end, &count) || count < 3) {
+            c->malformed = true;
+            return;
+        }
+
+        c->counts[0] += count - 2;
+    }
+}
+
+static void ParsePlyFaces(void *data, int chunk) {
+    TextParse *parse = data;
+    TextChunk *c = parse->chunks + chunk;
+    PlyFormat *ply = parse->format;
+    size_t face = c->counts[0];
+
+    for (char *p = c->begin; p < c->end; p = NextLine(p, c->end)) {
+        size_t count, first, prev, curr;
+        p = SkipSpace(p, c->end);
+
+        if (AtLineEnd(p, c->end))
+            continue;
+
+        p = PlyFaceList(ply, p, c->end, &count);
+
+        for (size_t i = 0; i < count; ++i) {
+            char *after = ParseUint(p, c->end, &curr);
+
+            if (after == p || curr >= ply->nverts) {
+                c->malformed = true;
+                return;
+            }
+
+            if (i >= 2)
+                ply->faces[face++] = (M7_MeshFace) { .idx_verts = { first, prev, curr }, .idx_tverts = { first, prev, curr } };
+
+            if (!i)
+                first = curr;
+
+            prev = curr;
+            p = SkipSpace(after, c->end);
+        }
+    }
+}
+
+/* Skips the lines of an element, returning the start of the next */
+static char *SkipElement(char *p, char *end, size_t count) {
+    for (size_t i = 0; i < count && p < end; ++i) {
+        while (p < end && AtLineEnd(SkipSpace(p, end), end))
+            p = NextLine(p, end);
+
+        p = NextLine(p, end);
+    }
+
+    return p;
+}
+
+/* Parses an ASCII .ply file. Args point to a scale for positions, or are null */
+M7_Mesh *M7_Mesh_ParsePLY(char *path, void *args) {
+    size_t size;
+    char *text = MapText(path, &size);
+
+    if (!text)
+        return nullptr;
+
+    char *end = text + size;
+    PlyFormat ply = { .scale = Scale(args) };
+    char *p = ParsePlyHeader(&ply, text, end);
+    bool valid = p && ply.columns[PLY_X] >= 0 && ply.columns[PLY_Y] >= 0 && ply.columns[PLY_Z] >= 0;
+    size_t nfaces = 0;
+
+    for (int i = 0; valid && i < ply.nelements; ++i) {
+        PlyElement *element = ply.elements + i;
+        char *section = p;
+        p = SkipElement(p, end, element->count);
+
+        if (element->kind == PLY_OTHER)
+            continue;
+
+        TextParse parse = { .format = &ply };
+        SplitText(&parse, section, p);
+
+        if (element->kind == PLY_VERTEX) {
+            valid = RunPass(&parse, CountPlyVertices);
+            PrefixCounts(&parse);
+
+            if (!valid || ply.verts || parse.totals[0] != element->count) {
+                valid = false;
+                break;
+            }
+
+            ply.nverts = element->count;
+            ply.verts = SDL_malloc(sizeof(vec3) * SDL_max(ply.nverts, 1));
+
+            if (ply.columns[PLY_NX] >= 0 && ply.columns[PLY_NY] >= 0 && ply.columns[PLY_NZ] >= 0)
+                ply.nrmls = SDL_malloc(sizeof(vec3) * SDL_max(ply.nverts, 1));
+
+            if (ply.columns[PLY_U] >= 0 && ply.columns[PLY_V] >= 0)
+                ply.ts_verts = SDL_malloc(sizeof(vec2) * SDL_max(ply.nverts, 1));
+
+            valid = RunPass(&parse, ParsePlyVertices);
+        } else {
+            /* Faces index vertices, so they must come after them */
+            valid = ply.verts && !ply.faces && ply.face_list >= 0 && RunPass(&parse, CountPlyFaces);
+
+            if (!valid)
+                break;
+
+            PrefixCounts(&parse);
+            nfaces = parse.totals[0];
+            ply.faces = SDL_malloc(sizeof(M7_MeshFace) * SDL_max(nfaces, 1));
+            valid = RunPass(&parse, ParsePlyFaces);
+        }
+    }
+
+    M7_UnmapFile(text, size);
+
+    /* Files without normals take smooth ones */
+    if (valid && ply.faces && !ply.nrmls) {
+        ply.nrmls = SDL_malloc(sizeof(vec3) * SDL_max(ply.nverts, 1));
+        M7_Mesh_SmoothNormals(ply.verts, ply.nrmls, ply.faces, ply.nverts, nfaces, nullptr);
+    }
+
+    M7_Mesh *mesh = valid && ply.faces
+        ? M7_Mesh_Create(ply.verts, ply.nrmls, ply.ts_verts, ply.faces, ply.nverts, ply.ts_verts ? ply.nverts : 0, nfaces)
+        : nullptr;
+
+    SDL_free(ply.verts);
+    SDL_free(ply.nrmls);
+    SDL_free(ply.ts_verts);
+    SDL_free(ply.faces);
+    return mesh ? mesh : Malformed(path);
+}
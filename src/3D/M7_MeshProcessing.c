@@ -0,0 +1,590 @@
+#include <SDL3/SDL.h>
+#include <M7/ECS.h>
+#include <M7/M7_ECS.h>
+#include <M7/Collections/List.h>
+#include <M7/Math/linalg.h>
+
+#include "M7_3D_c.h"
+
+#define WELD_PARTITIONS  64
+#define WELD_EMPTY       SIZE_MAX
+#define MIN_PARALLEL     (1 << 14) /* Elements below which processing stays on the calling thread */
+#define MAX_WORKERS      WELD_PARTITIONS /* So that welding gives each worker a partition */
+#define ORDER_NONE       SIZE_MAX
+#define MESHLET_CONE_COS 0.7f /* Least cosine between a face normal and the mean normal of the meshlet it joins */
+
+typedef struct ParallelJob {
+    void (*fn)(void *data, int worker);
+    void *data;
+    int worker;
+} ParallelJob;
+
+static int RunJob(void *data) {
+    ParallelJob *job = data;
+    job->fn(job->data, job->worker);
+    return 0;
+}
+
+/* Calls fn once for each worker index on its own thread, the calling thread taking worker 0, and waits for all of them */
+void M7_RunParallel(int nworkers, void (*fn)(void *data, int worker), void *data) {
+    ParallelJob *jobs = SDL_malloc(sizeof(ParallelJob) * nworkers);
+    SDL_Thread **threads = SDL_malloc(sizeof(SDL_Thread *) * nworkers);
+
+    for (int i = 0; i < nworkers; ++i)
+        jobs[i] = (ParallelJob) { .fn = fn, .data = data, .worker = i };
+
+    for (int i = 1; i < nworkers; ++i)
+        threads[i] = SDL_CreateThread(RunJob, "worker", jobs + i);
+
+    fn(data, 0);
+
+    for (int i = 1; i < nworkers; ++i)
+        SDL_WaitThread(threads[i], nullptr);
+
+    SDL_free(threads);
+    SDL_free(jobs);
+}
+
+static int Workers(size_t count) {
+    return count < MIN_PARALLEL ? 1 : SDL_clamp(SDL_GetNumLogicalCPUCores(), 1, MAX_WORKERS);
+}
+
+/* A worker's share of count elements, split as evenly as possible */
+static void ChunkRange(size_t count, int nworkers, int worker, size_t range[2]) {
+    size_t qot = count / nworkers;
+    size_t rem = count % nworkers;
+    range[0] = worker * qot + SDL_min((size_t)worker, rem);
+    range[1] = (worker + 1) * qot + SDL_min((size_t)worker + 1, rem);
+}
+
+typedef struct WeldState {
+    vec3 *verts, *nrmls;
+    size_t nverts;
+    Uint32 *hashes;
+    size_t *order; /* Vertex indices grouped by partition, ascending within each */
+    size_t *remap; /* First vertex equal to each vertex */
+    size_t (*counts)[WELD_PARTITIONS]; /* Per chunk partition sizes, then scatter cursors */
+    size_t partitions[WELD_PARTITIONS + 1];
+    int nworkers;
+} WeldState;
+
+static inline Uint32 HashFloat(Uint32 hash, float f) {
+    Uint32 bits;
+    SDL_memcpy(&bits, &f, sizeof(bits));
+
+    /* Both zeros weld together */
+    if (f == 0)
+        bits = 0;
+
+    hash ^= bits;
+    return hash * 0x01000193;
+}
+
+static Uint32 HashVertex(WeldState *state, size_t i) {
+    vec3 vert = state->verts[i];
+    Uint32 hash = 0x811C9DC5;
+    hash = HashFloat(hash, vert.x);
+    hash = HashFloat(hash, vert.y);
+    hash = HashFloat(hash, vert.z);
+
+    if (state->nrmls) {
+        vec3 nrml = state->nrmls[i];
+        hash = HashFloat(hash, nrml.x);
+        hash = HashFloat(hash, nrml.y);
+        hash = HashFloat(hash, nrml.z);
+    }
+
+    /* Final mix, so that partitions and table slots can take the low bits */
+    hash ^= hash >> 16;
+    hash *= 0x7FEB352D;
+    hash ^= hash >> 15;
+    return hash;
+}
+
+static inline bool VerticesEqual(WeldState *state, size_t a, size_t b) {
+    vec3 va = state->verts[a], vb = state->verts[b];
+
+    if (va.x != vb.x || va.y != vb.y || va.z != vb.z)
+        return false;
+
+    if (!state->nrmls)
+        return true;
+
+    vec3 na = state->nrmls[a], nb = state->nrmls[b];
+    return na.x == nb.x && na.y == nb.y && na.z == nb.z;
+}
+
+/* Hashes a chunk of vertices and counts them into partitions */
+static void HashChunk(void *data, int worker) {
+    WeldState *state = data;
+    size_t range[2];
+    ChunkRange(state->nverts, state->nworkers, worker, range);
+
+    size_t *counts = state->counts[worker];
+    SDL_memset(counts, 0, sizeof(size_t [WELD_PARTITIONS]));
+
+    for (size_t i = range[0]; i < range[1]; ++i) {
+        state->hashes[i] = HashVertex(state, i);
+        counts[state->hashes[i] % WELD_PARTITIONS] += 1;
+    }
+}
+
+/* Scatters a chunk of vertices to its partitions, keeping ascending order within each */
+static void ScatterChunk(void *data, int worker) {
+    WeldState *state = data;
+    size_t range[2];
+    ChunkRange(state->nverts, state->nworkers, worker, range);
+
+    size_t *cursors = state->counts[worker];
+
+    for (size_t i = range[0]; i < range[1]; ++i)
+        state->order[cursors[state->hashes[i] % WELD_PARTITIONS]++] = i;
+}
+
+/* Maps every vertex of a worker's partitions to the first vertex equal to it, through an open addressing table */
+static void WeldPartitions(void *data, int worker) {
+    WeldState *state = data;
+    size_t *table = nullptr;
+    size_t capacity = 0;
+
+    for (int p = worker; p < WELD_PARTITIONS; p += state->nworkers) {
+        size_t first = state->partitions[p];
+        size_t last = state->partitions[p + 1];
+        size_t size = 16;
+
+        while (size < (last - first) * 2)
+            size *= 2;
+
+        if (size > capacity) {
+            SDL_free(table);
+            table = SDL_malloc(sizeof(size_t) * size);
+            capacity = size;
+        }
+
+        for (size_t i = 0; i < size; ++i)
+            table[i] = WELD_EMPTY;
+
+        for (size_t i = first; i < last; ++i) {
+            size_t vert = state->order[i];
+            size_t slot = (state->hashes[vert] / WELD_PARTITIONS) & (size - 1);
+
+            while (table[slot] != WELD_EMPTY && (state->hashes[table[slot]] != state->hashes[vert] || !VerticesEqual(state, table[slot], vert)))
+                slot = (slot + 1) & (size - 1);
+
+            if (table[slot] == WELD_EMPTY)
+                table[slot] = vert;
+
+            state->remap[vert] = table[slot];
+        }
+    }
+
+    SDL_free(table);
+}
+
+/*
+ * Merges vertices with bitwise equal positions and normals, which may be null, in linear time. Keeps the first
+ * of each set of equal vertices, in their original order, compacting verts and nrmls in place and remapping
+ * faces to match. Returns the welded vertex count
+ */
+size_t M7_Mesh_Weld(vec3 *verts, vec3 *nrmls, M7_MeshFace *faces, size_t nverts, size_t nfaces) {
+    if (!nverts)
+        return 0;
+
+    int nworkers = Workers(nverts);
+
+    WeldState state = {
+        .verts = verts,
+        .nrmls = nrmls,
+        .nverts = nverts,
+        .hashes = SDL_malloc(sizeof(Uint32) * nverts),
+        .order = SDL_malloc(sizeof(size_t) * nverts),
+        .remap = SDL_malloc(sizeof(size_t) * nverts),
+        .counts = SDL_malloc(sizeof(size_t [WELD_PARTITIONS]) * nworkers),
+        .nworkers = nworkers
+    };
+
+    M7_RunParallel(nworkers, HashChunk, &state);
+
+    /* Lay partitions out in order, with each chunk's share after those of the chunks before it */
+    size_t offset = 0;
+
+    for (int p = 0; p < WELD_PARTITIONS; ++p) {
+        state.partitions[p] = offset;
+
+        for (int c = 0; c < nworkers; ++c) {
+            size_t count = state.counts[c][p];
+            state.counts[c][p] = offset;
+            offset += count;
+        }
+    }
+
+    state.partitions[WELD_PARTITIONS] = offset;
+
+    M7_RunParallel(nworkers, ScatterChunk, &state);
+    M7_RunParallel(nworkers, WeldPartitions, &state);
+
+    /* Equal vertices map to an earlier or the same vertex, whose new index is known by the time it's needed */
+    size_t nwelded = 0;
+
+    for (size_t i = 0; i < nverts; ++i) {
+        if (state.remap[i] != i) {
+            state.remap[i] = state.remap[state.remap[i]];
+            continue;
+        }
+
+        verts[nwelded] = verts[i];
+
+        if (nrmls)
+            nrmls[nwelded] = nrmls[i];
+
+        state.remap[i] = nwelded++;
+    }
+
+    for (size_t i = 0; i < nfaces; ++i)
+        for (int j = 0; j < 3; ++j)
+            faces[i].idx_verts[j] = state.remap[faces[i].idx_verts[j]];
+
+    SDL_free(state.hashes);
+    SDL_free(state.order);
+    SDL_free(state.remap);
+    SDL_free(state.counts);
+    return nwelded;
+}
+
+/*
+ * Lists the faces around each vertex in compressed rows, in ascending face order, with a face listed once
+ * per vertex even if degenerate. Built with a counting sort in linear time
+ */
+M7_MeshAdjacency *M7_MeshAdjacency_Create(M7_MeshFace *faces, size_t nverts, size_t nfaces) {
+    M7_MeshAdjacency *adjacency = SDL_malloc(sizeof(M7_MeshAdjacency));
+    size_t *offsets = SDL_calloc(nverts + 1, sizeof(size_t));
+
+    for (size_t i = 0; i < nfaces; ++i) {
+        size_t *idx = faces[i].idx_verts;
+        offsets[idx[0]] += 1;
+        offsets[idx[1]] += idx[1] != idx[0];
+        offsets[idx[2]] += idx[2] != idx[0] && idx[2] != idx[1];
+    }
+
+    /* Offsets of each row's end, which filling walks back to its start */
+    for (size_t i = 1; i <= nverts; ++i)
+        offsets[i] += offsets[i - 1];
+
+    size_t *adjacent = SDL_malloc(sizeof(size_t) * SDL_max(offsets[nverts], 1));
+
+    for (size_t i = nfaces; i-- > 0;) {
+        size_t *idx = faces[i].idx_verts;
+        adjacent[--offsets[idx[0]]] = i;
+
+        if (idx[1] != idx[0])
+            adjacent[--offsets[idx[1]]] = i;
+
+        if (idx[2] != idx[0] && idx[2] != idx[1])
+            adjacent[--offsets[idx[2]]] = i;
+    }
+
+    *adjacency = (M7_MeshAdjacency) {
+        .offsets = offsets,
+        .faces = adjacent,
+        .nverts = nverts
+    };
+
+    return adjacency;
+}
+
+void M7_MeshAdjacency_Free(M7_MeshAdjacency *adjacency) {
+    SDL_free(adjacency->offsets);
+    SDL_free(adjacency->faces);
+    SDL_free(adjacency);
+}
+
+typedef struct NormalState {
+    vec3 *verts, *nrmls;
+    M7_MeshFace *faces;
+    M7_MeshAdjacency *adjacency;
+    vec3 *face_nrmls; /* Scaled by twice the face area */
+    size_t nverts, nfaces;
+    int nworkers;
+} NormalState;
+
+static void FaceNormals(void *data, int worker) {
+    NormalState *state = data;
+    size_t range[2];
+    ChunkRange(state->nfaces, state->nworkers, worker, range);
+
+    for (size_t i = range[0]; i < range[1]; ++i) {
+        size_t *idx = state->faces[i].idx_verts;
+        vec3 origin = state->verts[idx[0]];
+        state->face_nrmls[i] = vec3_cross(vec3_sub(state->verts[idx[1]], origin), vec3_sub(state->verts[idx[2]], origin));
+    }
+}
+
+/* Sums the normals of the faces around each vertex of a chunk, in face order */
+static void VertexNormals(void *data, int worker) {
+    NormalState *state = data;
+    M7_MeshAdjacency *adjacency = state->adjacency;
+    size_t range[2];
+    ChunkRange(state->nverts, state->nworkers, worker, range);
+
+    for (size_t i = range[0]; i < range[1]; ++i) {
+        vec3 nrml = vec3_zero;
+
+        for (size_t j = adjacency->offsets[i]; j < adjacency->offsets[i + 1]; ++j)
+            nrml = vec3_add(nrml, state->face_nrmls[adjacency->faces[j]]);
+
+        state->nrmls[i] = vec3_normalize(nrml);
+    }
+}
+
+/*
+ * Writes area weighted vertex normals, the normalized sum of the unnormalized normals of the faces around each
+ * vertex, in time linear in the face count. Adjacency may be null, in which case it's built and freed here
+ */
+void M7_Mesh_SmoothNormals(vec3 *verts, vec3 *nrmls, M7_MeshFace *faces, size_t nverts, size_t nfaces, M7_MeshAdjacency *adjacency) {
+    NormalState state = {
+        .verts = verts,
+        .nrmls = nrmls,
+        .faces = faces,
+        .adjacency = adjacency ? adjacency : M7_MeshAdjacency_Create(faces, nverts, nfaces),
+        .face_nrmls = SDL_malloc(sizeof(vec3) * SDL_max(nfaces, 1)),
+        .nverts = nverts,
+        .nfaces = nfaces
+    };
+
+    state.nworkers = Workers(nfaces);
+    M7_RunParallel(state.nworkers, FaceNormals, &state);
+
+    state.nworkers = Workers(nverts);
+    M7_RunParallel(state.nworkers, VertexNormals, &state);
+
+    if (!adjacency)
+        M7_MeshAdjacency_Free(state.adjacency);
+
+    SDL_free(state.face_nrmls);
+}
+
+typedef struct OrderState {
+    M7_MeshAdjacency *adjacency;
+    size_t *live; /* Faces around each vertex not yet emitted */
+    size_t *stamps; /* Time each vertex last entered the simulated cache */
+    size_t *dead_ends; /* Stack of emitted vertices, to resume from when a fan runs out of live neighbours */
+    size_t *candidates; /* Vertices of the faces emitted by the current fan */
+    size_t ndead_ends, ncandidates;
+    size_t time, cursor, nverts;
+} OrderState;
+
+/*
+ * The live candidate that would still be cached after its remaining faces are emitted, having entered the
+ * cache longest ago. Failing that, the most recent live vertex of the dead end stack, then the next live vertex
+ */
+static size_t NextFan(OrderState *state) {
+    size_t best = ORDER_NONE;
+    size_t best_priority = 0;
+
+    for (size_t i = 0; i < state->ncandidates; ++i) {
+        size_t vert = state->candidates[i];
+
+        if (!state->live[vert])
+            continue;
+
+        size_t age = state->time - state->stamps[vert];
+        size_t priority = age + 2 * state->live[vert] <= M7_VERTEX_CACHE_SIZE ? age + 1 : 1;
+
+        if (priority > best_priority) {
+            best = vert;
+            best_priority = priority;
+        }
+    }
+
+    if (best != ORDER_NONE)
+        return best;
+
+    while (state->ndead_ends) {
+        size_t vert = state->dead_ends[--state->ndead_ends];
+
+        if (state->live[vert])
+            return vert;
+    }
+
+    for (; state->cursor < state->nverts; ++state->cursor)
+        if (state->live[state->cursor])
+            return state->cursor;
+
+    return ORDER_NONE;
+}
+
+/*
+ * Reorders faces for reuse of recently transformed vertices, fanning around one vertex at a time as in Tipsify,
+ * with a cache of M7_VERTEX_CACHE_SIZE vertices
+ */
+void M7_Mesh_OptimizeOrder(M7_MeshFace *faces, size_t nverts, size_t nfaces) {
+    M7_MeshAdjacency *adjacency = M7_MeshAdjacency_Create(faces, nverts, nfaces);
+    M7_MeshFace *ordered = SDL_malloc(sizeof(M7_MeshFace) * SDL_max(nfaces, 1));
+    bool *emitted = SDL_calloc(SDL_max(nfaces, 1), sizeof(bool));
+    size_t max_degree = 0;
+    size_t nordered = 0;
+
+    OrderState state = {
+        .adjacency = adjacency,
+        .live = SDL_malloc(sizeof(size_t) * SDL_max(nverts, 1)),
+        .stamps = SDL_calloc(SDL_max(nverts, 1), sizeof(size_t)),
+        .dead_ends = SDL_malloc(sizeof(size_t) * SDL_max(nfaces * 3, 1)),
+        .time = M7_VERTEX_CACHE_SIZE + 1,
+        .nverts = nverts
+    };
+
+    for (size_t i = 0; i < nverts; ++i) {
+        state.live[i] = adjacency->offsets[i + 1] - adjacency->offsets[i];
+        max_degree = SDL_max(max_degree, state.live[i]);
+    }
+
+    state.candidates = SDL_malloc(sizeof(size_t) * SDL_max(max_degree * 3, 1));
+
+    for (size_t fan = NextFan(&state); fan != ORDER_NONE; fan = NextFan(&state)) {
+        state.ncandidates = 0;
+
+        for (size_t i = adjacency->offsets[fan]; i < adjacency->offsets[fan + 1]; ++i) {
+            size_t face = adjacency->faces[i];
+            size_t *idx = faces[face].idx_verts;
+
+            if (emitted[face])
+                continue;
+
+            emitted[face] = true;
+            ordered[nordered++] = faces[face];
+
+            for (int j = 0; j < 3; ++j) {
+                size_t vert = idx[j];
+
+                /* Degenerate corners are listed once in the adjacency */
+                if ((j > 0 && vert == idx[0]) || (j > 1 && vert == idx[1]))
+                    continue;
+
+                state.dead_ends[state.ndead_ends++] = vert;
+                state.candidates[state.ncandidates++] = vert;
+                state.live[vert] -= 1;
+
+                if (state.time - state.stamps[vert] > M7_VERTEX_CACHE_SIZE)
+                    state.stamps[vert] = state.time++;
+            }
+        }
+    }
+
+    SDL_memcpy(faces, ordered, sizeof(M7_MeshFace) * nordered);
+
+    M7_MeshAdjacency_Free(adjacency);
+    SDL_free(ordered);
+    SDL_free(emitted);
+    SDL_free(state.live);
+    SDL_free(state.stamps);
+    SDL_free(state.dead_ends);
+    SDL_free(state.candidates);
+}
+
+/* Unit normal of a face, or zero if it's degenerate */
+static vec3 FaceNormal(vec3 *verts, M7_MeshFace *face) {
+    size_t *idx = face->idx_verts;
+    vec3 nrml = vec3_cross(vec3_sub(verts[idx[1]], verts[idx[0]]), vec3_sub(verts[idx[2]], verts[idx[0]]));
+    float length = vec3_length(nrml);
+    return length > 0 ? vec3_div(nrml, length) : vec3_zero;
+}
+
+/* Bounding sphere around the bounding box center of a meshlet's faces, and the cone around their mean normal */
+static void BoundMeshlet(M7_Meshlet *meshlet, vec3 *verts, M7_MeshFace *faces, vec3 *face_nrmls) {
+    M7_MeshFace *first = faces + meshlet->first_face;
+    vec3 min = verts[first->idx_verts[0]], max = min;
+    vec3 axis = vec3_zero;
+
+    for (size_t i = 0; i < meshlet->nfaces; ++i) {
+        for (int j = 0; j < 3; ++j) {
+            vec3 vert = verts[first[i].idx_verts[j]];
+            min = (vec3) {{ SDL_min(min.x, vert.x), SDL_min(min.y, vert.y), SDL_min(min.z, vert.z) }};
+            max = (vec3) {{ SDL_max(max.x, vert.x), SDL_max(max.y, vert.y), SDL_max(max.z, vert.z) }};
+        }
+
+        axis = vec3_add(axis, face_nrmls[i]);
+    }
+
+    meshlet->center = vec3_mul(vec3_add(min, max), 0.5f);
+    meshlet->radius = 0;
+
+    for (size_t i = 0; i < meshlet->nfaces; ++i)
+        for (int j = 0; j < 3; ++j)
+            meshlet->radius = SDL_max(meshlet->radius, vec3_length(vec3_sub(verts[first[i].idx_verts[j]], meshlet->center)));
+
+    float axis_length = vec3_length(axis);
+    meshlet->cone_axis = axis_length > 0 ? vec3_div(axis, axis_length) : vec3_zero;
+    meshlet->cone_cos = axis_length > 0 ? 1 : 0;
+
+    for (size_t i = 0; i < meshlet->nfaces; ++i)
+        if (vec3_dot(face_nrmls[i], face_nrmls[i]) > 0)
+            meshlet->cone_cos = SDL_min(meshlet->cone_cos, vec3_dot(meshlet->cone_axis, face_nrmls[i]));
+}
+
+/*
+ * Cuts faces, in the order M7_Mesh_OptimizeOrder fanned them, into meshlets of up to M7_MESHLET_FACES faces.
+ * A meshlet also ends before a face whose normal strays from the meshlet's mean normal by more than
+ * MESHLET_CONE_COS allows, keeping normal cones narrow for backface culling without leaving the fanned order
+ * and its vertex reuse. Degenerate faces are never drawn with backface culling, so they don't widen the cone
+ */
+M7_Meshlet *M7_Mesh_BuildMeshlets(vec3 *verts, M7_MeshFace *faces, size_t nfaces, size_t *nmeshlets) {
+    List(M7_Meshlet) *meshlets = List_Create(M7_Meshlet);
+    vec3 *face_nrmls = SDL_malloc(sizeof(vec3) * SDL_max(nfaces, 1));
+
+    for (size_t i = 0; i < nfaces; ++i)
+        face_nrmls[i] = FaceNormal(verts, faces + i);
+
+    for (size_t first = 0; first < nfaces;) {
+        size_t count = 1;
+        vec3 axis = face_nrmls[first];
+
+        while (count < M7_MESHLET_FACES && first + count < nfaces) {
+            vec3 nrml = face_nrmls[first + count];
+
+            if (vec3_dot(nrml, nrml) > 0 && vec3_dot(axis, axis) > 0 && vec3_dot(vec3_normalize(axis), nrml) < MESHLET_CONE_COS)
+                break;
+
+            axis = vec3_add(axis, nrml);
+            count += 1;
+        }
+
+        List_Push(meshlets, ((M7_Meshlet) { .first_face = first, .nfaces = count }));
+        first += count;
+    }
+
+    *nmeshlets = List_Length(meshlets);
+    M7_Meshlet *bounded = SDL_malloc(sizeof(M7_Meshlet) * SDL_max(*nmeshlets, 1));
+
+    for (size_t i = 0; i < *nmeshlets; ++i) {
+        bounded[i] = List_Get(meshlets, i);
+        BoundMeshlet(bounded + i, verts, faces, face_nrmls + bounded[i].first_face);
+    }
+
+    List_Free(meshlets);
+    SDL_free(face_nrmls);
+    return bounded;
+}
+
+/*
+ * Renumbers vertices in order of first use by faces, with unused ones last, so that drawing walks vertex arrays
+ * roughly front to back. Writes the new index of each vertex to remap, for the caller to move vertex data to
+ */
+void M7_Mesh_RenumberVertices(M7_MeshFace *faces, size_t nverts, size_t nfaces, size_t *remap) {
+    size_t next = 0;
+
+    for (size_t i = 0; i < nverts; ++i)
+        remap[i] = ORDER_NONE;
+
+    for (size_t i = 0; i < nfaces; ++i)
+        for (int j = 0; j < 3; ++j)
+            if (remap[faces[i].idx_verts[j]] == ORDER_NONE)
+                remap[faces[i].idx_verts[j]] = next++;
+
+    for (size_t i = 0; i < nverts; ++i)
+        if (remap[i] == ORDER_NONE)
+            remap[i] = next++;
+
+    for (size_t i = 0; i < nfaces; ++i)
+        for (int j = 0; j < 3; ++j)
+            faces[i].idx_verts[j] = remap[faces[i].idx_verts[j]];
+}
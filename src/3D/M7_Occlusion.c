@@ -0,0 +1,242 @@
+#include <float.h>
+#include <SDL3/SDL.h>
+#include <M7/ECS.h>
+#include <M7/M7_ECS.h>
+#include <M7/Collections/List.h>
+#include <M7/Math/linalg.h>
+#include <M7/Math/stride.h>
+
+#include "M7_3D_c.h"
+
+typedef struct OcclusionEdge {
+    float a, b, c; /* a * x + b * y + c, at the corner of a texel nearest the outside of the edge */
+} OcclusionEdge;
+
+static OcclusionEdge Edge(vec2 from, vec2 to) {
+    vec2 normal = vec2_orthogonal(vec2_sub(to, from));
+
+    return (OcclusionEdge) {
+        .a = normal.x,
+        .b = normal.y,
+        .c = SDL_min(normal.x, 0) + SDL_min(normal.y, 0) - vec2_dot(normal, from)
+    };
+}
+
+/*
+ * Depth only scan of a front facing triangle in occlusion buffer coordinates. Texels only take the triangle's
+ * farthest depth, and only where the triangle covers them whole, so the buffer never hides more than the triangle
+ */
+static void ScanOccluder(float *depth, vec2 verts[3], float far) {
+    if (vec2_dot(vec2_orthogonal(vec2_sub(verts[1], verts[0])), vec2_sub(verts[2], verts[0])) <= 0)
+        return;
+
+    int min_x = SDL_clamp(SDL_floorf(SDL_min(verts[0].x, SDL_min(verts[1].x, verts[2].x))), 0, M7_OCCLUSION_WIDTH);
+    int max_x = SDL_clamp(SDL_ceilf(SDL_max(verts[0].x, SDL_max(verts[1].x, verts[2].x))), 0, M7_OCCLUSION_WIDTH);
+    int min_y = SDL_clamp(SDL_floorf(SDL_min(verts[0].y, SDL_min(verts[1].y, verts[2].y))), 0, M7_OCCLUSION_HEIGHT);
+    int max_y = SDL_clamp(SDL_ceilf(SDL_max(verts[0].y, SDL_max(verts[1].y, verts[2].y))), 0, M7_OCCLUSION_HEIGHT);
+
+    OcclusionEdge edges[3] = { Edge(verts[0], verts[1]), Edge(verts[1], verts[2]), Edge(verts[2], verts[0]) };
+    sd_float sd_far = sd_float_set(far);
+
+    for (int y = min_y; y < max_y; ++y) {
+        sd_float *row = (sd_float *)(depth + y * M7_OCCLUSION_WIDTH);
+
+        for (int x = min_x / SD_LENGTH * SD_LENGTH; x < max_x; x += SD_LENGTH) {
+            sd_float texel_x = sd_float_add(sd_float_range(), sd_float_set(x));
+            sd_mask outside = sd_mask_set(false);
+
+            for (int i = 0; i < 3; ++i) {
+                sd_float e = sd_float_fmadd(sd_float_set(edges[i].a), texel_x, sd_float_set(edges[i].b * y + edges[i].c));
+                outside = sd_mask_or(outside, sd_float_lt(e, sd_float_zero()));
+            }
+
+            sd_float *texels = row + x / SD_LENGTH;
+            *texels = sd_float_mask_blend(sd_float_min(*texels, sd_far), *texels, outside);
+        }
+    }
+}
+
+/* Triangles crossing the near plane are clipped the way the rasterizer clips them, then scanned as a fan */
+static void DrawOccluders(ECS_Handle *self, M7_Rasterizer *rasterizer, M7_WorldGeometry *wg, vec2 midpoint, vec2 to_buffer) {
+    M7_MeshFace *faces = wg->mesh->faces;
+    size_t sd_count = sd_bounding_size(wg->mesh->nverts);
+
+    for (size_t p = 0; p < List_Length(wg->placements); ++p) {
+        sd_vec3 *vs_block = wg->vs_verts + sd_count * p;
+        sd_vec2 *ss_block = wg->ss_verts + sd_count * p;
+
+        for (size_t i = 0; i < wg->mesh->nfaces; ++i) {
+            size_t *idx = faces[i].idx_verts;
+            float far = 0;
+            vec3 vs_verts[3];
+            vec2 clipped[4];
+            int nclipped = 0;
+
+            for (int j = 0; j < 3; ++j) {
+                sd_vec3_scalar vs_vert = sd_vec3_arr_get(vs_block, idx[j]);
+                vs_verts[j] = (vec3) {{ vs_vert.x.val, vs_vert.y.val, vs_vert.z.val }};
+                far = SDL_max(far, vs_verts[j].z);
+            }
+
+            for (int j = 0; j < 3; ++j) {
+                vec3 curr = vs_verts[j];
+                vec3 next = vs_verts[(j + 1) % 3];
+
+                if (curr.z >= rasterizer->near) {
+                    sd_vec2_scalar ss_vert = sd_vec2_arr_get(ss_block, idx[j]);
+                    clipped[nclipped++] = (vec2) {{ ss_vert.x.val * to_buffer.x, ss_vert.y.val * to_buffer.y }};
+                }
+
+                if ((curr.z < rasterizer->near) != (next.z < rasterizer->near)) {
+                    vec3 intercept = intersect_near(curr, next, rasterizer->near);
+
+                    sd_vec2 projected = rasterizer->project(self,
+                        sd_vec3_set(intercept.x, intercept.y, rasterizer->near),
+                        sd_vec2_set(midpoint.x, midpoint.y)
+                    );
+
+                    sd_vec2_scalar projected_scalar = sd_vec2_arr_get(&projected, 0);
+                    clipped[nclipped++] = (vec2) {{ projected_scalar.x.val * to_buffer.x, projected_scalar.y.val * to_buffer.y }};
+                }
+            }
+
+            for (int j = 1; j < nclipped - 1; ++j)
+                ScanOccluder(rasterizer->occlusion, (vec2 []) { clipped[0], clipped[j], clipped[j + 1] }, far);
+        }
+    }
+}
+
+/* Whether every texel under the screen bounds of a view space sphere holds an occluder nearer than the sphere */
+static bool SphereOccluded(M7_Rasterizer *rasterizer, float tan_half_fov, vec2 midpoint, vec2 to_buffer, vec3 center, float radius) {
+    float near_z = center.z - radius;
+    float far_z = center.z + radius;
+
+    if (near_z < rasterizer->near)
+        return false;
+
+    /* Extremes of x / z and y / z over the box around the sphere */
+    float min_x = (center.x - radius) / (center.x - radius < 0 ? near_z : far_z);
+    float max_x = (center.x + radius) / (center.x + radius > 0 ? near_z : far_z);
+    float min_y = (center.y - radius) / (center.y - radius < 0 ? near_z : far_z);
+    float max_y = (center.y + radius) / (center.y + radius > 0 ? near_z : far_z);
+
+    float scale = midpoint.x / tan_half_fov;
+
+    int x0 = SDL_max((int)SDL_floorf((midpoint.x + min_x * scale) * to_buffer.x), 0);
+    int x1 = SDL_min((int)SDL_ceilf((midpoint.x + max_x * scale) * to_buffer.x), M7_OCCLUSION_WIDTH);
+    int y0 = SDL_max((int)SDL_floorf((midpoint.y - max_y * scale) * to_buffer.y), 0);
+    int y1 = SDL_min((int)SDL_ceilf((midpoint.y - min_y * scale) * to_buffer.y), M7_OCCLUSION_HEIGHT);
+
+    /* Off screen spheres are left to frustum culling */
+    if (x0 >= x1 || y0 >= y1)
+        return false;
+
+    for (int y = y0; y < y1; ++y)
+        for (int x = x0; x < x1; ++x)
+            if (rasterizer->occlusion[y * M7_OCCLUSION_WIDTH + x] >= near_z)
+                return false;
+
+    return true;
+}
+
+typedef struct CullView {
+    M7_Rasterizer *rasterizer;
+    M7_PerspectiveFOV *perspective_fov; /* Null unless projecting in perspective */
+    M7_RasterizerCounters *counters;
+    xform3 ws2vs_xform;
+    vec2 midpoint, to_buffer;
+    int rows[2];
+    bool occlude; /* Whether the occlusion buffer was drawn */
+} CullView;
+
+/* Placements of a BVH subtree that culling applies to, which occluders are not */
+static size_t CullablePlacements(M7_BVHNode *nodes, size_t index) {
+    size_t count = 0;
+
+    for (size_t i = index; i < index + 2 * nodes[index].leaves - 1; ++i)
+        count += nodes[i].placement && !nodes[i].placement->geometry->occluder;
+
+    return count;
+}
+
+/* Unculls the placements of a BVH subtree whose bounds are in view, skipping whole subtrees that aren't */
+static void CullNode(CullView *view, M7_BVHNode *nodes, size_t index) {
+    M7_BVHNode *node = nodes + index;
+    M7_Placement *placement = node->placement;
+    vec3 center;
+    float radius;
+
+    /* Leaves test the placement's own bounding sphere, inner nodes the sphere around their box */
+    if (placement) {
+        mat3x3 basis = placement->xform.basis;
+        float scale = SDL_max(vec3_length(basis.x), SDL_max(vec3_length(basis.y), vec3_length(basis.z)));
+        center = xform3_apply(placement->xform, placement->geometry->bounds_center);
+        radius = placement->geometry->bounds_radius * scale;
+    } else {
+        center = xform3_apply(view->ws2vs_xform, vec3_mul(vec3_add(node->min, node->max), 0.5f));
+        radius = vec3_length(vec3_sub(node->max, node->min)) * 0.5f;
+    }
+
+    if (M7_SphereOutside(view->rasterizer, view->perspective_fov, view->midpoint, view->rows, center, radius)) {
+        if (view->counters) view->counters->placements_frustum_culled += CullablePlacements(nodes, index);
+        return;
+    }
+
+    if (view->occlude && SphereOccluded(view->rasterizer, view->perspective_fov->tan_half_fov, view->midpoint, view->to_buffer, center, radius)) {
+        if (view->counters) view->counters->placements_occluded += CullablePlacements(nodes, index);
+        return;
+    }
+
+    if (placement) {
+        placement->culled = false;
+        return;
+    }
+
+    CullNode(view, nodes, index + 1);
+    CullNode(view, nodes, node->right);
+}
+
+/*
+ * Rasterizes the transformed placements of occluder geometry into the occlusion buffer, then walks the world's BVH
+ * to mark the placements of other geometry outside the view frustum, or hidden behind occluders, as culled. Only
+ * perspective projection is occlusion culled. Geometry and the BVH must be up to date with the view
+ */
+void SD_VARIANT(M7_Rasterizer_Cull)(ECS_Handle *self, M7_World *world, xform3 ws2vs_xform) {
+    M7_Rasterizer *rasterizer = ECS_Entity_GetComponent(self, M7_Components.Rasterizer);
+    M7_Canvas *canvas = ECS_Entity_GetComponent(rasterizer->target, M7_Components.Canvas);
+    M7_PerspectiveFOV *perspective_fov = ECS_Entity_GetComponent(self, M7_Components.PerspectiveFOV);
+    bool perspective = perspective_fov && rasterizer->project == SD_VARIANT(M7_ProjectPerspective);
+    bool occluders = false;
+
+    List_ForEach(world->geometry, wg, {
+        occluders |= wg->occluder;
+        List_ForEach(wg->placements, placement, placement->culled = !wg->occluder; );
+    });
+
+    CullView view = {
+        .rasterizer = rasterizer,
+        .perspective_fov = perspective ? perspective_fov : nullptr,
+        .counters = rasterizer->stats ? &rasterizer->stats->total : nullptr,
+        .ws2vs_xform = ws2vs_xform,
+        .midpoint = {{ canvas->width * 0.5f, canvas->height * 0.5f }},
+        .to_buffer = {{ (float)M7_OCCLUSION_WIDTH / canvas->width, (float)M7_OCCLUSION_HEIGHT / canvas->height }},
+        .rows = { 0, canvas->height },
+        .occlude = occluders && perspective
+    };
+
+    if (view.occlude) {
+        if (!rasterizer->occlusion)
+            rasterizer->occlusion = SDL_aligned_alloc(SD_ALIGN, sizeof(float) * M7_OCCLUSION_WIDTH * M7_OCCLUSION_HEIGHT);
+
+        for (size_t i = 0; i < M7_OCCLUSION_WIDTH * M7_OCCLUSION_HEIGHT; ++i)
+            rasterizer->occlusion[i] = FLT_MAX;
+
+        List_ForEach(world->geometry, wg, {
+            if (wg->occluder)
+                DrawOccluders(self, rasterizer, wg, view.midpoint, view.to_buffer);
+        });
+    }
+
+    if (world->bvh.nnodes)
+        CullNode(&view, world->bvh.nodes, 0);
+}
@@ -4,94 +4,103 @@
 #include <M7/Collections/List.h>
 #include <M7/Math/linalg.h>
 
+#include "M7_3D_c.h"
+
+static Uint32 FloatBits(float f) {
+    Uint32 bits;
+    SDL_memcpy(&bits, &f, sizeof(bits));
+    return bits;
+}
+
+/*
+ * Takes the mesh a primitive was built with, or the one another primitive with the same key, formatted from
+ * everything the mesh is built from, shares through the nearest mesh bank. Returns whether there was one
+ */
+static bool FindMesh(ECS_Handle *self, M7_MeshPrimitive *primitive, char *fmt, ...) {
+    if (primitive->mesh)
+        return true;
+
+    va_list args;
+    va_start(args, fmt);
+    SDL_vsnprintf(primitive->key, M7_RESOURCE_PATHLEN, fmt, args);
+    va_end(args);
+
+    primitive->bank = ECS_Entity_AncestorWithComponent(self, M7_Components.MeshBank, false);
+
+    if (primitive->bank)
+        primitive->mesh = M7_ResourceBank_Find(primitive->bank, M7_Components.MeshBank, primitive->key);
+
+    return primitive->mesh;
+}
+
+/* Keeps a newly built mesh for a primitive, sharing it if FindMesh found a bank */
+static M7_Mesh *KeepMesh(M7_MeshPrimitive *primitive, M7_Mesh *mesh) {
+    if (primitive->bank)
+        M7_ResourceBank_Add(primitive->bank, M7_Components.MeshBank, primitive->key, mesh);
+
+    primitive->mesh = mesh;
+    return mesh;
+}
+
 M7_Mesh *M7_Teapot_GetMesh(ECS_Handle *self) {
-    M7_Mesh **mesh = ECS_Entity_GetComponent(self, M7_Components.MeshPrimitive);
+    M7_MeshPrimitive *primitive = ECS_Entity_GetComponent(self, M7_Components.MeshPrimitive);
     M7_Teapot *teapot = ECS_Entity_GetComponent(self, M7_Components.Teapot);
-    if (*mesh) return *mesh;
-
-    SDL_IOStream *teapot_data = SDL_IOFromFile("assets/teapot_surface0.norm", "r");
-    Uint8 chr;
-    char chrs[64];
-    int nchrs = 0;
-
-    /* Get triangle count */
-    while (SDL_ReadU8(teapot_data, &chr)) {
-        if (chr == '\n') {
-            chrs[nchrs] = '\0';
-            nchrs = 0;
-            break;
-        }
-
-        chrs[nchrs++] = chr;
-    }
 
-    size_t nfaces = SDL_strtoull(chrs, nullptr, 0);
-    size_t nverts = nfaces * 3;
-
-    vec3 *verts = List_Create(vec3);
-    vec3 *nrmls = List_Create(vec3);
-    M7_MeshFace *faces = List_Create(M7_MeshFace);
-
-    /* Read vertex/normal data */
-    float vals[18];
-    int nvals = 0;
-
-    while (SDL_ReadU8(teapot_data, &chr)) {
-        switch (chr) {
-            case ' ':
-            case '\n':
-                if (!nchrs)
-                    break;
-
-                chrs[nchrs] = '\0';
-                nchrs = 0;
-                vals[nvals++] = SDL_strtod(chrs, nullptr);
-
-                if (nvals == 18) {
-                    nvals = 0;
-                    size_t offset = List_Length(verts);
-
-                    for (int i = 0; i < 3; ++i) {
-                        List_Push(verts, vec3_mul((vec3) {
-                            .x = vals[i * 6 + 0],
-                            .y = vals[i * 6 + 1],
-                            .z = vals[i * 6 + 2]
-                        }, teapot->scale));
-
-                        List_Push(nrmls, vec3_normalize((vec3) {
-                            .x = vals[i * 6 + 3],
-                            .y = vals[i * 6 + 4],
-                            .z = vals[i * 6 + 5]
-                        }));
-                    }
-
-                    List_Push(faces, ((M7_MeshFace) {
-                        .idx_verts = { offset + 0, offset + 1, offset + 2 }
-                    }));
-                }
-
-                break;
-
-            default:
-                chrs[nchrs++] = chr;
-                break;
-        }
-    }
+    /* The scale is baked into the vertices, so it keys the cache */
+    Uint32 key = FloatBits(teapot->scale);
+
+    if (FindMesh(self, primitive, "teapot %d %08x", teapot->surface, key))
+        return primitive->mesh;
+
+    char *path;
+    SDL_asprintf(&path, "assets/teapot_surface%d.norm", teapot->surface);
+    M7_Mesh *mesh = M7_Mesh_Load(path, M7_Mesh_ParseNorm, &teapot->scale, key);
+    SDL_free(path);
+    return KeepMesh(primitive, mesh);
+}
+
+/* Loads a mesh file, choosing its parser by extension. Unreadable files load as an empty mesh */
+M7_Mesh *M7_MeshFile_GetMesh(ECS_Handle *self) {
+    M7_MeshPrimitive *primitive = ECS_Entity_GetComponent(self, M7_Components.MeshPrimitive);
+    M7_MeshFile *file = ECS_Entity_GetComponent(self, M7_Components.MeshFile);
+
+    /* The scale is baked into the vertices, so it keys the cache */
+    Uint32 key = FloatBits(file->scale);
 
-    *mesh = M7_Mesh_Create(List_GetAddress(verts, 0), List_GetAddress(nrmls, 0), nullptr, List_GetAddress(faces, 0), nverts, 0, nfaces);
+    if (FindMesh(self, primitive, "file %08x %zu %08x", SDL_crc32(0, file->path, SDL_strlen(file->path)), SDL_strlen(file->path), key))
+        return primitive->mesh;
 
-    List_Free(verts);
-    List_Free(nrmls);
-    List_Free(faces);
-    SDL_CloseIO(teapot_data);
+    static const struct { char *extension; M7_MeshParser parse; } parsers[] = {
+        { ".obj", M7_Mesh_ParseOBJ },
+        { ".ply", M7_Mesh_ParsePLY },
+        { ".norm", M7_Mesh_ParseNorm }
+    };
+
+    char *extension = SDL_strrchr(file->path, '.');
+    M7_MeshParser parse = nullptr;
+    M7_Mesh *mesh = nullptr;
+
+    for (size_t i = 0; extension && i < SDL_arraysize(parsers); ++i)
+        if (!SDL_strcasecmp(extension, parsers[i].extension))
+            parse = parsers[i].parse;
+
+    if (!parse)
+        SDL_Log("Unknown mesh format %s", file->path);
+    else
+        mesh = M7_Mesh_Load(file->path, parse, &file->scale, key);
+
+    if (!mesh)
+        mesh = M7_Mesh_Create(nullptr, nullptr, nullptr, nullptr, 0, 0, 0);
 
-    return *mesh;
+    return KeepMesh(primitive, mesh);
 }
 
 M7_Mesh *M7_Torus_GetMesh(ECS_Handle *self) {
-    M7_Mesh **mesh = ECS_Entity_GetComponent(self, M7_Components.MeshPrimitive);
+    M7_MeshPrimitive *primitive = ECS_Entity_GetComponent(self, M7_Components.MeshPrimitive);
     M7_Torus *torus = ECS_Entity_GetComponent(self, M7_Components.Torus);
-    if (*mesh) return *mesh;
+
+    if (FindMesh(self, primitive, "torus %zu %zu %08x %08x", torus->outer_precision, torus->inner_precision, FloatBits(torus->outer_radius), FloatBits(torus->inner_radius)))
+        return primitive->mesh;
 
     M7_Sculpture *torus_sculpt = M7_Sculpture_Create();
     List(M7_PolyChain *) *rings = List_Create(M7_PolyChain *);
@@ -111,17 +120,19 @@ M7_Mesh *M7_Torus_GetMesh(ECS_Handle *self) {
     for (size_t i = 0; i < List_Length(rings); ++i)
         M7_Sculpture_JoinPolyChains(torus_sculpt, List_Get(rings, i), List_Get(rings, (i + 1) % List_Length(rings)));
 
-    *mesh = M7_Sculpture_ToMesh(torus_sculpt);
+    M7_Mesh *mesh = M7_Sculpture_ToMesh(torus_sculpt);
     List_Free(rings);
     M7_Sculpture_Free(torus_sculpt);
 
-    return *mesh;
+    return KeepMesh(primitive, mesh);
 }
 
 M7_Mesh *M7_Sphere_GetMesh(ECS_Handle *self) {
-    M7_Mesh **mesh = ECS_Entity_GetComponent(self, M7_Components.MeshPrimitive);
+    M7_MeshPrimitive *primitive = ECS_Entity_GetComponent(self, M7_Components.MeshPrimitive);
     M7_Sphere *sphere = ECS_Entity_GetComponent(self, M7_Components.Sphere);
-    if (*mesh) return *mesh;
+
+    if (FindMesh(self, primitive, "sphere %zu %zu %08x", sphere->nrings, sphere->ring_precision, FloatBits(sphere->radius)))
+        return primitive->mesh;
 
     M7_Sculpture *sphere_sculpt = M7_Sculpture_Create();
     List(M7_PolyChain *) *rings = List_Create(M7_PolyChain *);
@@ -150,17 +161,19 @@ M7_Mesh *M7_Sphere_GetMesh(ECS_Handle *self) {
     for (size_t i = 0; i < sphere->nrings - 1; ++i)
         M7_Sculpture_JoinPolyChains(sphere_sculpt, List_Get(rings, i), List_Get(rings, i + 1));
 
-    *mesh = M7_Sculpture_ToMesh(sphere_sculpt);
+    M7_Mesh *mesh = M7_Sculpture_ToMesh(sphere_sculpt);
     List_Free(rings);
     M7_Sculpture_Free(sphere_sculpt);
 
-    return *mesh;
+    return KeepMesh(primitive, mesh);
 }
 
 M7_Mesh *M7_Rect_GetMesh(ECS_Handle *self) {
-    M7_Mesh **mesh = ECS_Entity_GetComponent(self, M7_Components.MeshPrimitive);
+    M7_MeshPrimitive *primitive = ECS_Entity_GetComponent(self, M7_Components.MeshPrimitive);
     M7_Rect *rect = ECS_Entity_GetComponent(self, M7_Components.Rect);
-    if (*mesh) return *mesh;
+
+    if (FindMesh(self, primitive, "rect %08x %08x", FloatBits(rect->width), FloatBits(rect->height)))
+        return primitive->mesh;
 
     vec3 ws_verts[4] = {
         { .x = -rect->width * 0.5f, .y = rect->height * 0.5f },
@@ -183,14 +196,15 @@ M7_Mesh *M7_Rect_GetMesh(ECS_Handle *self) {
         { .idx_verts = { 1, 3, 2 }, .idx_tverts = { 1, 3, 2 } },
     };
 
-    *mesh = M7_Mesh_Create(ws_verts, nullptr, ts_verts, faces, 4, 4, 2);
-    return *mesh;
+    return KeepMesh(primitive, M7_Mesh_Create(ws_verts, nullptr, ts_verts, faces, 4, 4, 2));
 }
 
 M7_Mesh *M7_Cubemap_GetMesh(ECS_Handle *self) {
-    M7_Mesh **mesh = ECS_Entity_GetComponent(self, M7_Components.MeshPrimitive);
+    M7_MeshPrimitive *primitive = ECS_Entity_GetComponent(self, M7_Components.MeshPrimitive);
     M7_Cubemap *cubemap = ECS_Entity_GetComponent(self, M7_Components.Cubemap);
-    if (*mesh) return *mesh;
+
+    if (FindMesh(self, primitive, "cubemap %08x", FloatBits(cubemap->scale)))
+        return primitive->mesh;
 
     vec3 ws_verts[8] = {
         { .x=-1, .y=1, .z=-1 }, { .x=1, .y=1, .z=-1 },
@@ -218,17 +232,44 @@ M7_Mesh *M7_Cubemap_GetMesh(ECS_Handle *self) {
         { .idx_verts = { 4, 6, 7 }, .idx_tverts = { 12, 8, 9 } }, { .idx_verts = { 4, 7, 5 }, .idx_tverts = { 12, 9, 13 } },
     };
 
-    *mesh = M7_Mesh_Create(ws_verts, nullptr, ts_verts, faces, 8, 14, 12);
-    return *mesh;
+    return KeepMesh(primitive, M7_Mesh_Create(ws_verts, nullptr, ts_verts, faces, 8, 14, 12));
 }
 
 void M7_MeshPrimitive_Init(void *component, void *args) {
     (void)args;
-    M7_Mesh **mesh = component;
-    *mesh = nullptr;
+    M7_MeshPrimitive *primitive = component;
+    *primitive = (M7_MeshPrimitive) {};
+}
+
+void M7_MeshPrimitive_Detach(ECS_Handle *self, ECS_Component(void) *component) {
+    M7_MeshPrimitive *primitive = ECS_Entity_GetComponent(self, component);
+
+    if (!primitive->mesh)
+        return;
+
+    if (primitive->bank)
+        M7_ResourceBank_Release(primitive->bank, M7_Components.MeshBank, primitive->key);
+    else
+        M7_Mesh_Free(primitive->mesh);
+}
+
+static void FreeMesh(ECS_Handle *self, void *data) {
+    (void)self;
+    M7_Mesh_Free(data);
+}
+
+void M7_MeshBank_Attach(ECS_Handle *self, ECS_Component(void) *component) {
+    M7_ResourceBank_Attach(self, component, nullptr, FreeMesh);
+}
+
+void M7_MeshFile_Init(void *component, void *args) {
+    M7_MeshFile *file = component;
+    M7_MeshFile *file_args = args;
+    file->path = SDL_strdup(file_args->path);
+    file->scale = file_args->scale;
 }
 
-void M7_MeshPrimitive_Free(void *component) {
-    M7_Mesh **mesh = component;
-    if (*mesh) M7_Mesh_Free(*mesh);
+void M7_MeshFile_Free(void *component) {
+    M7_MeshFile *file = component;
+    SDL_free(file->path);
 }
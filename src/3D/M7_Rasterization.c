@@ -1,6 +1,7 @@
 #include <SDL3/SDL.h>
 #include <M7/ECS.h>
 #include <M7/M7_ECS.h>
+#include <M7/M7_Profile.h>
 #include <M7/Collections/List.h>
 #include <M7/Math/linalg.h>
 #include <M7/Math/stride.h>
@@ -9,30 +10,73 @@
 
 typedef struct SubCanvasRenderData {
     ECS_Handle *rasterizer;
+    M7_RasterizerCounters (*counters)[M7_RASTERIZER_FLAG_COMBINATIONS];
     int bounds[2];
     int (*scanlines)[2];
+    M7_Texture *sky;
+    bool primary;
 } SubCanvasRenderData;
 
+static M7_FragmentSpan CreateFragmentSpan(size_t sd_width) {
+    size_t block_size = sizeof(sd_vec4) * (1 + M7_VERTEX_ATTRIBUTES) + sizeof(sd_vec3) * 2 + sizeof(sd_vec2) + sizeof(sd_float);
+    M7_FragmentSpan span = { .col = SDL_aligned_alloc(SD_ALIGN, block_size * sd_width) };
+
+    for (int i = 0; i < M7_VERTEX_ATTRIBUTES; ++i)
+        span.attrs[i] = span.col + sd_width * (1 + i);
+
+    span.vs = (sd_vec3 *)(span.col + sd_width * (1 + M7_VERTEX_ATTRIBUTES));
+    span.nrml = span.vs + sd_width;
+    span.ts = (sd_vec2 *)(span.nrml + sd_width);
+    span.inv_z = (sd_float *)(span.ts + sd_width);
+    return span;
+}
+
 static inline int roundtl(float f) {
     return SDL_ceilf(f - 0.5f);
 }
 
-static inline vec3 intersect_near(vec3 from, vec3 to, float near) {
-    vec3 path = vec3_sub(to, from);
-    vec3 slope = vec3_div(path, path.z);
-    return vec3_add(from, vec3_mul(slope, near - from.z));
+/* Runs the shader pipeline over the scanned span, then depth tests and writes it to the canvas */
+static void M7_Rasterizer_DrawSpan(M7_Canvas *canvas, M7_TriangleDraw *triangle, M7_RasterizerFlags flags, int scanline[2]) {
+    M7_FragmentSpan *span = triangle->span;
+
+    {
+        M7_PROFILE_ACCUMULATE(M7_PROFILE_SHADE);
+
+        for (size_t i = 0; i < triangle->nshaders; ++i)
+            triangle->shader_pipeline[i](triangle->shader_states[i], span);
+    }
+
+    int base = span->y * sd_bounding_size(canvas->width) + span->x / SD_LENGTH;
+
+    for (size_t k = 0; k < span->length; ++k) {
+        sd_float fragment_x = sd_float_add(sd_float_range(), sd_float_set(0.5f));
+                 fragment_x = sd_float_add(fragment_x, sd_float_set(span->x + (int)k * SD_LENGTH));
+
+        sd_vec3 bg = canvas->color[base + k];
+        sd_float bg_z = canvas->depth[base + k];
+        sd_float inv_z = span->inv_z[k];
+        sd_mask mask = sd_float_clamp_mask(fragment_x, scanline[0], scanline[1]);
+        sd_mask coverage = mask;
+
+        if (flags & M7_RASTERIZER_TEST_DEPTH)
+            mask = sd_mask_and(mask, sd_float_gt(inv_z, bg_z));
+
+        if (triangle->counters) {
+            triangle->counters->blocks_scanned += 1;
+            triangle->counters->fragments_shaded += sd_mask_count(coverage);
+            triangle->counters->fragments_passed += sd_mask_count(mask);
+        }
+
+        if (flags & M7_RASTERIZER_WRITE_DEPTH)
+            canvas->depth[base + k] = sd_float_mask_blend(bg_z, inv_z, mask);
+
+        canvas->color[base + k] = sd_vec3_mask_blend(bg, span->col[k].rgb, mask);
+    }
 }
 
 void SD_VARIANT(M7_ScanLinear)(ECS_Handle *self, M7_TriangleDraw triangle, M7_RasterizerFlags flags, int (*scanlines)[2], int range[2]) {
     M7_Rasterizer *rasterizer = ECS_Entity_GetComponent(self, M7_Components.Rasterizer);
     M7_Canvas *canvas = ECS_Entity_GetComponent(rasterizer->target, M7_Components.Canvas);
-    xform3 scalar_vs2ws_xform = M7_Entity_GetXform(self);
-
-    sd_vec3 vs2ws_xform[3] = {
-        sd_vec3_set(scalar_vs2ws_xform.basis.x.x, scalar_vs2ws_xform.basis.x.y, scalar_vs2ws_xform.basis.x.z),
-        sd_vec3_set(scalar_vs2ws_xform.basis.y.x, scalar_vs2ws_xform.basis.y.y, scalar_vs2ws_xform.basis.y.z),
-        sd_vec3_set(scalar_vs2ws_xform.basis.z.x, scalar_vs2ws_xform.basis.z.y, scalar_vs2ws_xform.basis.z.z),
-    };
 
     sd_vec2 origin = sd_vec2_set(triangle.ss_verts[0].x ,triangle.ss_verts[0].y);
     sd_vec2 ab = sd_vec2_sub(sd_vec2_set(triangle.ss_verts[1].x, triangle.ss_verts[1].y), origin);
@@ -72,16 +116,37 @@ void SD_VARIANT(M7_ScanLinear)(ECS_Handle *self, M7_TriangleDraw triangle, M7_Ra
         sd_vec2_fmadd(ac_ts, inv_xform[1].y, sd_vec2_muls(ab_ts, inv_xform[1].x))
     };
 
+    sd_vec4 origin_attrs[M7_VERTEX_ATTRIBUTES];
+    sd_vec4 attrs_xform[M7_VERTEX_ATTRIBUTES][2];
+
+    for (int a = 0; triangle.interpolate_attrs && a < M7_VERTEX_ATTRIBUTES; ++a) {
+        float (*verts)[4] = triangle.attrs[a];
+        origin_attrs[a] = sd_vec4_set(verts[0][0], verts[0][1], verts[0][2], verts[0][3]);
+        sd_vec4 ab_attr = sd_vec4_sub(sd_vec4_set(verts[1][0], verts[1][1], verts[1][2], verts[1][3]), origin_attrs[a]);
+        sd_vec4 ac_attr = sd_vec4_sub(sd_vec4_set(verts[2][0], verts[2][1], verts[2][2], verts[2][3]), origin_attrs[a]);
+
+        for (int i = 0; i < 2; ++i)
+            attrs_xform[a][i] = sd_vec4_fmadd(ac_attr, inv_xform[i].y, sd_vec4_muls(ab_attr, inv_xform[i].x));
+    }
+
     vec3 scalar_nrml = vec3_cross(vec3_sub(triangle.vs_verts[1], triangle.vs_verts[0]), vec3_sub(triangle.vs_verts[2], triangle.vs_verts[0]));
     sd_vec3 nrml = sd_vec3_set(scalar_nrml.x, scalar_nrml.y, scalar_nrml.z);
 
     for (int i = range[0]; i < range[1]; ++i) {
-        int base = i * sd_bounding_size(canvas->width);
         int sd_left = scanlines[i][0] / SD_LENGTH;
         int sd_right = sd_bounding_size(scanlines[i][1]);
 
+        if (sd_left >= sd_right)
+            continue;
+
+        M7_FragmentSpan *span = triangle.span;
+        span->x = sd_left * SD_LENGTH;
+        span->y = i;
+        span->length = sd_right - sd_left;
+
         for (int j = sd_left; j < sd_right; ++j) {
             int left = j * SD_LENGTH;
+            int k = j - sd_left;
 
             sd_vec2 ss = {
                 .x = sd_float_add(sd_float_set(left), sd_float_add(sd_float_range(), sd_float_set(0.5f))),
@@ -106,29 +171,19 @@ void SD_VARIANT(M7_ScanLinear)(ECS_Handle *self, M7_TriangleDraw triangle, M7_Ra
             sd_vec2 fragment_ts = sd_vec2_fmadd(ts_xform[0], relative.x, origin_ts);
                     fragment_ts = sd_vec2_fmadd(ts_xform[1], relative.y, fragment_ts);
 
-            M7_ShaderParams fragment = {
-                .vs = fragment_vs,
-                .nrml = fragment_nrml,
-                .ts = fragment_ts
-            };
-
-            SDL_memcpy(fragment.vs2ws_xform, vs2ws_xform, sizeof(sd_vec3 [3]));
-
-            for (size_t i = 0; i < triangle.nshaders; ++i)
-                fragment.col = triangle.shader_pipeline[i](triangle.shader_states[i], fragment);
-
-            sd_vec3 bg = canvas->color[base + j];
-            sd_float bg_z = canvas->depth[base + j];
-            sd_mask mask = sd_float_clamp_mask(ss.x, scanlines[i][0], scanlines[i][1]);
-
-            if (flags & M7_RASTERIZER_TEST_DEPTH)
-                mask = sd_mask_and(mask, sd_float_gt(inv_z, bg_z));
-
-            if (flags & M7_RASTERIZER_WRITE_DEPTH)
-                canvas->depth[base + j] = sd_float_mask_blend(bg_z, inv_z, mask);
+            for (int a = 0; triangle.interpolate_attrs && a < M7_VERTEX_ATTRIBUTES; ++a) {
+                sd_vec4 fragment_attr = sd_vec4_fmadd(attrs_xform[a][0], relative.x, origin_attrs[a]);
+                span->attrs[a][k] = sd_vec4_fmadd(attrs_xform[a][1], relative.y, fragment_attr);
+            }
 
-            canvas->color[base + j] = sd_vec3_mask_blend(bg, fragment.col.rgb, mask);
+            span->col[k] = (sd_vec4) {};
+            span->vs[k] = fragment_vs;
+            span->nrml[k] = fragment_nrml;
+            span->ts[k] = fragment_ts;
+            span->inv_z[k] = inv_z;
         }
+
+        M7_Rasterizer_DrawSpan(canvas, &triangle, flags, scanlines[i]);
     }
 }
 
@@ -136,13 +191,6 @@ void SD_VARIANT(M7_ScanPerspective)(ECS_Handle *self, M7_TriangleDraw triangle,
     M7_Rasterizer *rasterizer = ECS_Entity_GetComponent(self, M7_Components.Rasterizer);
     M7_Canvas *canvas = ECS_Entity_GetComponent(rasterizer->target, M7_Components.Canvas);
     M7_PerspectiveFOV *perspective_fov = ECS_Entity_GetComponent(self, M7_Components.PerspectiveFOV);
-    xform3 scalar_vs2ws_xform = M7_Entity_GetXform(self);
-
-    sd_vec3 vs2ws_xform[3] = {
-        sd_vec3_set(scalar_vs2ws_xform.basis.x.x, scalar_vs2ws_xform.basis.x.y, scalar_vs2ws_xform.basis.x.z),
-        sd_vec3_set(scalar_vs2ws_xform.basis.y.x, scalar_vs2ws_xform.basis.y.y, scalar_vs2ws_xform.basis.y.z),
-        sd_vec3_set(scalar_vs2ws_xform.basis.z.x, scalar_vs2ws_xform.basis.z.y, scalar_vs2ws_xform.basis.z.z),
-    };
 
     sd_vec3 origin = sd_vec3_set(triangle.vs_verts[0].x, triangle.vs_verts[0].y, triangle.vs_verts[0].z);
     sd_vec3 ab = sd_vec3_sub(sd_vec3_set(triangle.vs_verts[1].x, triangle.vs_verts[1].y, triangle.vs_verts[1].z), origin);
@@ -182,6 +230,19 @@ void SD_VARIANT(M7_ScanPerspective)(ECS_Handle *self, M7_TriangleDraw triangle,
         sd_vec2_fmadd(ac_ts, inv_xform[2].y, sd_vec2_muls(ab_ts, inv_xform[2].x))
     };
 
+    sd_vec4 origin_attrs[M7_VERTEX_ATTRIBUTES];
+    sd_vec4 attrs_xform[M7_VERTEX_ATTRIBUTES][3];
+
+    for (int a = 0; triangle.interpolate_attrs && a < M7_VERTEX_ATTRIBUTES; ++a) {
+        float (*verts)[4] = triangle.attrs[a];
+        origin_attrs[a] = sd_vec4_set(verts[0][0], verts[0][1], verts[0][2], verts[0][3]);
+        sd_vec4 ab_attr = sd_vec4_sub(sd_vec4_set(verts[1][0], verts[1][1], verts[1][2], verts[1][3]), origin_attrs[a]);
+        sd_vec4 ac_attr = sd_vec4_sub(sd_vec4_set(verts[2][0], verts[2][1], verts[2][2], verts[2][3]), origin_attrs[a]);
+
+        for (int i = 0; i < 3; ++i)
+            attrs_xform[a][i] = sd_vec4_fmadd(ac_attr, inv_xform[i].y, sd_vec4_muls(ab_attr, inv_xform[i].x));
+    }
+
     sd_vec2 midpoint = {
         .x = sd_float_set(canvas->width * 0.5f),
         .y = sd_float_set(canvas->height * 0.5f)
@@ -190,12 +251,20 @@ void SD_VARIANT(M7_ScanPerspective)(ECS_Handle *self, M7_TriangleDraw triangle,
     sd_float normalize_ss = sd_float_mul(sd_float_set(perspective_fov->tan_half_fov), sd_float_rcp(midpoint.x));
 
     for (int i = range[0]; i < range[1]; ++i) {
-        int base = i * sd_bounding_size(canvas->width);
         int sd_left = scanlines[i][0] / SD_LENGTH;
         int sd_right = sd_bounding_size(scanlines[i][1]);
 
+        if (sd_left >= sd_right)
+            continue;
+
+        M7_FragmentSpan *span = triangle.span;
+        span->x = sd_left * SD_LENGTH;
+        span->y = i;
+        span->length = sd_right - sd_left;
+
         for (int j = sd_left; j < sd_right; ++j) {
             int left = j * SD_LENGTH;
+            int k = j - sd_left;
             sd_float fragment_x = sd_float_add(sd_float_range(), sd_float_set(0.5));
                      fragment_x = sd_float_add(fragment_x, sd_float_set(left));
 
@@ -235,29 +304,20 @@ void SD_VARIANT(M7_ScanPerspective)(ECS_Handle *self, M7_TriangleDraw triangle,
                     fragment_ts = sd_vec2_fmadd(ts_xform[1], relative.y, fragment_ts);
                     fragment_ts = sd_vec2_fmadd(ts_xform[2], relative.z, fragment_ts);
 
-            M7_ShaderParams fragment = {
-                .vs = fragment_vs,
-                .nrml = fragment_nrml,
-                .ts = fragment_ts
-            };
-
-            SDL_memcpy(fragment.vs2ws_xform, vs2ws_xform, sizeof(sd_vec3 [3]));
-
-            for (size_t i = 0; i < triangle.nshaders; ++i)
-                fragment.col = triangle.shader_pipeline[i](triangle.shader_states[i], fragment);
-
-            sd_vec3 bg = canvas->color[base + j];
-            sd_float bg_z = canvas->depth[base + j];
-            sd_mask mask = sd_float_clamp_mask(fragment_x, scanlines[i][0], scanlines[i][1]);
-
-            if (flags & M7_RASTERIZER_TEST_DEPTH)
-                mask = sd_mask_and(mask, sd_float_gt(inv_z, bg_z));
-
-            if (flags & M7_RASTERIZER_WRITE_DEPTH)
-                canvas->depth[base + j] = sd_float_mask_blend(bg_z, inv_z, mask);
+            for (int a = 0; triangle.interpolate_attrs && a < M7_VERTEX_ATTRIBUTES; ++a) {
+                sd_vec4 fragment_attr = sd_vec4_fmadd(attrs_xform[a][0], relative.x, origin_attrs[a]);
+                        fragment_attr = sd_vec4_fmadd(attrs_xform[a][1], relative.y, fragment_attr);
+                span->attrs[a][k] = sd_vec4_fmadd(attrs_xform[a][2], relative.z, fragment_attr);
+            }
 
-            canvas->color[base + j] = sd_vec3_mask_blend(bg, fragment.col.rgb, mask);
+            span->col[k] = (sd_vec4) {};
+            span->vs[k] = fragment_vs;
+            span->nrml[k] = fragment_nrml;
+            span->ts[k] = fragment_ts;
+            span->inv_z[k] = inv_z;
         }
+
+        M7_Rasterizer_DrawSpan(canvas, &triangle, flags, scanlines[i]);
     }
 }
 
@@ -280,6 +340,7 @@ static void Trace(int width, int bounds[2], int (*scanlines)[2], vec2 line[2]) {
 }
 
 static void M7_Rasterizer_DrawTriangle(ECS_Handle *self, M7_TriangleDraw triangle, M7_RasterizerFlags flags, int (*scanlines)[2], int bounds[2]) {
+    M7_PROFILE_ACCUMULATE(M7_PROFILE_SCAN);
     M7_Rasterizer *rasterizer = ECS_Entity_GetComponent(self, M7_Components.Rasterizer);
     M7_Canvas *canvas = ECS_Entity_GetComponent(rasterizer->target, M7_Components.Canvas);
 
@@ -295,129 +356,611 @@ static void M7_Rasterizer_DrawTriangle(ECS_Handle *self, M7_TriangleDraw triangl
     rasterizer->scan(self, triangle, flags, scanlines, (int [2]) { high, low });
 }
 
-static void M7_Rasterizer_DrawBatch(ECS_Handle *self, List(M7_RenderInstance *) *batch, M7_RasterizerFlags flags, int (*scanlines)[2], int bounds[2]) {
+/* Counts the vertices of a face missing from a FIFO cache of recently fetched vertices, and fetches them into it */
+static size_t FetchVertices(size_t cache[M7_VERTEX_CACHE_SIZE], size_t *head, size_t idx[3]) {
+    size_t misses = 0;
+
+    for (int i = 0; i < 3; ++i) {
+        bool cached = false;
+
+        for (int j = 0; j < M7_VERTEX_CACHE_SIZE; ++j)
+            cached |= cache[j] == idx[i];
+
+        if (cached)
+            continue;
+
+        cache[*head] = idx[i];
+        *head = (*head + 1) % M7_VERTEX_CACHE_SIZE;
+        misses += 1;
+    }
+
+    return misses;
+}
+
+/* Whether a basis only rotates and uniformly scales, so that it keeps normal cones circular and doesn't mirror */
+static bool IsSimilarity(mat3x3 basis, float scale) {
+    float tolerance = scale * scale * 1e-3f;
+
+    return SDL_fabsf(vec3_dot(basis.y, basis.y) - scale * scale) <= tolerance
+        && SDL_fabsf(vec3_dot(basis.z, basis.z) - scale * scale) <= tolerance
+        && SDL_fabsf(vec3_dot(basis.x, basis.y)) <= tolerance
+        && SDL_fabsf(vec3_dot(basis.y, basis.z)) <= tolerance
+        && SDL_fabsf(vec3_dot(basis.z, basis.x)) <= tolerance
+        && vec3_dot(vec3_cross(basis.x, basis.y), basis.z) > 0;
+}
+
+/* Whether every face of a view space meshlet faces away from the camera, given its normal cone */
+static bool ConeBackfacing(vec3 center, float radius, vec3 axis, float cone_cos) {
+    if (cone_cos <= 0)
+        return false;
+
+    float along = vec3_dot(axis, center);
+    float across = SDL_sqrtf(SDL_max(vec3_dot(center, center) - along * along, 0));
+    return cone_cos * along - SDL_sqrtf(1 - cone_cos * cone_cos) * across > radius;
+}
+
+/* Classification of a triangle in setup, as bits */
+enum TriangleSetup {
+    SETUP_CLIPPED   = 1 << 0, /* Crosses the near plane */
+    SETUP_OFFSCREEN = 1 << 1, /* Bounds miss the canvas */
+    SETUP_OUTSIDE   = 1 << 2, /* Bounds miss the rows drawn */
+    SETUP_CW        = 1 << 3  /* Winds clockwise on screen, so faces the camera */
+};
+
+/* What setting up and drawing the faces of one placement of an instance takes */
+typedef struct PlacementDraw {
+    ECS_Handle *self;
+    M7_Rasterizer *rasterizer;
+    M7_Canvas *canvas;
+    M7_RenderInstance *instance;
+    M7_RasterizerFlags flags;
+    M7_RasterizerCounters *counters;
+    M7_FragmentSpan *span;
+    int (*scanlines)[2];
+    int *bounds;
+    bool count;
+    size_t sd_count;
+    sd_vec3 *vs_block, *nrml_block;
+    sd_vec2 *ss_block;
+    sd_vec4 *attrs_block;
+} PlacementDraw;
+
+/* Counts a classified triangle, and returns whether it goes on to be scanned */
+static bool SetupSurvives(PlacementDraw *draw, int setup) {
+    if (draw->count && setup & SETUP_OFFSCREEN) {
+        draw->counters->triangles_offscreen_culled += 1;
+        return false;
+    }
+
+    if (setup & SETUP_OUTSIDE && !draw->count)
+        return false;
+
+    if (draw->flags & M7_RASTERIZER_CULL_BACKFACE && !(setup & SETUP_CW)) {
+        if (draw->count) draw->counters->triangles_backface_culled += 1;
+        return false;
+    }
+
+    if (draw->count)
+        draw->counters->triangles_rasterized += 1;
+
+    return !(setup & SETUP_OUTSIDE);
+}
+
+/* Scans a face set up as a screen space triangle, wound clockwise whichever way it faces */
+static void DrawFace(PlacementDraw *draw, M7_MeshFace *face, vec3 vs_verts[3], vec2 ss_verts[3], bool verts_cw) {
+    M7_RenderInstance *instance = draw->instance;
+    M7_Mesh *mesh = instance->geometry->mesh;
+    size_t idx[3] = { face->idx_verts[0], face->idx_verts[1 + !verts_cw], face->idx_verts[1 + verts_cw] };
+    size_t idx_tverts[3] = { face->idx_tverts[0], face->idx_tverts[1 + !verts_cw], face->idx_tverts[1 + verts_cw] };
+
+    M7_TriangleDraw triangle = instance->fused_shader ? (M7_TriangleDraw) {
+        .counters = draw->counters,
+        .span = draw->span,
+        .shader_pipeline = &instance->fused_shader,
+        .shader_states = &instance->fused_state,
+        .nshaders = 1
+    } : (M7_TriangleDraw) {
+        .counters = draw->counters,
+        .span = draw->span,
+        .shader_pipeline = instance->shader_pipeline,
+        .shader_states = instance->shader_states,
+        .nshaders = instance->nshaders
+    };
+
+    SDL_memcpy(triangle.vs_verts, (vec3 [3]) { vs_verts[0], vs_verts[1 + !verts_cw], vs_verts[1 + verts_cw] }, sizeof(vec3 [3]));
+    SDL_memcpy(triangle.ss_verts, (vec2 [3]) { ss_verts[0], ss_verts[1 + !verts_cw], ss_verts[1 + verts_cw] }, sizeof(vec2 [3]));
+
+    if (draw->nrml_block)
+        SDL_memcpy(triangle.vs_nrmls, (sd_vec3_scalar [3]) {
+            sd_vec3_arr_get(draw->nrml_block, idx[0]),
+            sd_vec3_arr_get(draw->nrml_block, idx[1]),
+            sd_vec3_arr_get(draw->nrml_block, idx[2])
+        }, sizeof(vec3 [3]));
+
+    if (mesh->ts_verts)
+        SDL_memcpy(triangle.ts_verts, (vec2 [3]) {
+            mesh->ts_verts[idx_tverts[0]],
+            mesh->ts_verts[idx_tverts[1]],
+            mesh->ts_verts[idx_tverts[2]]
+        }, sizeof(vec2 [3]));
+
+    if (draw->attrs_block) {
+        triangle.interpolate_attrs = true;
+
+        for (int k = 0; k < M7_VERTEX_ATTRIBUTES; ++k)
+            SDL_memcpy(triangle.attrs[k], (sd_vec4_scalar [3]) {
+                sd_vec4_arr_get(draw->attrs_block + draw->sd_count * k, idx[0]),
+                sd_vec4_arr_get(draw->attrs_block + draw->sd_count * k, idx[1]),
+                sd_vec4_arr_get(draw->attrs_block + draw->sd_count * k, idx[2])
+            }, sizeof(float [3][4]));
+    }
+
+    M7_Rasterizer_DrawTriangle(draw->self, triangle, draw->flags, draw->scanlines, draw->bounds);
+}
+
+/* Fetches the view and screen space vertices of a face, as wound in the mesh, for faces set up one at a time */
+static void FaceVerts(PlacementDraw *draw, M7_MeshFace *face, vec3 vs_verts[3], vec2 ss_verts[3]) {
+    SDL_memcpy(vs_verts, &(sd_vec3_scalar [3]) {
+        sd_vec3_arr_get(draw->vs_block, face->idx_verts[0]),
+        sd_vec3_arr_get(draw->vs_block, face->idx_verts[1]),
+        sd_vec3_arr_get(draw->vs_block, face->idx_verts[2])
+    }, sizeof(vec3 [3]));
+
+    SDL_memcpy(ss_verts, (sd_vec2_scalar [3]) {
+        sd_vec2_arr_get(draw->ss_block, face->idx_verts[0]),
+        sd_vec2_arr_get(draw->ss_block, face->idx_verts[1]),
+        sd_vec2_arr_get(draw->ss_block, face->idx_verts[2]),
+    }, sizeof(vec2 [3]));
+}
+
+/* Clips a face crossing the near plane, then sets up and draws the fan of triangles left one at a time */
+static void DrawClippedFace(PlacementDraw *draw, M7_MeshFace *face) {
+    M7_Rasterizer *rasterizer = draw->rasterizer;
+    M7_Canvas *canvas = draw->canvas;
+    vec3 vs_verts[3];
+    vec2 ss_verts[3];
+    vec2 clipped[4];
+    int nclipped = 0;
+
+    FaceVerts(draw, face, vs_verts, ss_verts);
+
+    for (int j = 0; j < 3; ++j) {
+        vec3 curr = vs_verts[j];
+        vec3 next = vs_verts[(j + 1) % 3];
+
+        if (curr.z >= rasterizer->near)
+            clipped[nclipped++] = ss_verts[j];
+
+        if ((curr.z < rasterizer->near) != (next.z < rasterizer->near)) {
+            vec3 intercept = intersect_near(curr, next, rasterizer->near);
+
+            sd_vec2 projected = rasterizer->project(draw->self,
+                sd_vec3_set(intercept.x, intercept.y, rasterizer->near),
+                sd_vec2_set(canvas->width * 0.5f, canvas->height * 0.5f)
+            );
+
+            sd_vec2_scalar projected_scalar = sd_vec2_arr_get(&projected, 0);
+            SDL_memcpy(clipped + nclipped++, &projected_scalar, sizeof(vec2));
+        }
+    }
+
+    if (draw->count && nclipped != 3)
+        draw->counters->triangles_near_clipped += 1;
+
+    /* Triangle fan clipped verticies */
+    for (int j = 1; j < nclipped - 1; ++j) {
+        vec2 fan[3] = { clipped[0], clipped[j], clipped[j + 1] };
+
+        float min_x = SDL_min(fan[0].x, SDL_min(fan[1].x, fan[2].x));
+        float max_x = SDL_max(fan[0].x, SDL_max(fan[1].x, fan[2].x));
+        float min_y = SDL_min(fan[0].y, SDL_min(fan[1].y, fan[2].y));
+        float max_y = SDL_max(fan[0].y, SDL_max(fan[1].y, fan[2].y));
+
+        bool verts_cw = vec2_dot(vec2_orthogonal(vec2_sub(fan[1], fan[0])), vec2_sub(fan[2], fan[0])) > 0;
+
+        int setup = (min_x > canvas->width || max_x < 0 || min_y > canvas->height || max_y < 0 ? SETUP_OFFSCREEN : 0)
+                  | (min_x > canvas->width || max_x < 0 || min_y > draw->bounds[1] || max_y < draw->bounds[0] ? SETUP_OUTSIDE : 0)
+                  | (verts_cw ? SETUP_CW : 0);
+
+        if (SetupSurvives(draw, setup))
+            DrawFace(draw, face, vs_verts, fan, verts_cw);
+    }
+}
+
+/*
+ * Classifies a run of faces SD_LENGTH at a time. Each batch gathers its vertices into lanes, one triangle to each, and
+ * tests them all at once against the near plane, the canvas and the rows drawn, and by winding. Only classification is
+ * batched: survivors go lane by lane, in face order, through the scalar setup of DrawFace, and faces crossing the near
+ * plane are clipped one at a time
+ */
+static void DrawFaces(PlacementDraw *draw, M7_MeshFace *faces, size_t first, size_t nfaces) {
+    M7_Canvas *canvas = draw->canvas;
+    sd_float near = sd_float_set(draw->rasterizer->near);
+    sd_float zero = sd_float_zero();
+    sd_float width = sd_float_set(canvas->width);
+    sd_float height = sd_float_set(canvas->height);
+    sd_float row_min = sd_float_set(draw->bounds[0]);
+    sd_float row_max = sd_float_set(draw->bounds[1]);
+
+    for (size_t base = first; base < first + nfaces; base += SD_LENGTH) {
+        size_t nlanes = SDL_min(first + nfaces - base, SD_LENGTH);
+        sd_int idx[3];
+
+        /* Idle lanes repeat the batch's first face */
+        for (size_t lane = 0; lane < SD_LENGTH; ++lane)
+            for (int j = 0; j < 3; ++j)
+                idx[j].elems[lane] = faces[base + (lane < nlanes ? lane : 0)].idx_verts[j];
+
+        sd_mask clipped = sd_mask_set(false);
+        sd_vec3 vs[3];
+        sd_vec2 ss[3];
+
+        for (int j = 0; j < 3; ++j) {
+            vs[j] = sd_vec3_gather_strided(draw->vs_block, idx[j]);
+            ss[j] = sd_vec2_gather_strided(draw->ss_block, idx[j]);
+            clipped = sd_mask_or(clipped, sd_float_lt(vs[j].z, near));
+        }
+
+        sd_float min_x = sd_float_min(ss[0].x, sd_float_min(ss[1].x, ss[2].x));
+        sd_float max_x = sd_float_max(ss[0].x, sd_float_max(ss[1].x, ss[2].x));
+        sd_float min_y = sd_float_min(ss[0].y, sd_float_min(ss[1].y, ss[2].y));
+        sd_float max_y = sd_float_max(ss[0].y, sd_float_max(ss[1].y, ss[2].y));
+
+        sd_mask outside_x = sd_mask_or(sd_float_gt(min_x, width), sd_float_lt(max_x, zero));
+        sd_mask offscreen = sd_mask_or(outside_x, sd_mask_or(sd_float_gt(min_y, height), sd_float_lt(max_y, zero)));
+        sd_mask outside = sd_mask_or(outside_x, sd_mask_or(sd_float_gt(min_y, row_max), sd_float_lt(max_y, row_min)));
+
+        sd_vec2 edges[2] = { sd_vec2_sub(ss[1], ss[0]), sd_vec2_sub(ss[2], ss[0]) };
+        sd_float winding = sd_float_sub(sd_float_mul(edges[0].x, edges[1].y), sd_float_mul(edges[0].y, edges[1].x));
+
+        sd_int setup = sd_int_set(0);
+        setup = sd_int_or(setup, sd_int_mask_blend(sd_int_set(0), sd_int_set(SETUP_CLIPPED), clipped));
+        setup = sd_int_or(setup, sd_int_mask_blend(sd_int_set(0), sd_int_set(SETUP_OFFSCREEN), offscreen));
+        setup = sd_int_or(setup, sd_int_mask_blend(sd_int_set(0), sd_int_set(SETUP_OUTSIDE), outside));
+        setup = sd_int_or(setup, sd_int_mask_blend(sd_int_set(0), sd_int_set(SETUP_CW), sd_float_gt(winding, zero)));
+
+        /* Draw the survivors one lane at a time, in face order */
+        for (size_t lane = 0; lane < nlanes; ++lane) {
+            M7_MeshFace *face = faces + base + lane;
+
+            if (setup.elems[lane] & SETUP_CLIPPED) {
+                DrawClippedFace(draw, face);
+                continue;
+            }
+
+            if (!SetupSurvives(draw, setup.elems[lane]))
+                continue;
+
+            /* Survivors draw from the gathered lanes rather than fetching their vertices again */
+            vec3 vs_verts[3];
+            vec2 ss_verts[3];
+
+            for (int j = 0; j < 3; ++j) {
+                vs_verts[j] = (vec3) {{ vs[j].x.elems[lane], vs[j].y.elems[lane], vs[j].z.elems[lane] }};
+                ss_verts[j] = (vec2) {{ ss[j].x.elems[lane], ss[j].y.elems[lane] }};
+            }
+
+            DrawFace(draw, face, vs_verts, ss_verts, setup.elems[lane] & SETUP_CW);
+        }
+    }
+}
+
+/* Geometry counters are only kept by the primary sub-canvas, which classifies triangles against the whole canvas */
+static void M7_Rasterizer_DrawBatch(ECS_Handle *self, List(M7_RenderInstance *) *batch, M7_RasterizerFlags flags, M7_RasterizerCounters *counters, M7_FragmentSpan *span, bool primary, int (*scanlines)[2], int bounds[2]) {
+    M7_PROFILE_SCOPE(M7_PROFILE_DRAW_BATCH);
     M7_Rasterizer *rasterizer = ECS_Entity_GetComponent(self, M7_Components.Rasterizer);
     M7_Canvas *canvas = ECS_Entity_GetComponent(rasterizer->target, M7_Components.Canvas);
+    bool count = counters && primary;
+
+    if (count)
+        counters->instances += List_Length(batch);
+
+    /* Meshlets are culled against the rows this call draws, or against the whole canvas if it counts culled triangles */
+    M7_PerspectiveFOV *perspective_fov = ECS_Entity_GetComponent(self, M7_Components.PerspectiveFOV);
+    vec2 midpoint = {{ canvas->width * 0.5f, canvas->height * 0.5f }};
+    int rows[2] = { count ? 0 : bounds[0], count ? canvas->height : bounds[1] };
 
     /* Draw triangles */
     List_ForEach(batch, instance, {
-        M7_MeshFace *faces = instance->geometry->mesh->faces;
-        size_t nfaces = instance->geometry->mesh->nfaces;
+        M7_WorldGeometry *wg = instance->geometry;
+        M7_MeshFace *faces = wg->mesh->faces;
+        size_t nfaces = wg->mesh->nfaces;
+        size_t sd_count = sd_bounding_size(wg->mesh->nverts);
+        size_t nplacements = List_Length(wg->placements);
 
-        for (size_t i = 0; i < nfaces; ++i) {
-            vec3 vs_verts[3];
+        /* Every placement draws the instance from its own block of transformed vertices */
+        for (size_t p = 0; p < nplacements; ++p) {
+            M7_Placement *placement = List_Get(wg->placements, p);
 
-            SDL_memcpy(vs_verts, &(sd_vec3_scalar [3]) {
-                sd_vec3_arr_get(instance->geometry->vs_verts, faces[i].idx_verts[0]),
-                sd_vec3_arr_get(instance->geometry->vs_verts, faces[i].idx_verts[1]),
-                sd_vec3_arr_get(instance->geometry->vs_verts, faces[i].idx_verts[2])
-            }, sizeof(vec3 [3]));
+            if (placement->culled)
+                continue;
 
-            /* Perform near plane clipping */
-            vec2 ss_verts[3];
-            vec2 clipped[4];
-            int nclipped = 0;
+            /* Submitted triangles count over the same placements as cache misses, which culled ones skip */
+            if (count) {
+                counters->placements_drawn += 1;
+                counters->triangles_submitted += nfaces;
+            }
 
-            SDL_memcpy(ss_verts, (sd_vec2_scalar [3]) {
-                sd_vec2_arr_get(instance->geometry->ss_verts, faces[i].idx_verts[0]),
-                sd_vec2_arr_get(instance->geometry->ss_verts, faces[i].idx_verts[1]),
-                sd_vec2_arr_get(instance->geometry->ss_verts, faces[i].idx_verts[2]),
-            }, sizeof(vec2 [3]));
+            mat3x3 basis = placement->xform.basis;
+            float scale = vec3_length(basis.x);
+            float max_scale = SDL_max(scale, SDL_max(vec3_length(basis.y), vec3_length(basis.z)));
+            bool cone_cull = flags & M7_RASTERIZER_CULL_BACKFACE && IsSimilarity(basis, scale);
+
+            PlacementDraw draw = {
+                .self = self,
+                .rasterizer = rasterizer,
+                .canvas = canvas,
+                .instance = instance,
+                .flags = flags,
+                .counters = counters,
+                .span = span,
+                .scanlines = scanlines,
+                .bounds = bounds,
+                .count = count,
+                .sd_count = sd_count,
+                .vs_block = wg->vs_verts + sd_count * p,
+                .nrml_block = wg->vs_nrmls ? wg->vs_nrmls + sd_count * p : nullptr,
+                .ss_block = wg->ss_verts + sd_count * p,
+                .attrs_block = instance->vertex_attrs ? instance->vertex_attrs + sd_count * M7_VERTEX_ATTRIBUTES * p : nullptr
+            };
 
-            for (int j = 0; j < 3; ++j) {
-                vec3 curr = vs_verts[j];
-                vec3 next = vs_verts[(j + 1) % 3];
+            size_t cache[M7_VERTEX_CACHE_SIZE];
+            size_t cache_head = 0;
 
-                if (curr.z >= rasterizer->near)
-                    clipped[nclipped++] = ss_verts[j];
+            for (int j = 0; j < M7_VERTEX_CACHE_SIZE; ++j)
+                cache[j] = SIZE_MAX;
 
-                if ((curr.z < rasterizer->near) != (next.z < rasterizer->near)) {
-                    vec3 intercept = intersect_near(curr, next, rasterizer->near);
+            for (size_t m = 0; m < wg->mesh->nmeshlets; ++m) {
+                M7_Meshlet *meshlet = wg->mesh->meshlets + m;
+                vec3 center = xform3_apply(placement->xform, meshlet->center);
+                float radius = meshlet->radius * max_scale;
 
-                    sd_vec2 projected = rasterizer->project(self,
-                        sd_vec3_set(intercept.x, intercept.y, rasterizer->near),
-                        sd_vec2_set(canvas->width * 0.5f, canvas->height * 0.5f)
-                    );
+                if (count)
+                    for (size_t i = meshlet->first_face; i < meshlet->first_face + meshlet->nfaces; ++i)
+                        counters->vertex_cache_misses += FetchVertices(cache, &cache_head, faces[i].idx_verts);
 
-                    sd_vec2_scalar projected_scalar = sd_vec2_arr_get(&projected, 0);
-                    SDL_memcpy(clipped + nclipped++, &projected_scalar, sizeof(vec2));
+                if (M7_SphereOutside(rasterizer, perspective_fov, midpoint, rows, center, radius)) {
+                    if (count) counters->meshlets_frustum_culled += 1;
+                    continue;
                 }
-            }
 
-            /* Triangle fan clipped verticies */
-            for (int j = 1; j < nclipped - 1; ++j) {
-                /* Compute extremes */
-                float min_x = SDL_min(clipped[0].x, SDL_min(clipped[j].x, clipped[j + 1].x));
-                float max_x = SDL_max(clipped[0].x, SDL_max(clipped[j].x, clipped[j + 1].x));
-                float min_y = SDL_min(clipped[0].y, SDL_min(clipped[j].y, clipped[j + 1].y));
-                float max_y = SDL_max(clipped[0].y, SDL_max(clipped[j].y, clipped[j + 1].y));
-
-                /* Cull off-screen triangles */
-                if (min_x > canvas->width || max_x < 0 ||
-                    min_y > bounds[1] || max_y < bounds[0] 
-                ) continue;
-
-                bool verts_cw = vec2_dot(
-                    vec2_orthogonal(vec2_sub(clipped[j], clipped[0])),
-                    vec2_sub(clipped[j + 1], clipped[0])
-                ) > 0;
-
-                if (flags & M7_RASTERIZER_CULL_BACKFACE && !verts_cw)
-                    continue;;
-
-                M7_TriangleDraw triangle = {
-                    .shader_pipeline = instance->shader_pipeline,
-                    .shader_states = instance->shader_states,
-                    .nshaders = instance->nshaders
-                };
-
-                SDL_memcpy(triangle.vs_verts, (vec3 [3]) { vs_verts[0], vs_verts[1 + !verts_cw], vs_verts[1 + verts_cw] }, sizeof(vec3 [3]));
-                SDL_memcpy(triangle.ss_verts, (vec2 [3]) { clipped[0], clipped[j + !verts_cw], clipped[j + verts_cw] }, sizeof(vec2 [3]));
-
-                if (instance->geometry->vs_nrmls)
-                    SDL_memcpy(triangle.vs_nrmls, (sd_vec3_scalar [3]) {
-                        sd_vec3_arr_get(instance->geometry->vs_nrmls, faces[i].idx_verts[0]),
-                        sd_vec3_arr_get(instance->geometry->vs_nrmls, faces[i].idx_verts[1 + !verts_cw]),
-                        sd_vec3_arr_get(instance->geometry->vs_nrmls, faces[i].idx_verts[1 + verts_cw])
-                    }, sizeof(vec3 [3]));
-
-                if (instance->geometry->mesh->ts_verts)
-                    SDL_memcpy(triangle.ts_verts, (vec2 [3]) {
-                        instance->geometry->mesh->ts_verts[faces[i].idx_tverts[0]],
-                        instance->geometry->mesh->ts_verts[faces[i].idx_tverts[1 + !verts_cw]],
-                        instance->geometry->mesh->ts_verts[faces[i].idx_tverts[1 + verts_cw]]
-                    }, sizeof(vec2 [3]));
-
-                M7_Rasterizer_DrawTriangle(self, triangle, flags, scanlines, bounds);
+                if (cone_cull && ConeBackfacing(center, radius, vec3_div(mat3x3_mulv(basis, meshlet->cone_axis), scale), meshlet->cone_cos)) {
+                    if (count) counters->meshlets_backface_culled += 1;
+                    continue;
+                }
+
+                DrawFaces(&draw, faces, meshlet->first_face, meshlet->nfaces);
             }
         }
     });
 }
 
+static void AddCounters(M7_RasterizerCounters *dst, M7_RasterizerCounters *src) {
+    size_t *dst_counts = (size_t *)dst, *src_counts = (size_t *)src;
+
+    for (size_t i = 0; i < sizeof(M7_RasterizerCounters) / sizeof(size_t); ++i)
+        dst_counts[i] += src_counts[i];
+}
+
+/* Shades the sky behind pixels without depth, casting view rays straight from the camera basis */
+static void M7_Rasterizer_DrawBackground(ECS_Handle *self, M7_Texture *sky, int bounds[2]) {
+    M7_PROFILE_SCOPE(M7_PROFILE_BACKGROUND);
+    M7_Rasterizer *rasterizer = ECS_Entity_GetComponent(self, M7_Components.Rasterizer);
+    M7_Canvas *canvas = ECS_Entity_GetComponent(rasterizer->target, M7_Components.Canvas);
+    M7_PerspectiveFOV *perspective_fov = ECS_Entity_GetComponent(self, M7_Components.PerspectiveFOV);
+    mat3x3 basis = M7_Entity_GetXform(self).basis;
+    size_t sd_width = sd_bounding_size(canvas->width);
+
+    sd_vec3 sd_basis[3] = {
+        sd_vec3_set(basis.x.x, basis.x.y, basis.x.z),
+        sd_vec3_set(basis.y.x, basis.y.y, basis.y.z),
+        sd_vec3_set(basis.z.x, basis.z.y, basis.z.z)
+    };
+
+    sd_vec2 midpoint = {
+        .x = sd_float_set(canvas->width * 0.5f),
+        .y = sd_float_set(canvas->height * 0.5f)
+    };
+
+    /* Parallel projections look straight ahead everywhere */
+    sd_float normalize_ss = perspective_fov
+        ? sd_float_mul(sd_float_set(perspective_fov->tan_half_fov), sd_float_rcp(midpoint.x))
+        : sd_float_zero();
+
+    for (int i = bounds[0]; i < bounds[1]; ++i) {
+        sd_float proj_y = sd_float_mul(sd_float_sub(midpoint.y, sd_float_set(i + 0.5f)), normalize_ss);
+        sd_vec3 row_dir = sd_vec3_fmadd(sd_basis[1], proj_y, sd_basis[2]);
+        size_t base = i * sd_width;
+
+        for (size_t j = 0; j < sd_width; ++j) {
+            sd_mask written = sd_float_gt(canvas->depth[base + j], sd_float_zero());
+
+            if (sd_mask_count(written) == SD_LENGTH)
+                continue;
+
+            sd_float fragment_x = sd_float_add(sd_float_range(), sd_float_set(0.5f));
+                     fragment_x = sd_float_add(fragment_x, sd_float_set(j * SD_LENGTH));
+
+            sd_float proj_x = sd_float_mul(sd_float_sub(fragment_x, midpoint.x), normalize_ss);
+            sd_vec3 dir = sd_vec3_normalize(sd_vec3_fmadd(sd_basis[0], proj_x, row_dir));
+
+            canvas->color[base + j] = sd_vec3_mask_blend(M7_SampleCubemap(sky, dir).rgb, canvas->color[base + j], written);
+        }
+    }
+}
+
 static int RenderToSubCanvas(void *data) {
+    M7_PROFILE_SCOPE(M7_PROFILE_RASTERIZE);
     SubCanvasRenderData *render = data;
     M7_Rasterizer *rasterizer = ECS_Entity_GetComponent(render->rasterizer, M7_Components.Rasterizer);
     M7_World *world = ECS_Entity_GetComponent(rasterizer->world, M7_Components.World);
     M7_Canvas *canvas = ECS_Entity_GetComponent(rasterizer->target, M7_Components.Canvas);
     size_t sd_width = sd_bounding_size(canvas->width);
+    M7_FragmentSpan span = CreateFragmentSpan(sd_width);
 
     /* Reset depth */
     for (size_t i = sd_width * render->bounds[0]; i < sd_width * render->bounds[1]; ++i)
         canvas->depth[i] = sd_float_zero();
 
+    /*
+     * The sky fills pixels left without depth. It's drawn once the batches before have all been opaque and written
+     * depth, so batches blending or leaving depth unwritten draw over the sky rather than being overwritten by it
+     */
+    bool sky_pending = render->sky != nullptr;
+
     /* Draw geometry in batches, according to render order and rasterizer flags */
     for (size_t i = 0; i < List_Length(world->render_batches); ++i) {
         for (int flags = 0; flags < M7_RASTERIZER_FLAG_COMBINATIONS; ++flags) {
             List(M7_RenderInstance *) *flag_batch = List_Get(world->render_batches, i)[flags];
 
-            if (flag_batch)
-                M7_Rasterizer_DrawBatch(render->rasterizer, flag_batch, flags, render->scanlines, render->bounds);
+            M7_RasterizerCounters *counters = render->counters ? render->counters[i] + flags : nullptr;
+
+            if (!flag_batch)
+                continue;
+
+            if (sky_pending && (flags & M7_RASTERIZER_ALPHA_BLEND || !(flags & M7_RASTERIZER_WRITE_DEPTH))) {
+                M7_Rasterizer_DrawBackground(render->rasterizer, render->sky, render->bounds);
+                sky_pending = false;
+            }
+
+            M7_Rasterizer_DrawBatch(render->rasterizer, flag_batch, flags, counters, &span, render->primary, render->scanlines, render->bounds);
         }
     }
 
+    if (sky_pending)
+        M7_Rasterizer_DrawBackground(render->rasterizer, render->sky, render->bounds);
+
+    SDL_aligned_free(span.col);
+
     return 0;
 }
 
+/* Transforms and projects the vertex blocks of a geometry's placements that aren't culled, then runs its vertex shaders */
+static void TransformGeometry(ECS_Handle *self, M7_WorldGeometry *wg, sd_vec2 midpoint) {
+    M7_Rasterizer *rasterizer = ECS_Entity_GetComponent(self, M7_Components.Rasterizer);
+    size_t sd_count = sd_bounding_size(wg->mesh->nverts);
+    size_t nplacements = List_Length(wg->placements);
+
+    /* Vertex buffers hold a block per placement */
+    if (wg->capacity < nplacements) {
+        size_t nblocks = SDL_max(sd_count * nplacements, 1);
+        SDL_aligned_free(wg->vs_verts);
+        SDL_aligned_free(wg->vs_nrmls);
+        SDL_aligned_free(wg->ss_verts);
+        wg->vs_verts = SDL_aligned_alloc(SD_ALIGN, sizeof(sd_vec3) * nblocks);
+        wg->vs_nrmls = wg->mesh->ws_nrmls ? SDL_aligned_alloc(SD_ALIGN, sizeof(sd_vec3) * nblocks) : nullptr;
+        wg->ss_verts = SDL_aligned_alloc(SD_ALIGN, sizeof(sd_vec2) * nblocks);
+        wg->capacity = nplacements;
+
+        List_ForEach(wg->placements, placement, {
+            placement->transformed_version = 0;
+            placement->projected_by = nullptr;
+        });
+    }
+
+    for (size_t p = 0; p < nplacements; ++p) {
+        M7_Placement *placement = List_Get(wg->placements, p);
+
+        if (placement->culled)
+            continue;
+
+        sd_vec3 *vs_block = wg->vs_verts + sd_count * p;
+        sd_vec3 *nrml_block = wg->vs_nrmls ? wg->vs_nrmls + sd_count * p : nullptr;
+        sd_vec2 *ss_block = wg->ss_verts + sd_count * p;
+
+        bool moved = placement->transformed_version != placement->version;
+        bool reprojected = placement->projected_by != rasterizer || placement->projected_version != rasterizer->projection_version;
+
+        placement->transformed_version = placement->version;
+        placement->projected_by = rasterizer;
+        placement->projected_version = rasterizer->projection_version;
+
+        /* Blocks of placements that kept their view space xform only need projecting again, if even that */
+        if (!moved) {
+            if (reprojected)
+                for (size_t i = 0; i < sd_count; ++i)
+                    ss_block[i] = rasterizer->project(self, vs_block[i], midpoint);
+
+            continue;
+        }
+
+        if (rasterizer->stats)
+            rasterizer->stats->total.verts_transformed += wg->mesh->nverts;
+
+        sd_vec3 translation = sd_vec3_set(
+            placement->xform.translation.x,
+            placement->xform.translation.y,
+            placement->xform.translation.z
+        );
+
+        sd_vec3 sd_xform[3] = {
+            sd_vec3_set(placement->xform.basis.x.x, placement->xform.basis.x.y, placement->xform.basis.x.z),
+            sd_vec3_set(placement->xform.basis.y.x, placement->xform.basis.y.y, placement->xform.basis.y.z),
+            sd_vec3_set(placement->xform.basis.z.x, placement->xform.basis.z.y, placement->xform.basis.z.z)
+        };
+
+        for (size_t i = 0; i < sd_count; ++i) {
+            vs_block[i] = sd_vec3_fmadd(sd_xform[0], wg->mesh->ws_verts[i].x, translation);
+            vs_block[i] = sd_vec3_fmadd(sd_xform[1], wg->mesh->ws_verts[i].y, vs_block[i]);
+            vs_block[i] = sd_vec3_fmadd(sd_xform[2], wg->mesh->ws_verts[i].z, vs_block[i]);
+
+            if (nrml_block) {
+                nrml_block[i] = sd_vec3_muls(sd_xform[0], wg->mesh->ws_nrmls[i].x);
+                nrml_block[i] = sd_vec3_fmadd(sd_xform[1], wg->mesh->ws_nrmls[i].y, nrml_block[i]);
+                nrml_block[i] = sd_vec3_fmadd(sd_xform[2], wg->mesh->ws_nrmls[i].z, nrml_block[i]);
+            }
+
+            ss_block[i] = rasterizer->project(self, vs_block[i], midpoint);
+        }
+    }
+
+    /* Run vertex shaders in pipeline order over each instance's own attributes, at every visible placement */
+    List_ForEach(wg->instances, instance, {
+        if (!instance->vertex_stage)
+            continue;
+
+        if (instance->attrs_capacity < nplacements) {
+            SDL_aligned_free(instance->vertex_attrs);
+            instance->vertex_attrs = SDL_aligned_alloc(SD_ALIGN, sizeof(sd_vec4) * M7_VERTEX_ATTRIBUTES * SDL_max(sd_count * nplacements, 1));
+            instance->attrs_capacity = nplacements;
+        }
+
+        for (size_t p = 0; p < nplacements; ++p) {
+            if (List_Get(wg->placements, p)->culled)
+                continue;
+
+            sd_vec4 *attrs_block = instance->vertex_attrs + sd_count * M7_VERTEX_ATTRIBUTES * p;
+
+            M7_VertexSpan vertex_span = {
+                .vs = wg->vs_verts + sd_count * p,
+                .nrml = wg->vs_nrmls ? wg->vs_nrmls + sd_count * p : nullptr,
+                .length = sd_count
+            };
+
+            for (int i = 0; i < M7_VERTEX_ATTRIBUTES; ++i)
+                vertex_span.attrs[i] = attrs_block + sd_count * i;
+
+            for (size_t i = 0; i < instance->nshaders; ++i)
+                if (instance->vertex_shaders[i])
+                    instance->vertex_shaders[i](instance->shader_states[i], &vertex_span);
+        }
+    });
+}
+
+/* The projector state of the rasterizer's entity that the built in projectors read */
+static M7_Projection CurrentProjection(ECS_Handle *self, M7_Rasterizer *rasterizer, M7_Canvas *canvas) {
+    M7_PerspectiveFOV *perspective_fov = ECS_Entity_GetComponent(self, M7_Components.PerspectiveFOV);
+    M7_ParallelProjector *parallel = ECS_Entity_GetComponent(self, M7_Components.ParallelProjector);
+
+    return (M7_Projection) {
+        .project = rasterizer->project,
+        .perspective_fov = perspective_fov ? *perspective_fov : (M7_PerspectiveFOV) {},
+        .parallel = parallel ? *parallel : (M7_ParallelProjector) {},
+        .width = canvas->width,
+        .height = canvas->height
+    };
+}
+
 void SD_VARIANT(M7_Rasterizer_Render)(ECS_Handle *self) {
     M7_Rasterizer *rasterizer = ECS_Entity_GetComponent(self, M7_Components.Rasterizer);
     M7_World *world = ECS_Entity_GetComponent(rasterizer->world, M7_Components.World);
@@ -432,42 +975,80 @@ void SD_VARIANT(M7_Rasterizer_Render)(ECS_Handle *self) {
         vec3_mul(mat3x3_mul(mat3x3_xpose(cam_xform.basis), cam_xform.translation), -1)
     };
 
-    M7_Entity_Xform(rasterizer->world, ws2vs_xform);
+    ECS_Handle *env = ECS_Entity_DescendantWithComponent(rasterizer->world, M7_Components.LightEnvironment, true);
 
-    List_ForEach(geometry, wg, {
-        size_t sd_count = sd_bounding_size(wg->mesh->nverts);
+    M7_LightEnvironment *environment = env ? *ECS_Entity_GetComponent(env, M7_Components.LightEnvironment) : nullptr;
 
-        sd_vec3 translation = sd_vec3_set(
-            wg->xform.translation.x,
-            wg->xform.translation.y,
-            wg->xform.translation.z
-        );
+    {
+        M7_PROFILE_SCOPE(M7_PROFILE_XFORM);
+        M7_World_Xform(rasterizer->world);
+        M7_World_ViewXform(rasterizer->world, environment, ws2vs_xform, cam_xform);
+        M7_WorldBVH_Update(world);
+    }
 
-        sd_vec3 sd_xform[3] = {
-            sd_vec3_set(wg->xform.basis.x.x, wg->xform.basis.x.y, wg->xform.basis.x.z),
-            sd_vec3_set(wg->xform.basis.y.x, wg->xform.basis.y.y, wg->xform.basis.y.z),
-            sd_vec3_set(wg->xform.basis.z.x, wg->xform.basis.z.y, wg->xform.basis.z.z)
-        };
+    /* Bin view space lights into canvas tiles */
 
-        for (size_t i = 0; i < sd_count; ++i) {
-            wg->vs_verts[i] = sd_vec3_fmadd(sd_xform[0], wg->mesh->ws_verts[i].x, translation);
-            wg->vs_verts[i] = sd_vec3_fmadd(sd_xform[1], wg->mesh->ws_verts[i].y, wg->vs_verts[i]);
-            wg->vs_verts[i] = sd_vec3_fmadd(sd_xform[2], wg->mesh->ws_verts[i].z, wg->vs_verts[i]);
-
-            if (wg->vs_nrmls) {
-                wg->vs_nrmls[i] = sd_vec3_muls(sd_xform[0], wg->mesh->ws_nrmls[i].x);
-                wg->vs_nrmls[i] = sd_vec3_fmadd(sd_xform[1], wg->mesh->ws_nrmls[i].y, wg->vs_nrmls[i]);
-                wg->vs_nrmls[i] = sd_vec3_fmadd(sd_xform[2], wg->mesh->ws_nrmls[i].z, wg->vs_nrmls[i]);
-            }
+    if (environment)
+        SD_VARIANT(M7_LightEnvironment_Cull)(environment, self);
 
-            wg->ss_verts[i] = rasterizer->project(self, wg->vs_verts[i], sd_vec2_set(canvas->width * 0.5f, canvas->height * 0.5f));
-        }
+    /* Re-render the shadow maps invalidated by movement */
+    if (environment) {
+        M7_PROFILE_SCOPE(M7_PROFILE_SHADOW);
+        SD_VARIANT(M7_LightEnvironment_Shadow)(environment, world);
+    }
+
+    /* Build shader uniform blocks */
+    M7_ShaderFrame shader_frame = { .vs2ws_xform = cam_xform };
+
+    List_ForEach(geometry, wg, {
+        List_ForEach(wg->instances, instance, {
+            for (size_t i = 0; i < instance->nshaders; ++i)
+                if (instance->shader_preparers[i])
+                    instance->shader_states[i] = instance->shader_preparers[i](instance->shader_sources[i], instance->shader_states[i], &shader_frame);
+        });
     });
 
+    if (rasterizer->stats)
+        rasterizer->stats->total = (M7_RasterizerCounters) {};
+
+    M7_Projection projection = CurrentProjection(self, rasterizer, canvas);
+
+    if (SDL_memcmp(&projection, &rasterizer->projection, sizeof(M7_Projection))) {
+        rasterizer->projection = projection;
+        rasterizer->projection_version += 1;
+    }
+
+    sd_vec2 midpoint = sd_vec2_set(canvas->width * 0.5f, canvas->height * 0.5f);
+
+    /* Occluders go first, to fill the occlusion buffer that, with the view frustum, decides which other placements are transformed */
+    {
+        M7_PROFILE_SCOPE(M7_PROFILE_VERTEX);
+
+        List_ForEach(geometry, wg, {
+            if (wg->occluder)
+                TransformGeometry(self, wg, midpoint);
+        });
+    }
+
+    {
+        M7_PROFILE_SCOPE(M7_PROFILE_OCCLUSION);
+        SD_VARIANT(M7_Rasterizer_Cull)(self, world, ws2vs_xform);
+    }
+
+    {
+        M7_PROFILE_SCOPE(M7_PROFILE_VERTEX);
+
+        List_ForEach(geometry, wg, {
+            if (!wg->occluder)
+                TransformGeometry(self, wg, midpoint);
+        });
+    }
+
     /* Render to sub-canvases in parallel */
     SDL_Thread **threads = SDL_malloc(sizeof(SDL_Thread *) * rasterizer->parallelism);
     SubCanvasRenderData *render_data = SDL_malloc(sizeof(SubCanvasRenderData) * rasterizer->parallelism);
     int (*scanlines)[2] = SDL_malloc(sizeof(int [2]) * canvas->height);
+    size_t nbatches = List_Length(world->render_batches);
 
     int qot = canvas->height / rasterizer->parallelism;
     int rem = canvas->height % rasterizer->parallelism;
@@ -475,11 +1056,14 @@ void SD_VARIANT(M7_Rasterizer_Render)(ECS_Handle *self) {
     for (int i = 0; i < rasterizer->parallelism; ++i) {
         render_data[i] = (SubCanvasRenderData) {
             .rasterizer = self,
+            .counters = rasterizer->stats ? SDL_calloc(nbatches, sizeof(M7_RasterizerCounters [M7_RASTERIZER_FLAG_COMBINATIONS])) : nullptr,
             .bounds = {
                 i * qot + SDL_min(i, rem),
                 (i + 1) * qot + SDL_min(i + 1, rem)
             },
-            .scanlines = scanlines
+            .scanlines = scanlines,
+            .sky = environment && rasterizer->sky_background ? environment->sky : nullptr,
+            .primary = !i
         };
 
         threads[i] = SDL_CreateThread(RenderToSubCanvas, "rendersc", render_data + i);
@@ -488,6 +1072,24 @@ void SD_VARIANT(M7_Rasterizer_Render)(ECS_Handle *self) {
     for (int i = 0; i < rasterizer->parallelism; ++i)
         SDL_WaitThread(threads[i], nullptr);
 
+    /* Sum per-thread counters */
+    if (rasterizer->stats) {
+        M7_RasterizerStats *stats = rasterizer->stats;
+        List_Clear(stats->batches);
+        SDL_memset(List_PushSpace(stats->batches, nbatches), 0, sizeof(*stats->batches) * nbatches);
+
+        for (int i = 0; i < rasterizer->parallelism; ++i) {
+            for (size_t j = 0; j < nbatches; ++j) {
+                for (int flags = 0; flags < M7_RASTERIZER_FLAG_COMBINATIONS; ++flags) {
+                    AddCounters(List_Get(stats->batches, j) + flags, render_data[i].counters[j] + flags);
+                    AddCounters(&stats->total, render_data[i].counters[j] + flags);
+                }
+            }
+
+            SDL_free(render_data[i].counters);
+        }
+    }
+
     SDL_free(scanlines);
     SDL_free(render_data);
     SDL_free(threads);
@@ -495,6 +1097,31 @@ void SD_VARIANT(M7_Rasterizer_Render)(ECS_Handle *self) {
 
 #ifndef SD_SRC_VARIANT
 
+/* Whether a view space sphere lies beyond the near plane, or outside the given rows of a perspective frustum */
+bool M7_SphereOutside(M7_Rasterizer *rasterizer, M7_PerspectiveFOV *perspective_fov, vec2 midpoint, int rows[2], vec3 center, float radius) {
+    if (center.z + radius < rasterizer->near)
+        return true;
+
+    if (!perspective_fov)
+        return false;
+
+    /* Side planes pass through the camera, with slopes in x and y over z */
+    float slopes[4] = {
+        perspective_fov->tan_half_fov,
+        perspective_fov->tan_half_fov,
+        (midpoint.y - rows[0]) * perspective_fov->tan_half_fov / midpoint.x,
+        (rows[1] - midpoint.y) * perspective_fov->tan_half_fov / midpoint.x
+    };
+
+    float offsets[4] = { center.x, -center.x, center.y, -center.y };
+
+    for (int i = 0; i < 4; ++i)
+        if (offsets[i] - slopes[i] * center.z > radius * SDL_sqrtf(1 + slopes[i] * slopes[i]))
+            return true;
+
+    return false;
+}
+
 void M7_Rasterizer_Attach(ECS_Handle *self, ECS_Component(void) *component) {
     M7_Rasterizer *rasterizer = ECS_Entity_GetComponent(self, component);
     rasterizer->world = ECS_Entity_AncestorWithComponent(self, M7_Components.World, true);
@@ -509,8 +1136,32 @@ void M7_Rasterizer_Init(void *component, void *args) {
         .project = rasterizer_args->project,
         .scan = rasterizer_args->scan,
         .near = rasterizer_args->near,
-        .parallelism = rasterizer_args->parallelism
+        .parallelism = rasterizer_args->parallelism,
+        .sky_background = rasterizer_args->sky_background
     };
+
+    if (rasterizer_args->collect_stats) {
+        rasterizer->stats = SDL_malloc(sizeof(M7_RasterizerStats));
+
+        *rasterizer->stats = (M7_RasterizerStats) {
+            .batches = List_Create(M7_RasterizerCounters [M7_RASTERIZER_FLAG_COMBINATIONS])
+        };
+    }
+}
+
+void M7_Rasterizer_Free(void *component) {
+    M7_Rasterizer *rasterizer = component;
+
+    if (rasterizer->stats) {
+        List_Free(rasterizer->stats->batches);
+        SDL_free(rasterizer->stats);
+    }
+
+    SDL_aligned_free(rasterizer->occlusion);
+}
+
+M7_RasterizerStats *M7_Rasterizer_GetStats(ECS_Handle *self) {
+    return ECS_Entity_GetComponent(self, M7_Components.Rasterizer)->stats;
 }
 
 void M7_PerspectiveFOV_Set(ECS_Handle *self, float fov) {
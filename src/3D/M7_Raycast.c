@@ -0,0 +1,401 @@
+#include <float.h>
+#include <SDL3/SDL.h>
+#include <M7/ECS.h>
+#include <M7/M7_ECS.h>
+#include <M7/Collections/List.h>
+#include <M7/Math/linalg.h>
+#include <M7/Math/stride.h>
+
+#include "M7_3D_c.h"
+
+#define MESH_BVH_MAX_DEPTH  64 /* Depth past which face ranges are halved rather than SAH split, bounding the tree */
+#define RAY_STACK_SIZE      ((MESH_BVH_MAX_DEPTH + 32) * M7_MESH_BVH_WIDTH)
+#define UNUSED_LANE         UINT32_MAX
+#define MIN_DIRECTION       1e-12f /* Smallest direction component divided by, keeping slab distances finite */
+
+typedef struct BinaryNode {
+    vec3 min, max;
+    size_t left, right; /* SIZE_MAX for leaves */
+    size_t begin, end; /* Primitives under the node */
+} BinaryNode;
+
+static float HalfArea(vec3 min, vec3 max) {
+    vec3 extent = vec3_sub(max, min);
+    return extent.x * extent.y + extent.y * extent.z + extent.z * extent.x;
+}
+
+/* Reciprocal of a ray direction, with components too small to divide by pushed out to MIN_DIRECTION */
+static vec3 RcpDirection(vec3 direction) {
+    vec3 rcp;
+
+    for (int i = 0; i < 3; ++i) {
+        float component = direction.entries[i];
+        rcp.entries[i] = 1 / (SDL_fabsf(component) > MIN_DIRECTION ? component : component < 0 ? -MIN_DIRECTION : MIN_DIRECTION);
+    }
+
+    return rcp;
+}
+
+static size_t BuildBinary(BinaryNode *nodes, size_t *nnodes, M7_BVHPrimitive *prims, size_t begin, size_t end, int depth) {
+    size_t index = (*nnodes)++;
+    BinaryNode *node = nodes + index;
+
+    *node = (BinaryNode) {
+        .min = prims[begin].min,
+        .max = prims[begin].max,
+        .left = SIZE_MAX,
+        .right = SIZE_MAX,
+        .begin = begin,
+        .end = end
+    };
+
+    for (size_t i = begin + 1; i < end; ++i) {
+        node->min = (vec3) {{ SDL_min(node->min.x, prims[i].min.x), SDL_min(node->min.y, prims[i].min.y), SDL_min(node->min.z, prims[i].min.z) }};
+        node->max = (vec3) {{ SDL_max(node->max.x, prims[i].max.x), SDL_max(node->max.y, prims[i].max.y), SDL_max(node->max.z, prims[i].max.z) }};
+    }
+
+    if (end - begin <= M7_MESH_BVH_LEAF_FACES)
+        return index;
+
+    size_t mid = depth < MESH_BVH_MAX_DEPTH ? M7_BVH_Split(prims, begin, end) : begin + (end - begin) / 2;
+    node->left = BuildBinary(nodes, nnodes, prims, begin, mid, depth + 1);
+    node->right = BuildBinary(nodes, nnodes, prims, mid, end, depth + 1);
+    return index;
+}
+
+/* Pulls binary nodes up into a wide node, opening the inner child with the largest area until the lanes are full */
+static Uint32 Collapse(M7_Mesh *mesh, BinaryNode *nodes, size_t index, size_t *nwide) {
+    Uint32 wide_index = (*nwide)++;
+    size_t children[M7_MESH_BVH_WIDTH] = { index };
+    int nchildren = 1;
+
+    if (nodes[index].left != SIZE_MAX) {
+        children[0] = nodes[index].left;
+        children[1] = nodes[index].right;
+        nchildren = 2;
+    }
+
+    while (nchildren < (int)M7_MESH_BVH_WIDTH) {
+        int open = -1;
+        float open_area = -1;
+
+        for (int i = 0; i < nchildren; ++i) {
+            BinaryNode *child = nodes + children[i];
+
+            if (child->left != SIZE_MAX && HalfArea(child->min, child->max) > open_area) {
+                open = i;
+                open_area = HalfArea(child->min, child->max);
+            }
+        }
+
+        if (open < 0)
+            break;
+
+        BinaryNode *opened = nodes + children[open];
+        children[open] = opened->left;
+        children[nchildren++] = opened->right;
+    }
+
+    M7_MeshBVHNode *wide = mesh->bvh_nodes + wide_index;
+
+    for (size_t i = 0; i < M7_MESH_BVH_WIDTH; ++i) {
+        if (i >= (size_t)nchildren) {
+            sd_vec3_arr_set(wide->min, i, FLT_MAX, FLT_MAX, FLT_MAX);
+            sd_vec3_arr_set(wide->max, i, -FLT_MAX, -FLT_MAX, -FLT_MAX);
+            wide->first[i] = UNUSED_LANE;
+            wide->count[i] = 0;
+            continue;
+        }
+
+        BinaryNode *child = nodes + children[i];
+        sd_vec3_arr_set(wide->min, i, child->min.x, child->min.y, child->min.z);
+        sd_vec3_arr_set(wide->max, i, child->max.x, child->max.y, child->max.z);
+
+        if (child->left == SIZE_MAX) {
+            wide->first[i] = child->begin;
+            wide->count[i] = child->end - child->begin;
+        } else {
+            wide->first[i] = Collapse(mesh, nodes, children[i], nwide);
+            wide->count[i] = 0;
+        }
+    }
+
+    return wide_index;
+}
+
+/*
+ * Builds a BVH over a mesh's faces for ray casts, with binned SAH splits collapsed into nodes of M7_MESH_BVH_WIDTH
+ * children, so a ray is tested against every child box of a node in one pass of SIMD chunks
+ */
+void SD_VARIANT(M7_Mesh_BuildBVH)(M7_Mesh *mesh) {
+    mesh->bvh_nodes = nullptr;
+    mesh->bvh_faces = nullptr;
+    mesh->nbvh_nodes = 0;
+
+    if (!mesh->nfaces)
+        return;
+
+    M7_BVHPrimitive *prims = SDL_malloc(sizeof(M7_BVHPrimitive) * mesh->nfaces);
+
+    for (size_t i = 0; i < mesh->nfaces; ++i) {
+        size_t *idx = mesh->faces[i].idx_verts;
+        vec3 verts[3] = { M7_Mesh_Vert(mesh, idx[0]), M7_Mesh_Vert(mesh, idx[1]), M7_Mesh_Vert(mesh, idx[2]) };
+
+        prims[i] = (M7_BVHPrimitive) {
+            .min = {{ SDL_min(verts[0].x, SDL_min(verts[1].x, verts[2].x)), SDL_min(verts[0].y, SDL_min(verts[1].y, verts[2].y)), SDL_min(verts[0].z, SDL_min(verts[1].z, verts[2].z)) }},
+            .max = {{ SDL_max(verts[0].x, SDL_max(verts[1].x, verts[2].x)), SDL_max(verts[0].y, SDL_max(verts[1].y, verts[2].y)), SDL_max(verts[0].z, SDL_max(verts[1].z, verts[2].z)) }},
+            .index = i
+        };
+
+        prims[i].centroid = vec3_mul(vec3_add(prims[i].min, prims[i].max), 0.5f);
+    }
+
+    BinaryNode *nodes = SDL_malloc(sizeof(BinaryNode) * (2 * mesh->nfaces - 1));
+    size_t nnodes = 0;
+    BuildBinary(nodes, &nnodes, prims, 0, mesh->nfaces, 0);
+
+    /* Every wide node but a lone leaf root opens at least one binary inner node */
+    mesh->bvh_nodes = SDL_aligned_alloc(SD_ALIGN, sizeof(M7_MeshBVHNode) * nnodes);
+    Collapse(mesh, nodes, 0, &mesh->nbvh_nodes);
+
+    mesh->bvh_faces = SDL_malloc(sizeof(Uint32) * mesh->nfaces);
+
+    for (size_t i = 0; i < mesh->nfaces; ++i)
+        mesh->bvh_faces[i] = prims[i].index;
+
+    SDL_free(nodes);
+    SDL_free(prims);
+}
+
+/* Distance along a ray to a triangle, from either side */
+static bool IntersectTriangle(vec3 origin, vec3 direction, vec3 verts[3], float max_t, float *t) {
+    vec3 edge1 = vec3_sub(verts[1], verts[0]);
+    vec3 edge2 = vec3_sub(verts[2], verts[0]);
+    vec3 p = vec3_cross(direction, edge2);
+    float det = vec3_dot(edge1, p);
+
+    if (det == 0)
+        return false;
+
+    float rcp_det = 1 / det;
+    vec3 s = vec3_sub(origin, verts[0]);
+    float u = vec3_dot(s, p) * rcp_det;
+
+    if (u < 0 || u > 1)
+        return false;
+
+    vec3 q = vec3_cross(s, edge1);
+    float v = vec3_dot(direction, q) * rcp_det;
+
+    if (v < 0 || u + v > 1)
+        return false;
+
+    float hit_t = vec3_dot(edge2, q) * rcp_det;
+
+    if (hit_t < 0 || hit_t > max_t)
+        return false;
+
+    *t = hit_t;
+    return true;
+}
+
+/*
+ * Nearest face of a mesh a mesh space ray hits before max_t, which is brought down to the hit. Stops at the first
+ * face hit if any is set
+ */
+static bool CastMesh(M7_Mesh *mesh, vec3 origin, vec3 direction, float *max_t, size_t *face, bool any) {
+    if (!mesh->nbvh_nodes)
+        return false;
+
+    sd_vec3 sd_origin = sd_vec3_set(origin.x, origin.y, origin.z);
+    vec3 rcp = RcpDirection(direction);
+    sd_vec3 sd_rcp = sd_vec3_set(rcp.x, rcp.y, rcp.z);
+
+    Uint32 stack[RAY_STACK_SIZE];
+    int top = 0;
+    bool hit = false;
+
+    stack[top++] = 0;
+
+    while (top) {
+        M7_MeshBVHNode *node = mesh->bvh_nodes + stack[--top];
+        float inner_t[M7_MESH_BVH_WIDTH];
+        Uint32 inner[M7_MESH_BVH_WIDTH];
+        int ninner = 0;
+
+        for (size_t c = 0; c < M7_MESH_BVH_CHUNKS; ++c) {
+            sd_vec3 t0 = sd_vec3_mul(sd_vec3_sub(node->min[c], sd_origin), sd_rcp);
+            sd_vec3 t1 = sd_vec3_mul(sd_vec3_sub(node->max[c], sd_origin), sd_rcp);
+            sd_vec3 t_min = sd_vec3_min(t0, t1);
+            sd_vec3 t_max = sd_vec3_max(t0, t1);
+
+            sd_float entry = sd_float_max(sd_float_max(t_min.x, t_min.y), sd_float_max(t_min.z, sd_float_zero()));
+            sd_float exit = sd_float_min(sd_float_min(t_max.x, t_max.y), sd_float_min(t_max.z, sd_float_set(*max_t)));
+            entry = sd_float_mask_blend(entry, sd_float_set(FLT_MAX), sd_float_gt(entry, exit));
+
+            for (size_t lane = 0; lane < SD_LENGTH; ++lane) {
+                size_t i = c * SD_LENGTH + lane;
+
+                if (node->first[i] == UNUSED_LANE || entry.elems[lane] == FLT_MAX)
+                    continue;
+
+                if (node->count[i]) {
+                    for (size_t f = node->first[i]; f < node->first[i] + node->count[i]; ++f) {
+                        size_t *idx = mesh->faces[mesh->bvh_faces[f]].idx_verts;
+                        vec3 verts[3] = { M7_Mesh_Vert(mesh, idx[0]), M7_Mesh_Vert(mesh, idx[1]), M7_Mesh_Vert(mesh, idx[2]) };
+
+                        if (IntersectTriangle(origin, direction, verts, *max_t, max_t)) {
+                            *face = mesh->bvh_faces[f];
+                            hit = true;
+
+                            if (any)
+                                return true;
+                        }
+                    }
+                } else {
+                    inner_t[ninner] = entry.elems[lane];
+                    inner[ninner++] = node->first[i];
+                }
+            }
+        }
+
+        /* Farthest children go on the stack first, so nearer ones are searched and narrow max_t before them */
+        for (int i = 1; i < ninner; ++i) {
+            for (int j = i; j > 0 && inner_t[j - 1] < inner_t[j]; --j) {
+                float swap_t = inner_t[j];
+                Uint32 swap = inner[j];
+                inner_t[j] = inner_t[j - 1];
+                inner[j] = inner[j - 1];
+                inner_t[j - 1] = swap_t;
+                inner[j - 1] = swap;
+            }
+        }
+
+        for (int i = 0; i < ninner; ++i)
+            stack[top++] = inner[i];
+    }
+
+    return hit;
+}
+
+/* Whether a ray enters a world space box before max_t */
+static bool RayBox(vec3 origin, vec3 rcp_direction, vec3 min, vec3 max, float max_t) {
+    float entry = 0;
+    float exit = max_t;
+
+    for (int i = 0; i < 3; ++i) {
+        float t0 = (min.entries[i] - origin.entries[i]) * rcp_direction.entries[i];
+        float t1 = (max.entries[i] - origin.entries[i]) * rcp_direction.entries[i];
+        entry = SDL_max(entry, SDL_min(t0, t1));
+        exit = SDL_min(exit, SDL_max(t0, t1));
+    }
+
+    return entry <= exit;
+}
+
+typedef struct WorldCast {
+    vec3 origin, direction;
+    float max_t;
+    bool any;
+    M7_Placement *placement; /* Hit, if any */
+    size_t face;
+} WorldCast;
+
+/* Casts in the mesh space of a placement. Affine maps keep distances along the ray in lengths of its direction */
+static void CastPlacement(WorldCast *cast, M7_Placement *placement) {
+    M7_WorldGeometry *wg = placement->geometry;
+
+    if (!List_Length(wg->instances))
+        return;
+
+    xform3 inverse = xform3_inverse(placement->world_xform);
+    vec3 origin = xform3_apply(inverse, cast->origin);
+    vec3 direction = mat3x3_mul(inverse.basis, cast->direction);
+
+    if (CastMesh(wg->mesh, origin, direction, &cast->max_t, &cast->face, cast->any))
+        cast->placement = placement;
+}
+
+static void Cast(M7_World *world, WorldCast *cast) {
+    M7_WorldBVH *bvh = &world->bvh;
+
+    /* Until the next render rebuilds the BVH, placements it doesn't hold are cast against one by one */
+    if (bvh->generation != world->generation) {
+        List_ForEach(world->geometry, wg, {
+            List_ForEach(wg->placements, placement, {
+                CastPlacement(cast, placement);
+
+                if (cast->any && cast->placement)
+                    return;
+            });
+        });
+
+        return;
+    }
+
+    vec3 rcp_direction = RcpDirection(cast->direction);
+    size_t index = 0;
+
+    while (index < bvh->nnodes) {
+        M7_BVHNode *node = bvh->nodes + index;
+
+        if (!RayBox(cast->origin, rcp_direction, node->min, node->max, cast->max_t)) {
+            index += 2 * node->leaves - 1;
+            continue;
+        }
+
+        if (node->placement) {
+            CastPlacement(cast, node->placement);
+
+            if (cast->any && cast->placement)
+                return;
+        }
+
+        index += 1;
+    }
+}
+
+/*
+ * Casts a ray from origin along direction, up to max_t lengths of direction, against the instanced geometry of a
+ * world at every placement, and reports the nearest face hit. Placements are where the world's hierarchy was last
+ * composed. Queries only read the world, so any number may run at once, as from Update systems, but not alongside
+ * rendering or changes to the world
+ */
+bool SD_VARIANT(M7_World_Raycast)(ECS_Handle *self, vec3 origin, vec3 direction, float max_t, M7_RayHit *hit) {
+    M7_World *world = ECS_Entity_GetComponent(self, M7_Components.World);
+    WorldCast cast = { .origin = origin, .direction = direction, .max_t = max_t };
+
+    Cast(world, &cast);
+
+    if (!cast.placement)
+        return false;
+
+    M7_Placement *placement = cast.placement;
+    M7_Mesh *mesh = placement->geometry->mesh;
+    size_t *idx = mesh->faces[cast.face].idx_verts;
+    vec3 verts[3] = { M7_Mesh_Vert(mesh, idx[0]), M7_Mesh_Vert(mesh, idx[1]), M7_Mesh_Vert(mesh, idx[2]) };
+    vec3 normal = vec3_cross(vec3_sub(verts[1], verts[0]), vec3_sub(verts[2], verts[0]));
+
+    /* Normals take the inverse transpose of the basis */
+    mat3x3 normal_basis = mat3x3_xpose(mat3x3_inverse(placement->world_xform.basis));
+
+    *hit = (M7_RayHit) {
+        .entity = placement->entity,
+        .geometry = placement->geometry,
+        .face = cast.face,
+        .t = cast.max_t,
+        .point = vec3_add(origin, vec3_mul(direction, cast.max_t)),
+        .normal = vec3_normalize(mat3x3_mul(normal_basis, normal))
+    };
+
+    return true;
+}
+
+/* Whether any instanced geometry of a world lies on the segment between two points, as for line of sight */
+bool SD_VARIANT(M7_World_SegmentBlocked)(ECS_Handle *self, vec3 from, vec3 to) {
+    M7_World *world = ECS_Entity_GetComponent(self, M7_Components.World);
+    WorldCast cast = { .origin = from, .direction = vec3_sub(to, from), .max_t = 1, .any = true };
+
+    Cast(world, &cast);
+    return cast.placement != nullptr;
+}
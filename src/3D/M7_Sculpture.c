@@ -95,32 +95,15 @@ M7_PolyChain *M7_Sculpture_Ellipse(M7_Sculpture *sculpture, vec3 center, vec3 ax
 
 M7_Mesh *M7_Sculpture_ToMesh(M7_Sculpture *sculpture) {
     size_t nverts = List_Length(sculpture->verts);
-    vec3 *nrmls = SDL_malloc(sizeof(vec3) * nverts);
+    size_t nfaces = List_Length(sculpture->faces);
+    vec3 *verts = List_GetAddress(sculpture->verts, 0);
+    M7_MeshFace *faces = List_GetAddress(sculpture->faces, 0);
+    vec3 *nrmls = SDL_malloc(sizeof(vec3) * SDL_max(nverts, 1));
 
-    for (size_t i = 0; i < nverts; ++i) {
-        vec3 nrml = vec3_zero;
-
-        List_ForEach(sculpture->faces, face, {
-            if (face.idx_verts[0] == i || face.idx_verts[1] == i || face.idx_verts[2] == i)
-                nrml = vec3_add(nrml, vec3_cross(
-                    vec3_sub(List_Get(sculpture->verts, face.idx_verts[1]), List_Get(sculpture->verts, face.idx_verts[0])),
-                    vec3_sub(List_Get(sculpture->verts, face.idx_verts[2]), List_Get(sculpture->verts, face.idx_verts[0]))
-                ));
-        });
-
-        nrmls[i] = vec3_normalize(nrml);
-    }
-
-    M7_Mesh *mesh = M7_Mesh_Create(
-        List_GetAddress(sculpture->verts, 0),
-        nrmls,
-        nullptr,
-        List_GetAddress(sculpture->faces, 0),
-        List_Length(sculpture->verts),
-        0,
-        List_Length(sculpture->faces)
-    );
+    M7_Mesh_SmoothNormals(verts, nrmls, faces, nverts, nfaces, nullptr);
+    M7_Mesh *mesh = M7_Mesh_Create(verts, nrmls, nullptr, faces, nverts, 0, nfaces);
 
+    SDL_free(nrmls);
     return mesh;
 }
 
@@ -3,107 +3,433 @@
 #include <M7/Math/stride.h>
 #include <M7/Math/linalg.h>
 
-sd_vec4 SD_VARIANT(M7_ShadeSolidColor)(void *state, M7_ShaderParams fragment) {
-    (void)fragment;
+#include "M7_3D_c.h"
+
+/* Uniform blocks, broadcast once per frame by the preparers */
+typedef struct SolidColorUniforms {
+    sd_vec4 col;
+} SolidColorUniforms;
+
+typedef struct CheckerboardUniforms {
+    sd_vec4 col1, col2;
+    sd_float tiles;
+    sd_int tiles_int;
+} CheckerboardUniforms;
+
+typedef struct LightingUniforms {
+    sd_vec3 vs2ws_xform[3];
+    sd_float specularity;
+    sd_float reflectivity;
+    sd_float ambient;
+    M7_LightTiles *tiles;
+    List(M7_ActiveLight *) *lights;
+    M7_Texture *reflection;
+    int exp;
+} LightingUniforms;
+
+typedef struct SkyUniforms {
+    sd_vec3 vs2ws_xform[3];
+    M7_Texture *sky;
+} SkyUniforms;
+
+/*
+ * Whether a light to fragment direction lies behind the nearest occluder in a shadow map. Picks faces and
+ * texels like M7_CubemapIndex, but reuses the major axis depth it compares against
+ */
+static inline sd_mask Occluded(M7_ShadowMap *shadow, sd_vec3 dir) {
+    sd_vec3 abs_dir = { .x = sd_float_abs(dir.x), .y = sd_float_abs(dir.y), .z = sd_float_abs(dir.z) };
+    sd_float depth = sd_float_max(sd_float_max(abs_dir.x, abs_dir.y), abs_dir.z);
+
+    sd_mask major_x = sd_mask_not(sd_mask_or(sd_float_lt(abs_dir.x, abs_dir.y), sd_float_lt(abs_dir.x, abs_dir.z)));
+    sd_mask major_y = sd_mask_andn(sd_mask_not(sd_float_lt(abs_dir.y, abs_dir.z)), major_x);
+
+    sd_mask negative_x = sd_float_lt(dir.x, sd_float_zero());
+    sd_mask negative_y = sd_float_lt(dir.y, sd_float_zero());
+    sd_mask negative_z = sd_float_lt(dir.z, sd_float_zero());
+
+    sd_float neg_x = sd_float_negate(dir.x);
+    sd_float neg_y = sd_float_negate(dir.y);
+    sd_float neg_z = sd_float_negate(dir.z);
+
+    sd_vec2 face_coord = {
+        .x = sd_float_mask_blend(sd_float_mask_blend(sd_float_mask_blend(dir.x, neg_x, negative_z), dir.x, major_y), sd_float_mask_blend(neg_z, dir.z, negative_x), major_x),
+        .y = sd_float_mask_blend(neg_y, sd_float_mask_blend(dir.z, neg_z, negative_y), major_y)
+    };
+
+    sd_int face = sd_int_mask_blend(sd_int_set(2), sd_int_set(5), negative_z);
+           face = sd_int_mask_blend(face, sd_int_mask_blend(sd_int_set(1), sd_int_set(4), negative_y), major_y);
+           face = sd_int_mask_blend(face, sd_int_mask_blend(sd_int_set(0), sd_int_set(3), negative_x), major_x);
+
+    sd_float unit = sd_float_set(shadow->width * 0.5f);
+    sd_vec2 pixel_coord = sd_vec2_fmadd(face_coord, sd_float_mul(sd_float_rcp(depth), unit), sd_vec2_set(shadow->width * 0.5f, shadow->width * 0.5f));
+            pixel_coord = sd_vec2_clamp(pixel_coord, sd_float_zero(), sd_float_set(shadow->width - 1));
+
+    sd_int pixel_index = sd_int_mul(face, sd_int_set(shadow->width * shadow->stride));
+           pixel_index = sd_int_add(pixel_index, sd_int_mul(sd_float_to_int(pixel_coord.y), sd_int_set(shadow->stride)));
+           pixel_index = sd_int_add(pixel_index, sd_float_to_int(pixel_coord.x));
+
+    sd_float occluder = sd_float_gather(shadow->depth, pixel_index);
+    return sd_float_gt(depth, sd_float_fmadd(occluder, sd_float_set(M7_SHADOW_BIAS), occluder));
+}
+
+#define UNIFORMS(type,uniforms)  ( (uniforms) ? (type *)(uniforms) : (type *)SDL_aligned_alloc(SD_ALIGN, sizeof(type)) )
+
+static void BroadcastBasis(sd_vec3 dst[3], mat3x3 basis) {
+    dst[0] = sd_vec3_set(basis.x.x, basis.x.y, basis.x.z);
+    dst[1] = sd_vec3_set(basis.y.x, basis.y.y, basis.y.z);
+    dst[2] = sd_vec3_set(basis.z.x, basis.z.y, basis.z.z);
+}
+
+void *SD_VARIANT(M7_PrepareSolidColor)(void *state, void *uniforms, M7_ShaderFrame *frame) {
+    (void)frame;
     M7_SolidColor *solid_color = state;
-    return sd_vec4_set(solid_color->r, solid_color->g, solid_color->b, 1);
+    SolidColorUniforms *u = UNIFORMS(SolidColorUniforms, uniforms);
+    u->col = sd_vec4_set(solid_color->r, solid_color->g, solid_color->b, 1);
+    return u;
 }
 
-sd_vec4 SD_VARIANT(M7_ShadeCheckerboard)(void *state, M7_ShaderParams fragment) {
+void *SD_VARIANT(M7_PrepareCheckerboard)(void *state, void *uniforms, M7_ShaderFrame *frame) {
+    (void)frame;
     M7_Checkerboard *checkerboard = state;
-    sd_vec2 tile_coord = sd_vec2_muls(fragment.ts, sd_float_set(checkerboard->tiles));
-    sd_int tile_idx = sd_int_add(sd_int_mul(sd_float_to_int(tile_coord.y), sd_int_set(checkerboard->tiles)), sd_float_to_int(tile_coord.x));
-    sd_mask tile_mask = sd_int_gt(sd_int_and(tile_idx, sd_int_set(1)), sd_int_set(0));
+    CheckerboardUniforms *u = UNIFORMS(CheckerboardUniforms, uniforms);
+    u->col1 = sd_vec4_set(checkerboard->r1, checkerboard->g1, checkerboard->b1, 1);
+    u->col2 = sd_vec4_set(checkerboard->r2, checkerboard->g2, checkerboard->b2, 1);
+    u->tiles = sd_float_set(checkerboard->tiles);
+    u->tiles_int = sd_int_set(checkerboard->tiles);
+    return u;
+}
+
+void *SD_VARIANT(M7_PrepareLighting)(void *state, void *uniforms, M7_ShaderFrame *frame) {
+    M7_OpticalMedium *medium = state;
+    LightingUniforms *u = UNIFORMS(LightingUniforms, uniforms);
+    BroadcastBasis(u->vs2ws_xform, frame->vs2ws_xform.basis);
+    u->specularity = sd_float_set(medium->specularity);
+    u->reflectivity = sd_float_set(medium->reflectivity);
+    u->ambient = sd_float_set(medium->environment->ambient);
+    u->tiles = &medium->environment->tiles;
+    u->lights = medium->environment->lights;
+    u->exp = medium->exp;
+
+    /* Sample the chain level whose texels match the half-power width of the specular lobe */
+    float lobe = SDL_acosf(SDL_powf(0.5f, SDL_powf(0.5f, SDL_max(medium->exp, 0))));
+    u->reflection = M7_CubemapChain_Level(medium->environment->sky_chain, lobe);
+    return u;
+}
+
+void *SD_VARIANT(M7_PrepareSky)(void *state, void *uniforms, M7_ShaderFrame *frame) {
+    M7_LightEnvironment **env = state;
+    SkyUniforms *u = UNIFORMS(SkyUniforms, uniforms);
+    BroadcastBasis(u->vs2ws_xform, frame->vs2ws_xform.basis);
+    u->sky = (*env)->sky;
+    return u;
+}
 
-    return sd_vec4_mask_blend(
-        sd_vec4_set(checkerboard->r1, checkerboard->g1, checkerboard->b1, 1),
-        sd_vec4_set(checkerboard->r2, checkerboard->g2, checkerboard->b2, 1),
-        tile_mask
-    );
+M7_SHADER_DEFINE(M7_ShadeSolidColor, state, fragment) {
+    (void)fragment;
+    SolidColorUniforms *u = state;
+    return u->col;
 }
 
-sd_vec4 SD_VARIANT(M7_ShadeTextureMap)(void *state, M7_ShaderParams fragment) {
+M7_SHADER_DEFINE(M7_ShadeCheckerboard, state, fragment) {
+    CheckerboardUniforms *u = state;
+    sd_vec2 tile_coord = sd_vec2_muls(fragment->ts, u->tiles);
+    sd_int tile_idx = sd_int_add(sd_int_mul(sd_float_to_int(tile_coord.y), u->tiles_int), sd_float_to_int(tile_coord.x));
+    sd_mask tile_mask = sd_int_gt(sd_int_and(tile_idx, sd_int_set(1)), sd_int_set(0));
+    return sd_vec4_mask_blend(u->col1, u->col2, tile_mask);
+}
+
+M7_SHADER_DEFINE(M7_ShadeTextureMap, state, fragment) {
     M7_TextureMap *texture_map = state;
-    return M7_SampleNearest(texture_map->texture, fragment.ts) ;
+    return M7_SampleNearest(texture_map->texture, fragment->ts);
 }
 
-sd_vec4 SD_VARIANT(M7_ShadeLighting)(void *state, M7_ShaderParams fragment) {
-    M7_OpticalMedium *medium = state;
-    sd_float specularity = sd_float_set(medium->specularity);
-    sd_float reflectivity = sd_float_set(medium->reflectivity);
-    sd_float ambient = sd_float_set(medium->environment->ambient);
-    sd_vec3 eye = sd_vec3_negate(sd_vec3_normalize(fragment.vs));
+/* Zero for unbounded lights, which leaves their falloff unwindowed */
+static inline float RcpSqrRadius(M7_ActiveLight *light) {
+    return light->radius ? 1 / (light->radius * light->radius) : 0;
+}
 
-    sd_vec4 out;
-    out.rgb = sd_vec3_muls(fragment.col.rgb, ambient);
-    out.a = fragment.col.a;
+/* Light a point reflects from a light towards the eye, per unit of surface color */
+static inline sd_vec3 LightPower(LightingUniforms *u, sd_vec3 vs, sd_vec3 nrml, sd_vec3 eye, sd_vec3 light_vs, sd_vec3 light_col, sd_float light_energy, sd_float rcp_sqr_radius, M7_ShadowMap *shadow) {
+    sd_vec3 incident = sd_vec3_sub(vs, light_vs);
+    sd_float sqrlen = sd_vec3_dot(incident, incident);
+    sd_float rcpsql = sd_float_rcp(sqrlen);
+    sd_float rcplen = sd_float_rsqrt(sqrlen);
+
+    /* Window the inverse square falloff to reach zero at the light's radius, if it has one */
+    sd_float window = sd_float_mul(sqrlen, rcp_sqr_radius);
+             window = sd_float_max(sd_float_sub(sd_float_one(), sd_float_mul(window, window)), sd_float_zero());
+             window = sd_float_mul(window, window);
 
-    List_ForEach(medium->environment->lights, light, {
-        sd_vec3 light_vs = sd_vec3_set(light->pos.x, light->pos.y, light->pos.z);
-        sd_vec3 light_col = sd_vec3_set(light->col.x, light->col.y, light->col.z);
-        sd_float light_energy = sd_float_set(light->energy);
+    sd_vec3 reflected = sd_vec3_muls(sd_vec3_reflect(incident, nrml), rcplen);
+    sd_float dp = sd_float_max(sd_vec3_dot(reflected, nrml), sd_float_zero());
 
-        sd_vec3 incident = sd_vec3_sub(fragment.vs, light_vs);
-        sd_float sqrlen = sd_vec3_dot(incident, incident);
-        sd_float rcpsql = sd_float_rcp(sqrlen);
-        sd_float rcplen = sd_float_rsqrt(sqrlen);
+    sd_float rf_falloff = sd_float_sub(sd_float_one(), dp);
+             rf_falloff = sd_float_mul(rf_falloff, rf_falloff);
+             rf_falloff = sd_float_mul(rf_falloff, rf_falloff);
 
-        sd_vec3 reflected = sd_vec3_muls(sd_vec3_reflect(incident, fragment.nrml), rcplen);
-        sd_float dp = sd_float_max(sd_vec3_dot(reflected, fragment.nrml), sd_float_zero());
+    sd_float rf_coeff = sd_float_fmadd(sd_float_sub(sd_float_one(), u->reflectivity), rf_falloff, u->reflectivity);
+    sd_float sp_coeff = sd_vec3_dot(eye, reflected);
 
-        sd_float rf_falloff = sd_float_sub(sd_float_one(), dp);
-                 rf_falloff = sd_float_mul(rf_falloff, rf_falloff);
-                 rf_falloff = sd_float_mul(rf_falloff, rf_falloff);
+    /* Occlude against the light's shadow map, by depth along the major axis of the light to point direction */
+    if (shadow) {
+        sd_vec3 dir = sd_vec3_muls(u->vs2ws_xform[0], incident.x);
+                dir = sd_vec3_fmadd(u->vs2ws_xform[1], incident.y, dir);
+                dir = sd_vec3_fmadd(u->vs2ws_xform[2], incident.z, dir);
 
-        sd_float rf_coeff = sd_float_fmadd(sd_float_sub(sd_float_one(), reflectivity), rf_falloff, reflectivity);
-        sd_float sp_coeff = sd_vec3_dot(eye, reflected);
+        window = sd_float_mask_blend(window, sd_float_zero(), Occluded(shadow, dir));
+    }
 
-        for (int i = 0; i < medium->exp; ++i)
-            sp_coeff = sd_float_mul(sp_coeff, sp_coeff);
+    for (int i = 0; i < u->exp; ++i)
+        sp_coeff = sd_float_mul(sp_coeff, sp_coeff);
 
-        sp_coeff = sd_float_mul(sp_coeff, specularity);
+    sp_coeff = sd_float_mul(sp_coeff, u->specularity);
 
-        sd_vec3 power_in = sd_vec3_muls(light_col, sd_float_mul(sd_float_mul(light_energy, rcpsql), dp));
-        sd_vec3 power_out = sd_vec3_muls(power_in, rf_coeff);
-        out.rgb = sd_vec3_add(out.rgb, sd_vec3_mul(fragment.col.rgb, sd_vec3_fmadd(power_out, sp_coeff, power_out)));
-    });
+    sd_vec3 power_in = sd_vec3_muls(light_col, sd_float_mul(sd_float_mul(sd_float_mul(light_energy, rcpsql), window), dp));
+    sd_vec3 power_out = sd_vec3_muls(power_in, rf_coeff);
+    return sd_vec3_fmadd(power_out, sp_coeff, power_out);
+}
 
-    sd_vec3 dir_vs = sd_vec3_reflect(sd_vec3_normalize(fragment.vs), fragment.nrml);
-    sd_float dp = sd_vec3_dot(dir_vs, fragment.nrml);
+/* Sky reflected from a point towards the eye, before scaling by specularity */
+static inline sd_vec3 ReflectionPower(LightingUniforms *u, sd_vec3 vs, sd_vec3 nrml) {
+    sd_vec3 dir_vs = sd_vec3_reflect(sd_vec3_normalize(vs), nrml);
+    sd_float dp = sd_vec3_dot(dir_vs, nrml);
 
     sd_float rf_falloff = sd_float_sub(sd_float_one(), dp);
              rf_falloff = sd_float_mul(rf_falloff, rf_falloff);
              rf_falloff = sd_float_mul(rf_falloff, rf_falloff);
 
-    sd_float rf_coeff = sd_float_fmadd(sd_float_sub(sd_float_one(), reflectivity), rf_falloff, reflectivity);
+    sd_float rf_coeff = sd_float_fmadd(sd_float_sub(sd_float_one(), u->reflectivity), rf_falloff, u->reflectivity);
 
-    sd_vec3 dir = sd_vec3_muls(fragment.vs2ws_xform[0], dir_vs.x);
-            dir = sd_vec3_fmadd(fragment.vs2ws_xform[1], dir_vs.y, dir);
-            dir = sd_vec3_fmadd(fragment.vs2ws_xform[2], dir_vs.z, dir);
+    sd_vec3 dir = sd_vec3_muls(u->vs2ws_xform[0], dir_vs.x);
+            dir = sd_vec3_fmadd(u->vs2ws_xform[1], dir_vs.y, dir);
+            dir = sd_vec3_fmadd(u->vs2ws_xform[2], dir_vs.z, dir);
 
-    sd_vec3 power_in = sd_vec3_muls(M7_SampleCubemap(medium->environment->sky, dir).rgb, dp);
-    sd_vec3 power_out = sd_vec3_muls(power_in, rf_coeff);
+    sd_vec3 power_in = sd_vec3_muls(M7_SampleCubemap(u->reflection, dir).rgb, dp);
+    return sd_vec3_muls(power_in, rf_coeff);
+}
+
+M7_SHADER_DEFINE(M7_ShadeLighting, state, fragment) {
+    LightingUniforms *u = state;
+    sd_vec3 eye = sd_vec3_negate(sd_vec3_normalize(fragment->vs));
 
-    out.rgb = sd_vec3_fmadd(power_out, specularity, out.rgb);
+    sd_vec4 out;
+    out.rgb = sd_vec3_muls(fragment->col.rgb, u->ambient);
+    out.a = fragment->col.a;
+
+    M7_LightTiles *tiles = u->tiles;
+    int tile_x = fragment->x / M7_LIGHT_TILE_SIZE;
+    int tile_y = fragment->y / M7_LIGHT_TILE_SIZE;
+    size_t tile = (size_t)tile_y * tiles->width + tile_x;
+    size_t first = 0, last = 0;
+
+    if (tile_x < tiles->width && tile_y < tiles->height) {
+        first = tiles->offsets[tile];
+        last = tiles->offsets[tile + 1];
+    }
+
+    for (size_t i = first; i < last; ++i) {
+        sd_vec3 power = LightPower(u, fragment->vs, fragment->nrml, eye,
+            sd_vec3_set(tiles->lights.x[i], tiles->lights.y[i], tiles->lights.z[i]),
+            sd_vec3_set(tiles->lights.r[i], tiles->lights.g[i], tiles->lights.b[i]),
+            sd_float_set(tiles->lights.energy[i]),
+            sd_float_set(tiles->lights.rcp_sqr_radius[i]),
+            tiles->lights.shadow[i]
+        );
+
+        out.rgb = sd_vec3_add(out.rgb, sd_vec3_mul(fragment->col.rgb, power));
+    }
+
+    out.rgb = sd_vec3_fmadd(ReflectionPower(u, fragment->vs, fragment->nrml), u->specularity, out.rgb);
     return out;
 }
 
-sd_vec4 SD_VARIANT(M7_ShadeSky)(void *state, M7_ShaderParams fragment) {
-    M7_LightEnvironment **env = state;
+/* Applies the color multiplier and addend lit at the vertices by M7_LightVertices */
+M7_SHADER_DEFINE(M7_ShadeVertexLighting, state, fragment) {
+    (void)state;
+    sd_vec4 out;
+    out.rgb = sd_vec3_add(sd_vec3_mul(fragment->col.rgb, fragment->attrs[0].rgb), fragment->attrs[1].rgb);
+    out.a = fragment->col.a;
+    return out;
+}
+
+/*
+ * Lights each vertex against every light of the environment, writing the diffuse and specular multiplier
+ * of surface color to attribute 0 and the reflection to attribute 1. Meshes without normals are left unlit
+ */
+void SD_VARIANT(M7_LightVertices)(void *state, M7_VertexSpan *span) {
+    LightingUniforms *u = state;
+    size_t nlights = List_Length(u->lights);
+
+    for (size_t k = 0; k < span->length; ++k) {
+        if (!span->nrml) {
+            span->attrs[0][k] = sd_vec4_set(1, 1, 1, 1);
+            span->attrs[1][k] = sd_vec4_set(0, 0, 0, 0);
+            continue;
+        }
+
+        sd_vec3 vs = span->vs[k];
+        sd_vec3 nrml = sd_vec3_normalize(span->nrml[k]);
+        sd_vec3 eye = sd_vec3_negate(sd_vec3_normalize(vs));
+        sd_vec3 multiplier = { .x = u->ambient, .y = u->ambient, .z = u->ambient };
+
+        for (size_t i = 0; i < nlights; ++i) {
+            M7_ActiveLight *light = List_Get(u->lights, i);
+
+            multiplier = sd_vec3_add(multiplier, LightPower(u, vs, nrml, eye,
+                sd_vec3_set(light->pos.x, light->pos.y, light->pos.z),
+                sd_vec3_set(light->col.x, light->col.y, light->col.z),
+                sd_float_set(light->energy),
+                sd_float_set(RcpSqrRadius(light)),
+                light->shadow
+            ));
+        }
+
+        span->attrs[0][k].rgb = multiplier;
+        span->attrs[0][k].a = sd_float_one();
+        span->attrs[1][k].rgb = sd_vec3_muls(ReflectionPower(u, vs, nrml), u->specularity);
+        span->attrs[1][k].a = sd_float_zero();
+    }
+}
+
+M7_SHADER_DEFINE(M7_ShadeSky, state, fragment) {
+    SkyUniforms *u = state;
 
-    sd_vec3 dir = sd_vec3_muls(fragment.vs2ws_xform[0], fragment.vs.x);
-            dir = sd_vec3_fmadd(fragment.vs2ws_xform[1], fragment.vs.y, dir);
-            dir = sd_vec3_fmadd(fragment.vs2ws_xform[2], fragment.vs.z, dir);
+    sd_vec3 dir = sd_vec3_muls(u->vs2ws_xform[0], fragment->vs.x);
+            dir = sd_vec3_fmadd(u->vs2ws_xform[1], fragment->vs.y, dir);
+            dir = sd_vec3_fmadd(u->vs2ws_xform[2], fragment->vs.z, dir);
             dir = sd_vec3_normalize(dir);
 
-    return M7_SampleCubemap((*env)->sky, dir);
+    return M7_SampleCubemap(u->sky, dir);
+}
+
+M7_FUSED_SHADERS(M7_SHADER_FUSE)
+
+static void ReserveLightTiles(M7_LightTiles *tiles, size_t count) {
+    if (count <= tiles->capacity)
+        return;
+
+    tiles->capacity = SDL_max(count, tiles->capacity * 2);
+
+    float **arrays[] = {
+        &tiles->lights.x, &tiles->lights.y, &tiles->lights.z,
+        &tiles->lights.r, &tiles->lights.g, &tiles->lights.b,
+        &tiles->lights.energy, &tiles->lights.rcp_sqr_radius
+    };
+
+    for (size_t i = 0; i < SDL_arraysize(arrays); ++i)
+        *arrays[i] = SDL_realloc(*arrays[i], sizeof(float) * tiles->capacity);
+
+    tiles->lights.shadow = SDL_realloc(tiles->lights.shadow, sizeof(M7_ShadowMap *) * tiles->capacity);
+}
+
+/* Lights must be in view space. Tile ranges are conservative, from the projected bounding box of each light */
+void SD_VARIANT(M7_LightEnvironment_Cull)(M7_LightEnvironment *env, ECS_Handle *rasterizer) {
+    M7_Rasterizer *rast = ECS_Entity_GetComponent(rasterizer, M7_Components.Rasterizer);
+    M7_Canvas *canvas = ECS_Entity_GetComponent(rast->target, M7_Components.Canvas);
+    M7_LightTiles *tiles = &env->tiles;
+
+    int width = (canvas->width + M7_LIGHT_TILE_SIZE - 1) / M7_LIGHT_TILE_SIZE;
+    int height = (canvas->height + M7_LIGHT_TILE_SIZE - 1) / M7_LIGHT_TILE_SIZE;
+    size_t ntiles = (size_t)width * height;
+
+    if (tiles->width != width || tiles->height != height) {
+        tiles->offsets = SDL_realloc(tiles->offsets, sizeof(size_t) * (ntiles + 1));
+        tiles->width = width;
+        tiles->height = height;
+    }
+
+    SDL_memset(tiles->offsets, 0, sizeof(size_t) * (ntiles + 1));
+
+    size_t nlights = List_Length(env->lights);
+    int (*rects)[4] = SDL_malloc(sizeof(int [4]) * SDL_max(nlights, 1));
+    sd_vec2 midpoint = sd_vec2_set(canvas->width * 0.5f, canvas->height * 0.5f);
+
+    for (size_t i = 0; i < nlights; ++i) {
+        M7_ActiveLight *light = List_Get(env->lights, i);
+        vec3 pos = light->pos;
+        float radius = light->radius;
+        int *rect = rects[i];
+
+        if (radius && pos.z + radius < rast->near) {
+            SDL_memset(rect, 0, sizeof(int [4]));
+            continue;
+        }
+
+        /* Unbounded lights, and lights crossing the near plane, may reach anywhere */
+        SDL_memcpy(rect, (int [4]) { 0, 0, width, height }, sizeof(int [4]));
+
+        if (radius && pos.z - radius >= rast->near) {
+            sd_vec2 projected = rast->project(rasterizer, sd_vec3_set(pos.x, pos.y, pos.z), midpoint);
+            sd_vec2_scalar projected_scalar = sd_vec2_arr_get(&projected, 0);
+            vec2 min, max;
+
+            SDL_memcpy(&min, &projected_scalar, sizeof(vec2));
+            max = min;
+
+            for (int corner = 0; corner < 8; ++corner) {
+                projected = rast->project(rasterizer, sd_vec3_set(
+                    pos.x + (corner & 1 ? radius : -radius),
+                    pos.y + (corner & 2 ? radius : -radius),
+                    pos.z + (corner & 4 ? radius : -radius)
+                ), midpoint);
+
+                projected_scalar = sd_vec2_arr_get(&projected, 0);
+                vec2 point;
+                SDL_memcpy(&point, &projected_scalar, sizeof(vec2));
+
+                min = (vec2) {{ SDL_min(min.x, point.x), SDL_min(min.y, point.y) }};
+                max = (vec2) {{ SDL_max(max.x, point.x), SDL_max(max.y, point.y) }};
+            }
+
+            rect[0] = (int)SDL_clamp(min.x, 0, canvas->width) / M7_LIGHT_TILE_SIZE;
+            rect[1] = (int)SDL_clamp(min.y, 0, canvas->height) / M7_LIGHT_TILE_SIZE;
+            rect[2] = SDL_min((int)SDL_clamp(max.x, 0, canvas->width) / M7_LIGHT_TILE_SIZE + 1, width);
+            rect[3] = SDL_min((int)SDL_clamp(max.y, 0, canvas->height) / M7_LIGHT_TILE_SIZE + 1, height);
+        }
+
+        for (int y = rect[1]; y < rect[3]; ++y)
+            for (int x = rect[0]; x < rect[2]; ++x)
+                tiles->offsets[(size_t)y * width + x + 1] += 1;
+    }
+
+    for (size_t i = 0; i < ntiles; ++i)
+        tiles->offsets[i + 1] += tiles->offsets[i];
+
+    ReserveLightTiles(tiles, tiles->offsets[ntiles]);
+    size_t *cursors = SDL_memcpy(SDL_malloc(sizeof(size_t) * SDL_max(ntiles, 1)), tiles->offsets, sizeof(size_t) * ntiles);
+
+    for (size_t i = 0; i < nlights; ++i) {
+        M7_ActiveLight *light = List_Get(env->lights, i);
+        int *rect = rects[i];
+
+        for (int y = rect[1]; y < rect[3]; ++y) {
+            for (int x = rect[0]; x < rect[2]; ++x) {
+                size_t j = cursors[(size_t)y * width + x]++;
+                tiles->lights.x[j] = light->pos.x;
+                tiles->lights.y[j] = light->pos.y;
+                tiles->lights.z[j] = light->pos.z;
+                tiles->lights.r[j] = light->col.x;
+                tiles->lights.g[j] = light->col.y;
+                tiles->lights.b[j] = light->col.z;
+                tiles->lights.energy[j] = light->energy;
+                tiles->lights.rcp_sqr_radius[j] = RcpSqrRadius(light);
+                tiles->lights.shadow[j] = light->shadow;
+            }
+        }
+    }
+
+    SDL_free(cursors);
+    SDL_free(rects);
 }
 
 #ifndef SD_SRC_VARIANT
 
 void M7_PointLight_OnXform(ECS_Handle *self, xform3 composed) {
     M7_PointLight *light = ECS_Entity_GetComponent(self, M7_Components.PointLight);
-    light->active->pos = composed.translation;
+    M7_Model *model = ECS_Entity_GetComponent(self, M7_Components.Model);
+    M7_Placement **placement = ECS_Entity_GetComponent(self, M7_Components.Placement);
+    light->active->world_pos = composed.translation;
+    light->active->emitter = model ? model->placement : placement ? *placement : nullptr;
 }
 
 void M7_TextureMap_Attach(ECS_Handle *self, ECS_Component(void) *component) {
@@ -134,16 +460,22 @@ void M7_PointLight_Attach(ECS_Handle *self, ECS_Component(void) *component) {
     M7_ActiveLight *active = SDL_malloc(sizeof(M7_ActiveLight));
     active->col = light->col;
     active->energy = light->energy;
+    active->radius = light->radius;
     active->pos = vec3_zero;
+    active->world_pos = vec3_zero;
+    active->shadow = light->shadow_size ? M7_ShadowMap_Create(light->shadow_size) : nullptr;
+    active->emitter = nullptr;
 
     light->active = active;
     List_Push(light->environment->lights, active);
+    M7_Entity_InvalidateXform(self);
 }
 
 void M7_LightEnvironment_Attach(ECS_Handle *self, ECS_Component(void) *component) {
     M7_LightEnvironment **env = ECS_Entity_GetComponent(self, component);
     ECS_Handle *tb = ECS_Entity_AncestorWithComponent(self, M7_Components.TextureBank, false);
     (*env)->sky = M7_ResourceBank_Get(tb, M7_Components.TextureBank, (*env)->sky_texture_path);
+    (*env)->sky_chain = M7_CubemapChain_Create((*env)->sky);
 }
 
 void M7_TextureMap_Detach(ECS_Handle *self, ECS_Component(void) *component) {
@@ -156,18 +488,25 @@ void M7_TextureMap_Detach(ECS_Handle *self, ECS_Component(void) *component) {
 void M7_PointLight_Detach(ECS_Handle *self, ECS_Component(void) *component) {
     M7_PointLight *light = ECS_Entity_GetComponent(self, component);
     List_RemoveWhere(light->environment->lights, active, active == light->active);
+
+    if (light->active->shadow)
+        M7_ShadowMap_Free(light->active->shadow);
+
     SDL_free(light->active);
 }
 
 void M7_LightEnvironment_Detach(ECS_Handle *self, ECS_Component(void) *component) {
     M7_LightEnvironment **env = ECS_Entity_GetComponent(self, component);
     ECS_Handle *tb = ECS_Entity_AncestorWithComponent(self, M7_Components.TextureBank, false);
+    M7_CubemapChain_Free((*env)->sky_chain);
     M7_ResourceBank_Release(tb, M7_Components.TextureBank, (*env)->sky_texture_path);
 }
 
 void M7_SolidColor_Init(void *component, void *args) {
     M7_ShaderComponent *shader_component = component;
     shader_component->callback = SD_SELECT(M7_ShadeSolidColor);
+    shader_component->prepare = SD_SELECT(M7_PrepareSolidColor);
+    shader_component->vertex = nullptr;
     shader_component->state = SDL_malloc(sizeof(M7_SolidColor));
     SDL_memcpy(shader_component->state, args, sizeof(M7_SolidColor));
 }
@@ -175,6 +514,8 @@ void M7_SolidColor_Init(void *component, void *args) {
 void M7_Checkerboard_Init(void *component, void *args) {
     M7_ShaderComponent *shader_component = component;
     shader_component->callback = SD_SELECT(M7_ShadeCheckerboard);
+    shader_component->prepare = SD_SELECT(M7_PrepareCheckerboard);
+    shader_component->vertex = nullptr;
     shader_component->state = SDL_malloc(sizeof(M7_Checkerboard));
     SDL_memcpy(shader_component->state, args, sizeof(M7_Checkerboard));
 }
@@ -182,6 +523,8 @@ void M7_Checkerboard_Init(void *component, void *args) {
 void M7_TextureMap_Init(void *component, void *args) {
     M7_ShaderComponent *shader_component = component;
     shader_component->callback = SD_SELECT(M7_ShadeTextureMap);
+    shader_component->prepare = nullptr;
+    shader_component->vertex = nullptr;
     shader_component->state = SDL_malloc(sizeof(M7_TextureMap));
 
     M7_TextureMap *texture_map = shader_component->state;
@@ -192,7 +535,10 @@ void M7_TextureMap_Init(void *component, void *args) {
 
 void M7_Lighting_Init(void *component, void *args) {
     M7_ShaderComponent *shader_component = component;
-    shader_component->callback = SD_SELECT(M7_ShadeLighting);
+    M7_OpticalMedium *medium = args;
+    shader_component->callback = medium->per_vertex ? SD_SELECT(M7_ShadeVertexLighting) : SD_SELECT(M7_ShadeLighting);
+    shader_component->prepare = SD_SELECT(M7_PrepareLighting);
+    shader_component->vertex = medium->per_vertex ? SD_SELECT(M7_LightVertices) : nullptr;
     shader_component->state = SDL_malloc(sizeof(M7_OpticalMedium));
     SDL_memcpy(shader_component->state, args, sizeof(M7_OpticalMedium));
 }
@@ -201,6 +547,8 @@ void M7_Sky_Init(void *component, void *args) {
     (void)args;
     M7_ShaderComponent *shader_component = component;
     shader_component->callback = SD_SELECT(M7_ShadeSky);
+    shader_component->prepare = SD_SELECT(M7_PrepareSky);
+    shader_component->vertex = nullptr;
     shader_component->state = SDL_malloc(sizeof(M7_LightEnvironment **));
 }
 
@@ -211,6 +559,7 @@ void M7_LightEnvironment_Init(void *component, void *args) {
     (*env)->sky_texture_path = SDL_malloc(SDL_strlen(env_args->sky_texture_path) + 1);
     SDL_strlcpy((*env)->sky_texture_path, env_args->sky_texture_path, M7_RESOURCE_PATHLEN);
     (*env)->lights = List_Create(M7_ActiveLight *);
+    (*env)->tiles = (M7_LightTiles) {};
     (*env)->ambient = env_args->ambient;
 }
 
@@ -221,6 +570,24 @@ void M7_TextureMap_Free(void *component) {
     SDL_free(texture_map);
 }
 
+#define M7_SHADER_SELECT(...)          __VA_OPT__(M7_SHADER_SELECT1(__VA_ARGS__))
+#define M7_SHADER_SELECT1(shader,...)  SD_SELECT(shader) __VA_OPT__(, M7_SHADER_SELECT2(__VA_ARGS__))
+#define M7_SHADER_SELECT2(shader,...)  SD_SELECT(shader) __VA_OPT__(, M7_SHADER_SELECT3(__VA_ARGS__))
+#define M7_SHADER_SELECT3(shader,...)  SD_SELECT(shader) __VA_OPT__(, M7_SHADER_SELECT4(__VA_ARGS__))
+#define M7_SHADER_SELECT4(shader)      SD_SELECT(shader)
+
+#define M7_FUSED_SHADER_MATCH(name,...)  do {                                                      \
+    M7_FragmentShader stages[] = { M7_SHADER_SELECT(__VA_ARGS__) };                                \
+    if (nshaders == SDL_arraysize(stages) && !SDL_memcmp(shader_pipeline, stages, sizeof(stages)))  \
+        return SD_SELECT(name);                                                                    \
+} while (0);
+
+/* Returns the fused shader for a pipeline, if there is one */
+M7_FragmentShader M7_Shader_Fuse(M7_FragmentShader *shader_pipeline, size_t nshaders) {
+    M7_FUSED_SHADERS(M7_FUSED_SHADER_MATCH)
+    return nullptr;
+}
+
 void M7_ShaderComponent_Free(void *component) {
     M7_ShaderComponent *shader_component = component;
     SDL_free(shader_component->state);
@@ -230,6 +597,18 @@ void M7_LightEnvironment_Free(void *component) {
     M7_LightEnvironment **env = component;
     SDL_free((*env)->sky_texture_path);
     List_Free((*env)->lights);
+
+    M7_LightTiles *tiles = &(*env)->tiles;
+    SDL_free(tiles->offsets);
+    SDL_free(tiles->lights.x);
+    SDL_free(tiles->lights.y);
+    SDL_free(tiles->lights.z);
+    SDL_free(tiles->lights.r);
+    SDL_free(tiles->lights.g);
+    SDL_free(tiles->lights.b);
+    SDL_free(tiles->lights.energy);
+    SDL_free(tiles->lights.rcp_sqr_radius);
+    SDL_free(tiles->lights.shadow);
     SDL_free(*env);
 }
 
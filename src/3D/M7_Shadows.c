@@ -0,0 +1,300 @@
+#include <float.h>
+#include <SDL3/SDL.h>
+#include <M7/ECS.h>
+#include <M7/M7_ECS.h>
+#include <M7/Collections/List.h>
+#include <M7/Math/linalg.h>
+#include <M7/Math/stride.h>
+
+#include "M7_3D_c.h"
+
+#define SHADOW_MOVE_EPSILON   1e-2f /* World units a light or geometry may drift from its last position unnoticed */
+#define SHADOW_BASIS_EPSILON  1e-4f
+#define SHADOW_QUERY_SLACK    0.1f /* Past a light's radius, covering placements that drifted within the epsilons */
+
+typedef struct FaceAxes {
+    vec3 right, down, forward;
+} FaceAxes;
+
+/* Axes of the shadow map faces, such that they project like M7_CubemapIndex samples */
+static const FaceAxes face_axes[6] = {
+    { {{  0,  0, -1 }}, {{  0, -1,  0 }}, {{  1,  0,  0 }} },
+    { {{  1,  0,  0 }}, {{  0,  0,  1 }}, {{  0,  1,  0 }} },
+    { {{  1,  0,  0 }}, {{  0, -1,  0 }}, {{  0,  0,  1 }} },
+    { {{  0,  0,  1 }}, {{  0, -1,  0 }}, {{ -1,  0,  0 }} },
+    { {{  1,  0,  0 }}, {{  0,  0, -1 }}, {{  0, -1,  0 }} },
+    { {{ -1,  0,  0 }}, {{  0, -1,  0 }}, {{  0,  0, -1 }} }
+};
+
+static inline float edge(vec2 from, vec2 to, vec2 point) {
+    return (to.x - from.x) * (point.y - from.y) - (to.y - from.y) * (point.x - from.x);
+}
+
+static bool XformsNear(xform3 lhs, xform3 rhs) {
+    vec3 diffs[4] = {
+        vec3_sub(lhs.basis.x, rhs.basis.x),
+        vec3_sub(lhs.basis.y, rhs.basis.y),
+        vec3_sub(lhs.basis.z, rhs.basis.z),
+        vec3_sub(lhs.translation, rhs.translation)
+    };
+
+    for (int i = 0; i < 3; ++i)
+        if (vec3_dot(diffs[i], diffs[i]) > SHADOW_BASIS_EPSILON * SHADOW_BASIS_EPSILON)
+            return false;
+
+    return vec3_dot(diffs[3], diffs[3]) <= SHADOW_MOVE_EPSILON * SHADOW_MOVE_EPSILON;
+}
+
+/* Whether the bounding sphere of geometry placed at ws_xform comes within reach of a light */
+static bool InReach(M7_ActiveLight *light, vec3 ws_pos, M7_WorldGeometry *wg, xform3 ws_xform) {
+    if (!light->radius)
+        return true;
+
+    float scale = SDL_max(vec3_length(ws_xform.basis.x), SDL_max(vec3_length(ws_xform.basis.y), vec3_length(ws_xform.basis.z)));
+    float reach = wg->bounds_radius * scale + light->radius;
+    vec3 offset = vec3_sub(xform3_apply(ws_xform, wg->bounds_center), ws_pos);
+    return vec3_dot(offset, offset) <= reach * reach;
+}
+
+typedef struct DepthPlane {
+    float a, b, c; /* a * x + b * y + c, at texel centers */
+} DepthPlane;
+
+/* Barycentric weight of the vertex opposite the edge from -> to */
+static DepthPlane Weight(vec2 from, vec2 to, float rcp_area) {
+    return (DepthPlane) {
+        .a = (from.y - to.y) * rcp_area,
+        .b = (to.x - from.x) * rcp_area,
+        .c = ((to.y - from.y) * (from.x - 0.5f) - (to.x - from.x) * (from.y - 0.5f)) * rcp_area
+    };
+}
+
+/*
+ * Depth only scan of a triangle in face space, keeping the nearest depth of each covered texel. Only back faces are
+ * drawn. Rows are scanned SD_LENGTH texels at a time, so the last step of a row may spill into its padding
+ */
+static void ScanDepth(float *face, int width, int stride, vec3 verts[3]) {
+    float half = width * 0.5f;
+    vec2 ss_verts[3];
+    float inv_z[3];
+
+    for (int i = 0; i < 3; ++i) {
+        inv_z[i] = 1 / verts[i].z;
+        ss_verts[i] = (vec2) {{ verts[i].x * inv_z[i] * half + half, verts[i].y * inv_z[i] * half + half }};
+    }
+
+    float area = edge(ss_verts[0], ss_verts[1], ss_verts[2]);
+
+    /* Front faces wind clockwise on screen, as in the main rasterizer */
+    if (area >= 0)
+        return;
+
+    float rcp_area = 1 / area;
+
+    int min_x = SDL_clamp(SDL_floorf(SDL_min(ss_verts[0].x, SDL_min(ss_verts[1].x, ss_verts[2].x))), 0, width);
+    int max_x = SDL_clamp(SDL_ceilf(SDL_max(ss_verts[0].x, SDL_max(ss_verts[1].x, ss_verts[2].x))), 0, width);
+    int min_y = SDL_clamp(SDL_floorf(SDL_min(ss_verts[0].y, SDL_min(ss_verts[1].y, ss_verts[2].y))), 0, width);
+    int max_y = SDL_clamp(SDL_ceilf(SDL_max(ss_verts[0].y, SDL_max(ss_verts[1].y, ss_verts[2].y))), 0, width);
+
+    DepthPlane weights[3] = {
+        Weight(ss_verts[1], ss_verts[2], rcp_area),
+        Weight(ss_verts[2], ss_verts[0], rcp_area),
+        Weight(ss_verts[0], ss_verts[1], rcp_area)
+    };
+
+    /* Reciprocal depth is linear on screen, so it is interpolated as a plane of its own */
+    DepthPlane rcp_depth = {};
+
+    for (int i = 0; i < 3; ++i) {
+        rcp_depth.a += weights[i].a * inv_z[i];
+        rcp_depth.b += weights[i].b * inv_z[i];
+        rcp_depth.c += weights[i].c * inv_z[i];
+    }
+
+    for (int y = min_y; y < max_y; ++y) {
+        sd_float *row = (sd_float *)(face + y * stride);
+
+        for (int x = min_x / SD_LENGTH * SD_LENGTH; x < max_x; x += SD_LENGTH) {
+            sd_float texel_x = sd_float_add(sd_float_range(), sd_float_set(x));
+            sd_mask outside = sd_mask_set(false);
+
+            for (int i = 0; i < 3; ++i) {
+                sd_float weight = sd_float_fmadd(sd_float_set(weights[i].a), texel_x, sd_float_set(weights[i].b * y + weights[i].c));
+                outside = sd_mask_or(outside, sd_float_lt(weight, sd_float_zero()));
+            }
+
+            sd_float depth = sd_float_rcp(sd_float_fmadd(sd_float_set(rcp_depth.a), texel_x, sd_float_set(rcp_depth.b * y + rcp_depth.c)));
+            sd_float *texels = row + x / SD_LENGTH;
+            *texels = sd_float_mask_blend(sd_float_min(*texels, depth), *texels, outside);
+        }
+    }
+}
+
+/* Clips a light relative triangle to the near plane of each face it may cover, and scans the pieces */
+static void DrawTriangle(M7_ShadowMap *shadow, vec3 verts[3]) {
+    for (int f = 0; f < 6; ++f) {
+        FaceAxes axes = face_axes[f];
+        vec3 fs_verts[3];
+        int outside[5] = {};
+
+        for (int i = 0; i < 3; ++i) {
+            fs_verts[i] = (vec3) {{ vec3_dot(axes.right, verts[i]), vec3_dot(axes.down, verts[i]), vec3_dot(axes.forward, verts[i]) }};
+            outside[0] += fs_verts[i].z < M7_SHADOW_NEAR;
+            outside[1] += fs_verts[i].x > fs_verts[i].z;
+            outside[2] += fs_verts[i].x < -fs_verts[i].z;
+            outside[3] += fs_verts[i].y > fs_verts[i].z;
+            outside[4] += fs_verts[i].y < -fs_verts[i].z;
+        }
+
+        if (outside[0] == 3 || outside[1] == 3 || outside[2] == 3 || outside[3] == 3 || outside[4] == 3)
+            continue;
+
+        vec3 clipped[4];
+        int nclipped = 0;
+
+        for (int i = 0; i < 3; ++i) {
+            vec3 curr = fs_verts[i];
+            vec3 next = fs_verts[(i + 1) % 3];
+
+            if (curr.z >= M7_SHADOW_NEAR)
+                clipped[nclipped++] = curr;
+
+            if ((curr.z < M7_SHADOW_NEAR) != (next.z < M7_SHADOW_NEAR)) {
+                vec3 path = vec3_sub(next, curr);
+                clipped[nclipped++] = vec3_add(curr, vec3_mul(path, (M7_SHADOW_NEAR - curr.z) / path.z));
+            }
+        }
+
+        float *face = shadow->depth + (size_t)f * shadow->width * shadow->stride;
+
+        for (int i = 1; i < nclipped - 1; ++i)
+            ScanDepth(face, shadow->width, shadow->stride, (vec3 []) { clipped[0], clipped[i], clipped[i + 1] });
+    }
+}
+
+static void RenderShadowMap(M7_ActiveLight *light, M7_World *world, vec3 ws_pos) {
+    M7_ShadowMap *shadow = light->shadow;
+
+    if (!shadow->depth) {
+        shadow->stride = sd_bounding_size(shadow->width) * SD_LENGTH;
+        shadow->depth = SDL_aligned_alloc(SD_ALIGN, sizeof(float) * 6 * shadow->width * shadow->stride);
+    }
+
+    size_t ntexels = (size_t)6 * shadow->width * shadow->stride;
+
+    for (size_t i = 0; i < ntexels; ++i)
+        shadow->depth[i] = FLT_MAX;
+
+    /* Placements' ws_xforms may lag their world xforms in the BVH, so the query reaches a little past the light */
+    List(M7_Placement *) *placements = List_Create(M7_Placement *);
+
+    if (light->radius) {
+        M7_WorldBVH_QuerySphere(world, ws_pos, light->radius + SHADOW_QUERY_SLACK, placements);
+    } else {
+        List_ForEach(world->geometry, wg, {
+            List_ForEach(wg->placements, placement, List_Push(placements, placement); );
+        });
+    }
+
+    vec3 *ls_verts = nullptr;
+    size_t capacity = 0;
+
+    List_ForEach(placements, placement, {
+        M7_WorldGeometry *wg = placement->geometry;
+
+        if (!List_Length(wg->instances) || placement == light->emitter || !InReach(light, ws_pos, wg, placement->ws_xform))
+            continue;
+
+        if (capacity < wg->mesh->nverts) {
+            capacity = wg->mesh->nverts;
+            SDL_free(ls_verts);
+            ls_verts = SDL_malloc(sizeof(vec3) * capacity);
+        }
+
+        /* Vertices relative to the light */
+        xform3 ls_xform = { placement->ws_xform.basis, vec3_sub(placement->ws_xform.translation, ws_pos) };
+
+        for (size_t j = 0; j < wg->mesh->nverts; ++j)
+            ls_verts[j] = xform3_apply(ls_xform, M7_Mesh_Vert(wg->mesh, j));
+
+        for (size_t j = 0; j < wg->mesh->nfaces; ++j) {
+            size_t *idx = wg->mesh->faces[j].idx_verts;
+            DrawTriangle(shadow, (vec3 []) { ls_verts[idx[0]], ls_verts[idx[1]], ls_verts[idx[2]] });
+        }
+    });
+
+    SDL_free(ls_verts);
+    List_Free(placements);
+
+    shadow->ws_pos = ws_pos;
+    shadow->generation = world->generation;
+    shadow->stale = false;
+}
+
+/*
+ * Marks shadow maps stale when their light moves, when geometry is registered, placed or freed, or when a placement
+ * moves from or into the light's reach, then re-renders the stale maps. Geometry and lights must have been composed
+ * into world space by M7_World_Xform
+ */
+void SD_VARIANT(M7_LightEnvironment_Shadow)(M7_LightEnvironment *env, M7_World *world) {
+    size_t nlights = List_Length(env->lights);
+
+    for (size_t i = 0; i < nlights; ++i) {
+        M7_ActiveLight *light = List_Get(env->lights, i);
+
+        if (!light->shadow)
+            continue;
+
+        vec3 offset = vec3_sub(light->world_pos, light->shadow->ws_pos);
+
+        if (light->shadow->generation != world->generation || vec3_dot(offset, offset) > SHADOW_MOVE_EPSILON * SHADOW_MOVE_EPSILON)
+            light->shadow->stale = true;
+    }
+
+    List_ForEach(world->geometry, wg, {
+        List_ForEach(wg->placements, placement, {
+            if (XformsNear(placement->world_xform, placement->ws_xform))
+                continue;
+
+            for (size_t i = 0; i < nlights; ++i) {
+                M7_ActiveLight *light = List_Get(env->lights, i);
+
+                if (!light->shadow || light->shadow->stale || placement == light->emitter)
+                    continue;
+
+                if (InReach(light, light->shadow->ws_pos, wg, placement->ws_xform) || InReach(light, light->shadow->ws_pos, wg, placement->world_xform))
+                    light->shadow->stale = true;
+            }
+
+            placement->ws_xform = placement->world_xform;
+        });
+    });
+
+    for (size_t i = 0; i < nlights; ++i) {
+        M7_ActiveLight *light = List_Get(env->lights, i);
+
+        if (light->shadow && light->shadow->stale)
+            RenderShadowMap(light, world, light->world_pos);
+    }
+}
+
+#ifndef SD_SRC_VARIANT
+
+M7_ShadowMap *M7_ShadowMap_Create(int width) {
+    M7_ShadowMap *shadow = SDL_malloc(sizeof(M7_ShadowMap));
+
+    *shadow = (M7_ShadowMap) {
+        .depth = nullptr,
+        .width = width,
+        .stale = true
+    };
+
+    return shadow;
+}
+
+void M7_ShadowMap_Free(M7_ShadowMap *shadow) {
+    SDL_aligned_free(shadow->depth);
+    SDL_free(shadow);
+}
+
+#endif /* SD_SRC_VARIANT */
@@ -1,8 +1,12 @@
+#include <SDL3/SDL.h>
 #include <M7/ECS.h>
 #include <M7/M7_ECS.h>
+#include <M7/Collections/List.h>
 #include <M7/Math/linalg.h>
 #include <M7/Math/stride.h>
 
+#include "M7_3D_c.h"
+
 sd_vec2 SD_VARIANT(M7_ProjectParallel)(ECS_Handle *self, sd_vec3 pos, sd_vec2 midpoint) {
     M7_ParallelProjector *parallel_projector = ECS_Entity_GetComponent(self, M7_Components.ParallelProjector);
     sd_vec2 projected = sd_vec2_fmadd(sd_vec2_set(parallel_projector->slope.x, parallel_projector->slope.y), pos.z, pos.xy);
@@ -30,13 +34,128 @@ xform3 M7_Entity_GetXform(ECS_Handle *self) {
     };
 }
 
-void M7_Entity_Xform(ECS_Handle *self, xform3 lhs) {
-    M7_XformComposer *compose = ECS_Entity_GetComponent(self, M7_Components.XformComposer);
-    if (!compose) return;
+/*
+ * Composes the entity again on the next M7_World_Xform, and marks the way down to it from the world so clean
+ * subtrees can be skipped. Marking stops at the first ancestor already marked, as everything above it is as well
+ */
+void M7_Entity_InvalidateXform(ECS_Handle *self) {
+    M7_XformNode *node = ECS_Entity_GetComponent(self, M7_Components.XformComposer);
+    if (!node) return;
+
+    node->stale = true;
+
+    for (ECS_Handle *e = self; (e = ECS_Entity_AncestorWithComponent(e, M7_Components.XformComposer, false)); ) {
+        M7_XformNode *above = ECS_Entity_GetComponent(e, M7_Components.XformComposer);
+        if (above->dirty_below) break;
+        above->dirty_below = true;
+    }
+}
+
+void M7_Entity_SetPosition(ECS_Handle *self, vec3 position) {
+    vec3 *current = ECS_Entity_GetComponent(self, M7_Components.Position);
+    if (!SDL_memcmp(current, &position, sizeof(vec3))) return;
+
+    *current = position;
+    M7_Entity_InvalidateXform(self);
+}
+
+void M7_Entity_SetBasis(ECS_Handle *self, mat3x3 basis) {
+    mat3x3 *current = ECS_Entity_GetComponent(self, M7_Components.Basis);
+    if (!SDL_memcmp(current, &basis, sizeof(mat3x3))) return;
+
+    *current = basis;
+    M7_Entity_InvalidateXform(self);
+}
+
+/* Shared by XformComposer, Position and Basis, so entities attached below an already composed world get composed */
+void M7_Xform_Attach(ECS_Handle *self, ECS_Component(void) *component) {
+    (void)component;
+    M7_Entity_InvalidateXform(self);
+}
+
+void M7_XformNode_Init(void *component, void *args) {
+    M7_XformNode *node = component;
+
+    *node = (M7_XformNode) {
+        .compose = *(M7_XformComposer *)args,
+        .stale = true
+    };
+}
+
+static void ComposeWorld(ECS_Handle *self, M7_World *world, xform3 lhs, bool moved) {
+    M7_XformNode *node = ECS_Entity_GetComponent(self, M7_Components.XformComposer);
+    if (!node) return;
+
+    if (node->compose != M7_XformComposeDefault) {
+        List_Push(world->view_xforms, ((M7_ViewXform) { self, lhs }));
+        node->stale = node->dirty_below = false;
+        return;
+    }
+
+    if (moved || node->stale) {
+        node->world = xform3_apply(lhs, M7_Entity_GetXform(self));
+        node->stale = false;
+        moved = true;
+        ECS_Entity_ProcessSystemGroup(self, M7_SystemGroups.OnXform, node->world);
+    } else if (!node->dirty_below && !node->view_below) {
+        return;
+    }
+
+    /* Children that are skipped keep their flags, which still hold as nothing below them changed */
+    node->dirty_below = node->view_below = false;
+
+    ECS_Entity_ForEachChild(self, c, {
+        ComposeWorld(c, world, node->world, moved);
+
+        M7_XformNode *child = ECS_Entity_GetComponent(c, M7_Components.XformComposer);
+        if (child && (child->view_below || child->compose != M7_XformComposeDefault))
+            node->view_below = true;
+    });
+}
+
+static void ComposeView(ECS_Handle *self, xform3 lhs, xform3 vs2ws_xform) {
+    M7_XformNode *node = ECS_Entity_GetComponent(self, M7_Components.XformComposer);
+    if (!node) return;
+
+    xform3 composed = node->compose(self, lhs);
+    ECS_Entity_ProcessSystemGroup(self, M7_SystemGroups.OnXform, xform3_apply(vs2ws_xform, composed));
+    ECS_Entity_ForEachChild(self, c, ComposeView(c, composed, vs2ws_xform); );
+}
+
+/*
+ * Composes the hierarchy below a world into world space, dispatching OnXform with the result. Entities are only
+ * composed again when they were invalidated, through M7_Entity_SetPosition, M7_Entity_SetBasis or
+ * M7_Entity_InvalidateXform, or one above them moved, and only subtrees leading to those are walked. Subtrees below
+ * composers other than M7_XformComposeDefault depend on the view, and are left to M7_World_ViewXform
+ */
+void M7_World_Xform(ECS_Handle *self) {
+    M7_World *world = ECS_Entity_GetComponent(self, M7_Components.World);
+    List_Clear(world->view_xforms);
+    ComposeWorld(self, world, (xform3) { mat3x3_identity, vec3_zero }, false);
+}
+
+/*
+ * Brings placements and lights into view space, and composes the subtrees that depend on the view in full,
+ * dispatching OnXform with their world space xforms ahead of that
+ */
+void M7_World_ViewXform(ECS_Handle *self, M7_LightEnvironment *env, xform3 ws2vs_xform, xform3 vs2ws_xform) {
+    M7_World *world = ECS_Entity_GetComponent(self, M7_Components.World);
+
+    List_ForEach(world->view_xforms, view_xform, ComposeView(view_xform.self, xform3_apply(ws2vs_xform, view_xform.lhs), vs2ws_xform); );
+
+    List_ForEach(world->geometry, wg, {
+        List_ForEach(wg->placements, placement, {
+            xform3 xform = xform3_apply(ws2vs_xform, placement->world_xform);
+
+            if (SDL_memcmp(&placement->xform, &xform, sizeof(xform3))) {
+                placement->xform = xform;
+                placement->version += 1;
+            }
+        });
+    });
 
-    xform3 composed = (*compose)(self, lhs);
-    ECS_Entity_ProcessSystemGroup(self, M7_SystemGroups.OnXform, composed);
-    ECS_Entity_ForEachChild(self, c, M7_Entity_Xform(c, composed); );
+    if (env)
+        List_ForEach(env->lights, light, light->pos = xform3_apply(ws2vs_xform, light->world_pos); );
 }
 
 xform3 M7_XformComposeDefault(ECS_Handle *self, xform3 lhs) {
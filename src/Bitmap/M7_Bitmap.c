@@ -15,11 +15,18 @@ void M7_Bitmap_RegisterToECS(ECS *ecs) {
         .free = M7_Viewport_Free
     });
 
+    M7_Components.Offscreen = ECS_RegisterComponent(ecs, M7_Offscreen, {
+        .attach = M7_Offscreen_Attach,
+        .init = M7_Offscreen_Init,
+        .free = M7_Offscreen_Free
+    });
+
     M7_Components.TextureBank = ECS_RegisterComponent(ecs, M7_ResourceBank, {
         .attach = M7_TextureBank_Attach,
         .detach = M7_ResourceBank_Detach
     });
 
     ECS_SystemGroup_RegisterSystem(M7_SystemGroups.RenderPresent, SD_SELECT(M7_Canvas_Present), M7_Components.Viewport, M7_Components.Canvas);
+    ECS_SystemGroup_RegisterSystem(M7_SystemGroups.RenderPresent, SD_SELECT(M7_Canvas_PresentOffscreen), M7_Components.Offscreen, M7_Components.Canvas);
 }
 
@@ -7,7 +7,14 @@
 void M7_Viewport_Init(void *component, void *args);
 void M7_Viewport_Free(void *component);
 
+void M7_Offscreen_Init(void *component, void *args);
+void M7_Offscreen_Free(void *component);
+void M7_Offscreen_Attach(ECS_Handle *self, ECS_Component(void) *component);
+void M7_Offscreen_Fit(M7_Offscreen *offscreen, M7_Canvas *canvas);
+void M7_Offscreen_Write(M7_Offscreen *offscreen);
+
 SD_DECLARE_VOID_RETURN(M7_Canvas_Present, ECS_Handle *, self)
+SD_DECLARE_VOID_RETURN(M7_Canvas_PresentOffscreen, ECS_Handle *, self)
 SD_DECLARE_VOID_RETURN(M7_Canvas_Init, void *, component, void *, args)
 void M7_Canvas_Free(void *component);
 
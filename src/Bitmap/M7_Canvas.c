@@ -1,12 +1,16 @@
 #include <SDL3/SDL.h>
 #include <M7/ECS.h>
 #include <M7/M7_ECS.h>
+#include <M7/M7_Profile.h>
 #include <M7/Math/stride.h>
 #include <M7/gamma.h>
 
+#include "M7_Bitmap_c.h"
+
 typedef struct PresentData {
     ECS_Handle *canvas;
     uint32_t *pixels;
+    int stride;
     int start, end;
 } PresentData;
 
@@ -38,7 +42,7 @@ static int PresentThread(void *data) {
                    b = sd_int_and(b, byte);
 
             sd_int out = sd_int_or(r, sd_int_or(g, b));
-            sd_int_store_unaligned((int32_t *)pd->pixels + i * canvas->width + j * SD_LENGTH, out);
+            sd_int_store_unaligned((int32_t *)pd->pixels + i * pd->stride + j * SD_LENGTH, out);
         }
 
         for (int j = 0; j < sd_rem; ++j) {
@@ -51,21 +55,16 @@ static int PresentThread(void *data) {
             uint16_t b = col.b.val * 0xFFFF;
                      b = gamma_encode_lut[b];
 
-            pd->pixels[i * canvas->width + sd_qot * SD_LENGTH + j] = (r << 16) | (g << 8) | b;
+            pd->pixels[i * pd->stride + sd_qot * SD_LENGTH + j] = (r << 16) | (g << 8) | b;
         }
     }
 
     return 0;
 }
 
-void SD_VARIANT(M7_Canvas_Present)(ECS_Handle *self) {
+/* Gamma encodes the canvas into BGRX pixels with a row stride given in pixels */
+static void Encode(ECS_Handle *self, uint32_t *pixels, int stride) {
     M7_Canvas *canvas = ECS_Entity_GetComponent(self, M7_Components.Canvas);
-    M7_Viewport *vp = ECS_Entity_GetComponent(self, M7_Components.Viewport);
-
-    uint32_t *pixels;
-    int pitch;
-
-    SDL_LockTexture(vp->texture, nullptr, (void **)&pixels, &pitch);
 
     SDL_Thread **threads = SDL_malloc(sizeof(SDL_Thread *) * canvas->parallelism);
     PresentData *present_data = SDL_malloc(sizeof(PresentData) * canvas->parallelism);
@@ -77,6 +76,7 @@ void SD_VARIANT(M7_Canvas_Present)(ECS_Handle *self) {
         present_data[i] = (PresentData) {
             .canvas = self,
             .pixels = pixels,
+            .stride = stride,
             .start = i * qot + SDL_min(i, rem),
             .end = (i + 1) * qot + SDL_min(i + 1, rem)
         };
@@ -89,12 +89,32 @@ void SD_VARIANT(M7_Canvas_Present)(ECS_Handle *self) {
 
     SDL_free(present_data);
     SDL_free(threads);
+}
+
+void SD_VARIANT(M7_Canvas_Present)(ECS_Handle *self) {
+    M7_PROFILE_SCOPE(M7_PROFILE_PRESENT);
+    M7_Viewport *vp = ECS_Entity_GetComponent(self, M7_Components.Viewport);
+
+    uint32_t *pixels;
+    int pitch;
 
+    SDL_LockTexture(vp->texture, nullptr, (void **)&pixels, &pitch);
+    Encode(self, pixels, pitch / sizeof(uint32_t));
     SDL_UnlockTexture(vp->texture);
+
     SDL_RenderTexture(vp->renderer, vp->texture, nullptr, nullptr);
     SDL_RenderPresent(vp->renderer);
 }
 
+void SD_VARIANT(M7_Canvas_PresentOffscreen)(ECS_Handle *self) {
+    M7_PROFILE_SCOPE(M7_PROFILE_PRESENT);
+    M7_Offscreen *offscreen = ECS_Entity_GetComponent(self, M7_Components.Offscreen);
+
+    M7_Offscreen_Fit(offscreen, ECS_Entity_GetComponent(self, M7_Components.Canvas));
+    Encode(self, offscreen->pixels, offscreen->width);
+    M7_Offscreen_Write(offscreen);
+}
+
 void SD_VARIANT(M7_Canvas_Init)(void *component, void *args) {
     M7_Canvas *canvas = component, *cargs = args;
 
@@ -0,0 +1,197 @@
+#include <SDL3/SDL.h>
+#include <M7/M7_Bitmap.h>
+#include <M7/M7_Resource.h>
+#include <M7/Math/linalg.h>
+
+#define CHAIN_MAGIC    0x4343374D /* "M7CC" */
+#define CHAIN_VERSION  1
+#define CHAIN_SAMPLES  24
+
+typedef struct ChainHeader {
+    Uint32 magic;
+    Uint32 version;
+    Uint32 crc;
+    Sint32 width;
+    Sint32 nlevels;
+} ChainHeader;
+
+/* Face and face coordinates in [-1, 1] of a direction, matching M7_SampleCubemap */
+static int CubemapTexel(int width, vec3 dir) {
+    vec3 abs_dir = {{ SDL_fabsf(dir.x), SDL_fabsf(dir.y), SDL_fabsf(dir.z) }};
+    int face;
+    float u, v;
+
+    if (abs_dir.x >= abs_dir.y && abs_dir.x >= abs_dir.z) {
+        face = dir.x >= 0 ? 0 : 3;
+        u = (dir.x >= 0 ? -dir.z : dir.z) / abs_dir.x;
+        v = -dir.y / abs_dir.x;
+    } else if (abs_dir.y >= abs_dir.z) {
+        face = dir.y >= 0 ? 1 : 4;
+        u = dir.x / abs_dir.y;
+        v = (dir.y >= 0 ? dir.z : -dir.z) / abs_dir.y;
+    } else {
+        face = dir.z >= 0 ? 2 : 5;
+        u = (dir.z >= 0 ? dir.x : -dir.x) / abs_dir.z;
+        v = -dir.y / abs_dir.z;
+    }
+
+    float unit = width * 0.5f;
+    int x = SDL_clamp((int)(u * unit + unit), 0, width - 1);
+    int y = SDL_clamp((int)(v * unit + unit), 0, width - 1);
+    return (face * width + y) * width + x;
+}
+
+/* Inverse of CubemapTexel for the center of a texel */
+static vec3 CubemapDirection(int width, int face, int x, int y) {
+    float u = (x + 0.5f) / (width * 0.5f) - 1;
+    float v = (y + 0.5f) / (width * 0.5f) - 1;
+
+    switch (face) {
+        case 0:  return (vec3) {{ 1, -v, -u }};
+        case 3:  return (vec3) {{ -1, -v, u }};
+        case 1:  return (vec3) {{ u, 1, v }};
+        case 4:  return (vec3) {{ u, -1, -v }};
+        case 2:  return (vec3) {{ u, -v, 1 }};
+        default: return (vec3) {{ -u, -v, -1 }};
+    }
+}
+
+/* Averages a cone of directions from the previous level, about two texels of this level wide */
+static void Prefilter(M7_Texture *dst, M7_Texture *src) {
+    int width = dst->width;
+    float cone = 4.0f / width;
+
+    for (int face = 0; face < 6; ++face) {
+        for (int y = 0; y < width; ++y) {
+            for (int x = 0; x < width; ++x) {
+                vec3 dir = vec3_normalize(CubemapDirection(width, face, x, y));
+                vec3 tangent = vec3_normalize(vec3_cross(SDL_fabsf(dir.y) < 0.9f ? vec3_j : vec3_i, dir));
+                vec3 bitangent = vec3_cross(dir, tangent);
+
+                float sum[4] = {};
+                float total = 0;
+
+                for (int i = 0; i < CHAIN_SAMPLES; ++i) {
+                    float r = SDL_sqrtf((i + 0.5f) / CHAIN_SAMPLES);
+                    float theta = i * 2.39996323f;
+                    float weight = 1 - r * r;
+
+                    vec3 offset = vec3_add(vec3_mul(tangent, SDL_cosf(theta) * r * cone), vec3_mul(bitangent, SDL_sinf(theta) * r * cone));
+                    float *texel = src->color + CubemapTexel(src->width, vec3_add(dir, offset)) * 4;
+
+                    for (int j = 0; j < 4; ++j)
+                        sum[j] += texel[j] * weight;
+
+                    total += weight;
+                }
+
+                float *out = dst->color + ((face * width + y) * width + x) * 4;
+
+                for (int j = 0; j < 4; ++j)
+                    out[j] = sum[j] / total;
+            }
+        }
+    }
+}
+
+static size_t LevelSize(M7_Texture *level) {
+    return sizeof(float [4]) * level->width * level->height;
+}
+
+static M7_Texture *CreateLevel(int width) {
+    M7_Texture *level = SDL_malloc(sizeof(M7_Texture));
+    level->width = width;
+    level->height = width * 6;
+    level->unit = width * 6;
+    level->color = SDL_malloc(LevelSize(level));
+    return level;
+}
+
+static bool ReadCache(M7_CubemapChain *chain, char *path, ChainHeader *expected) {
+    SDL_IOStream *io = SDL_IOFromFile(path, "rb");
+    ChainHeader header;
+
+    if (!io)
+        return false;
+
+    bool valid = SDL_ReadIO(io, &header, sizeof(header)) == sizeof(header) && !SDL_memcmp(&header, expected, sizeof(header));
+
+    for (int i = 1; valid && i < chain->nlevels; ++i)
+        valid = SDL_ReadIO(io, chain->levels[i]->color, LevelSize(chain->levels[i])) == LevelSize(chain->levels[i]);
+
+    SDL_CloseIO(io);
+    return valid;
+}
+
+static void WriteCache(M7_CubemapChain *chain, char *path, ChainHeader *header) {
+    SDL_CreateDirectory(M7_CACHE_DIR);
+    SDL_IOStream *io = SDL_IOFromFile(path, "wb");
+
+    if (!io) {
+        SDL_Log("Failed to open %s: %s", path, SDL_GetError());
+        return;
+    }
+
+    bool written = SDL_WriteIO(io, header, sizeof(*header)) == sizeof(*header);
+
+    for (int i = 1; written && i < chain->nlevels; ++i)
+        written = SDL_WriteIO(io, chain->levels[i]->color, LevelSize(chain->levels[i])) == LevelSize(chain->levels[i]);
+
+    if (!written)
+        SDL_Log("Failed to write %s: %s", path, SDL_GetError());
+
+    SDL_CloseIO(io);
+}
+
+/*
+ * Builds successively halved, prefiltered levels of a cubemap down to M7_CUBEMAP_CHAIN_MIN_WIDTH.
+ * Level 0 is the cubemap itself. Levels are cached in M7_CACHE_DIR, keyed by the cubemap's contents
+ */
+M7_CubemapChain *M7_CubemapChain_Create(M7_Texture *cubemap) {
+    M7_CubemapChain *chain = SDL_malloc(sizeof(M7_CubemapChain));
+    chain->levels[0] = cubemap;
+    chain->nlevels = 1;
+
+    for (int width = cubemap->width / 2; width >= M7_CUBEMAP_CHAIN_MIN_WIDTH && chain->nlevels < M7_CUBEMAP_CHAIN_LEVELS; width /= 2)
+        chain->levels[chain->nlevels++] = CreateLevel(width);
+
+    ChainHeader header = {
+        .magic = CHAIN_MAGIC,
+        .version = CHAIN_VERSION,
+        .crc = SDL_crc32(0, cubemap->color, LevelSize(cubemap)),
+        .width = cubemap->width,
+        .nlevels = chain->nlevels
+    };
+
+    char *path;
+    SDL_asprintf(&path, "%s/cubemap_%08x_%d.bin", M7_CACHE_DIR, header.crc, header.width);
+
+    if (!ReadCache(chain, path, &header)) {
+        for (int i = 1; i < chain->nlevels; ++i)
+            Prefilter(chain->levels[i], chain->levels[i - 1]);
+
+        WriteCache(chain, path, &header);
+    }
+
+    SDL_free(path);
+    return chain;
+}
+
+/* The coarsest level whose texels are still at most half the given cone angle, in radians */
+M7_Texture *M7_CubemapChain_Level(M7_CubemapChain *chain, float angle) {
+    int level = 0;
+
+    while (level + 1 < chain->nlevels && SDL_PI_F / 2 / chain->levels[level + 1]->width <= angle / 2)
+        ++level;
+
+    return chain->levels[level];
+}
+
+void M7_CubemapChain_Free(M7_CubemapChain *chain) {
+    for (int i = 1; i < chain->nlevels; ++i) {
+        SDL_free(chain->levels[i]->color);
+        SDL_free(chain->levels[i]);
+    }
+
+    SDL_free(chain);
+}
@@ -0,0 +1,96 @@
+#include <SDL3/SDL.h>
+#include <SDL3_image/SDL_image.h>
+#include <M7/ECS.h>
+#include <M7/M7_ECS.h>
+
+#include "M7_Bitmap_c.h"
+
+void M7_Offscreen_Init(void *component, void *args) {
+    M7_Offscreen *offscreen = component;
+    M7_OffscreenArgs *offscreen_args = args;
+
+    offscreen->width = 0;
+    offscreen->height = 0;
+    offscreen->path = offscreen_args->path ? SDL_strdup(offscreen_args->path) : nullptr;
+    offscreen->frame = 0;
+    offscreen->pixels = nullptr;
+}
+
+void M7_Offscreen_Attach(ECS_Handle *self, ECS_Component(void) *component) {
+    M7_Offscreen *offscreen = ECS_Entity_GetComponent(self, component);
+    M7_Canvas *canvas = ECS_Entity_GetComponent(self, M7_Components.Canvas);
+
+    if (canvas)
+        M7_Offscreen_Fit(offscreen, canvas);
+}
+
+/* Reallocates the pixels if the canvas they are encoded from is not the size they were made for */
+void M7_Offscreen_Fit(M7_Offscreen *offscreen, M7_Canvas *canvas) {
+    if (offscreen->pixels && offscreen->width == canvas->width && offscreen->height == canvas->height)
+        return;
+
+    offscreen->width = canvas->width;
+    offscreen->height = canvas->height;
+    offscreen->pixels = SDL_realloc(offscreen->pixels, sizeof(uint32_t) * offscreen->width * offscreen->height);
+}
+
+void M7_Offscreen_Free(void *component) {
+    M7_Offscreen *offscreen = component;
+    SDL_free(offscreen->pixels);
+    SDL_free(offscreen->path);
+}
+
+static void WritePPM(M7_Offscreen *offscreen, char *path) {
+    SDL_IOStream *file = SDL_IOFromFile(path, "wb");
+
+    if (!file) {
+        SDL_Log("Failed to open %s: %s", path, SDL_GetError());
+        return;
+    }
+
+    size_t npixels = (size_t)offscreen->width * offscreen->height;
+    Uint8 *rgb = SDL_malloc(npixels * 3);
+
+    for (size_t i = 0; i < npixels; ++i) {
+        uint32_t pixel = offscreen->pixels[i];
+        rgb[i * 3 + 0] = pixel >> 16;
+        rgb[i * 3 + 1] = pixel >> 8;
+        rgb[i * 3 + 2] = pixel;
+    }
+
+    SDL_IOprintf(file, "P6\n%d %d\n255\n", offscreen->width, offscreen->height);
+    SDL_WriteIO(file, rgb, npixels * 3);
+    SDL_CloseIO(file);
+    SDL_free(rgb);
+}
+
+static void WritePNG(M7_Offscreen *offscreen, char *path) {
+    SDL_Surface *surface = SDL_CreateSurfaceFrom(
+        offscreen->width,
+        offscreen->height,
+        SDL_PIXELFORMAT_BGRX32,
+        offscreen->pixels,
+        offscreen->width * sizeof(uint32_t)
+    );
+
+    if (!surface || !IMG_SavePNG(surface, path))
+        SDL_Log("Failed to write %s: %s", path, SDL_GetError());
+
+    SDL_DestroySurface(surface);
+}
+
+/* Path is a printf pattern taking the frame number, e.g. "frames/%04d.ppm" */
+void M7_Offscreen_Write(M7_Offscreen *offscreen) {
+    int frame = offscreen->frame++;
+    if (!offscreen->path) return;
+
+    char path[256];
+    SDL_snprintf(path, sizeof(path), offscreen->path, frame);
+
+    char *ext = SDL_strrchr(path, '.');
+
+    if (ext && !SDL_strcasecmp(ext, ".png"))
+        WritePNG(offscreen, path);
+    else
+        WritePPM(offscreen, path);
+}
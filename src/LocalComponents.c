@@ -33,8 +33,7 @@ void FreeCam_Update(ECS_Handle *self, double delta) {
         return;
 
     FreeCam *cam = ECS_Entity_GetComponent(self, Components.FreeCam);
-    vec3 *pos = ECS_Entity_GetComponent(self, M7_Components.Position);
-    mat3x3 *basis = ECS_Entity_GetComponent(self, M7_Components.Basis);
+    vec3 pos = *ECS_Entity_GetComponent(self, M7_Components.Position);
 
     vec3 input_axis = vec3_zero;
 
@@ -53,7 +52,7 @@ void FreeCam_Update(ECS_Handle *self, double delta) {
 
     input_axis = (vec3_eq(input_axis, vec3_zero)) ? vec3_zero : vec3_normalize(input_axis);
     input_axis = vec3_rotate(input_axis, vec3_j, cam->yaw);
-    *pos = vec3_add(*pos, vec3_mul(input_axis, 250 * delta));
+    M7_Entity_SetPosition(self, vec3_add(pos, vec3_mul(input_axis, 250 * delta)));
 
     vec2 mouse_motion = M7_InputState_GetMouseMotion(is);
 
@@ -66,10 +65,10 @@ void FreeCam_Update(ECS_Handle *self, double delta) {
     float fov_curr = ECS_Entity_GetComponent(fov, M7_Components.PerspectiveFOV)->fov;
     M7_PerspectiveFOV_Set(fov, SDL_clamp(fov_curr - M7_InputState_GetWheelMotion(is).y * 16 * delta, 30 * SDL_PI_F / 180, 150 * SDL_PI_F / 180));
 
-    *basis = mat3x3_rotate(
+    M7_Entity_SetBasis(self, mat3x3_rotate(
         mat3x3_rotate(mat3x3_identity, vec3_i, cam->pitch),
         vec3_j, cam->yaw
-    );
+    ));
 }
 
 void RegisterToECS(ECS *ecs) {
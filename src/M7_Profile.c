@@ -0,0 +1,206 @@
+#include <SDL3/SDL.h>
+#include <M7/M7_Profile.h>
+
+#define MAX_LANES    64
+#define LANE_EVENTS  ( 1 << 14 )
+
+typedef struct ProfileEvent {
+    Uint64 start, end;
+    M7_ProfileStage stage;
+    bool summed;
+} ProfileEvent;
+
+/* Threads claim a lane on first use and give it back when they exit */
+typedef struct ProfileLane {
+    SDL_AtomicInt claimed;
+    ProfileEvent *events;
+    Uint64 nevents;
+    Uint64 accum[M7_PROFILE_STAGE_COUNT];
+    Uint64 accum_start[M7_PROFILE_STAGE_COUNT];
+    Uint64 frame_ticks[M7_PROFILE_STAGE_COUNT];
+} ProfileLane;
+
+static ProfileLane lanes[MAX_LANES];
+static SDL_AtomicInt nlanes;
+static SDL_TLSID lane_tls;
+static thread_local ProfileLane *current_lane;
+
+static Uint64 base_ticks, base_counter, frame_start;
+static double ms_per_tick;
+
+static double history[M7_PROFILE_HISTORY][M7_PROFILE_STAGE_COUNT];
+static int history_length, history_next;
+
+static const char *stage_names[M7_PROFILE_STAGE_COUNT] = {
+    [M7_PROFILE_FRAME] = "frame",
+    [M7_PROFILE_ECS_UPDATE] = "ecs_update",
+    [M7_PROFILE_XFORM] = "xform",
+    [M7_PROFILE_SHADOW] = "shadow",
+    [M7_PROFILE_VERTEX] = "vertex",
+    [M7_PROFILE_OCCLUSION] = "occlusion",
+    [M7_PROFILE_RASTERIZE] = "rasterize",
+    [M7_PROFILE_DRAW_BATCH] = "draw_batch",
+    [M7_PROFILE_SCAN] = "scan",
+    [M7_PROFILE_SHADE] = "shade",
+    [M7_PROFILE_BACKGROUND] = "background",
+    [M7_PROFILE_PRESENT] = "present"
+};
+
+static void Record(ProfileLane *lane, M7_ProfileStage stage, Uint64 start, Uint64 end, bool summed) {
+    lane->events[lane->nevents++ % LANE_EVENTS] = (ProfileEvent) { start, end, stage, summed };
+    lane->frame_ticks[stage] += end - start;
+}
+
+static void Flush(ProfileLane *lane) {
+    for (int i = 0; i < M7_PROFILE_STAGE_COUNT; ++i) {
+        if (lane->accum[i])
+            Record(lane, i, lane->accum_start[i], lane->accum_start[i] + lane->accum[i], true);
+
+        lane->accum[i] = 0;
+    }
+}
+
+static void ReleaseLane(void *data) {
+    ProfileLane *lane = data;
+    Flush(lane);
+    SDL_SetAtomicInt(&lane->claimed, 0);
+}
+
+static ProfileLane *GetLane(void) {
+    if (current_lane)
+        return current_lane;
+
+    for (int i = 0; i < MAX_LANES; ++i) {
+        if (!SDL_CompareAndSwapAtomicInt(&lanes[i].claimed, 0, 1))
+            continue;
+
+        if (!lanes[i].events)
+            lanes[i].events = SDL_malloc(sizeof(ProfileEvent) * LANE_EVENTS);
+
+        for (int used = SDL_GetAtomicInt(&nlanes); used < i + 1; used = SDL_GetAtomicInt(&nlanes))
+            if (SDL_CompareAndSwapAtomicInt(&nlanes, used, i + 1)) break;
+
+        current_lane = lanes + i;
+        SDL_SetTLS(&lane_tls, current_lane, ReleaseLane);
+        return current_lane;
+    }
+
+    /* Out of lanes, samples from this thread are dropped */
+    return nullptr;
+}
+
+void M7_Profile_End(M7_ProfileScope *scope) {
+    Uint64 end = M7_Profile_Now();
+    ProfileLane *lane = GetLane();
+
+    if (lane)
+        Record(lane, scope->stage, scope->start, end, false);
+}
+
+void M7_Profile_Accumulate(M7_ProfileScope *scope) {
+    Uint64 end = M7_Profile_Now();
+    ProfileLane *lane = GetLane();
+
+    if (!lane)
+        return;
+
+    if (!lane->accum[scope->stage])
+        lane->accum_start[scope->stage] = scope->start;
+
+    lane->accum[scope->stage] += end - scope->start;
+}
+
+void M7_Profile_FrameBegin(void) {
+    frame_start = M7_Profile_Now();
+
+    if (!base_ticks) {
+        base_ticks = frame_start;
+        base_counter = SDL_GetPerformanceCounter();
+    }
+}
+
+/* Must be called from the frame's thread once all workers of the frame have been joined */
+void M7_Profile_FrameEnd(void) {
+    ProfileLane *lane = GetLane();
+    Uint64 end = M7_Profile_Now();
+
+    if (lane) {
+        Record(lane, M7_PROFILE_FRAME, frame_start, end, false);
+        Flush(lane);
+    }
+
+    /* Calibrate ticks against the performance counter over the whole profiled run */
+    Uint64 elapsed_counter = SDL_GetPerformanceCounter() - base_counter;
+
+    if (end > base_ticks)
+        ms_per_tick = (double)elapsed_counter * 1000 / SDL_GetPerformanceFrequency() / (end - base_ticks);
+
+    double *frame = history[history_next];
+    history_next = (history_next + 1) % M7_PROFILE_HISTORY;
+    history_length = SDL_min(history_length + 1, M7_PROFILE_HISTORY);
+
+    for (int i = 0; i < M7_PROFILE_STAGE_COUNT; ++i) {
+        Uint64 ticks = 0;
+
+        for (int j = 0; j < SDL_GetAtomicInt(&nlanes); ++j) {
+            ticks += lanes[j].frame_ticks[i];
+            lanes[j].frame_ticks[i] = 0;
+        }
+
+        frame[i] = ticks * ms_per_tick;
+    }
+}
+
+const char *M7_Profile_StageName(M7_ProfileStage stage) {
+    return stage < M7_PROFILE_STAGE_COUNT ? stage_names[stage] : "unknown";
+}
+
+/* Averaged over the last M7_PROFILE_HISTORY frames */
+M7_ProfileAverages M7_Profile_GetAverages(void) {
+    M7_ProfileAverages averages = { .frames = history_length };
+
+    for (int i = 0; i < history_length; ++i)
+        for (int j = 0; j < M7_PROFILE_STAGE_COUNT; ++j)
+            averages.ms[j] += history[i][j] / history_length;
+
+    return averages;
+}
+
+/* Writes the events still held in the lane ring buffers as Chrome trace-event JSON */
+bool M7_Profile_WriteTrace(const char *path) {
+    if (!ms_per_tick)
+        return false;
+
+    SDL_IOStream *file = SDL_IOFromFile(path, "w");
+
+    if (!file)
+        return false;
+
+    SDL_IOprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    SDL_IOprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"M7\"}}");
+
+    for (int i = 0; i < SDL_GetAtomicInt(&nlanes); ++i) {
+        ProfileLane *lane = lanes + i;
+        Uint64 first = lane->nevents > LANE_EVENTS ? lane->nevents - LANE_EVENTS : 0;
+
+        SDL_IOprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"lane %d\"}}", i, i);
+
+        for (Uint64 j = first; j < lane->nevents; ++j) {
+            ProfileEvent event = lane->events[j % LANE_EVENTS];
+
+            if (event.start < base_ticks)
+                continue;
+
+            SDL_IOprintf(file, ",\n{\"name\":\"%s%s\",\"cat\":\"M7\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                stage_names[event.stage],
+                event.summed ? " (summed)" : "",
+                i,
+                (event.start - base_ticks) * ms_per_tick * 1000,
+                (event.end - event.start) * ms_per_tick * 1000
+            );
+        }
+    }
+
+    SDL_IOprintf(file, "\n]}\n");
+    return SDL_CloseIO(file);
+}
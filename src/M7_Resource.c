@@ -5,21 +5,39 @@
 #include <M7/M7_Resource.h>
 
 void *M7_ResourceBank_GetActual(ECS_Handle *self, ECS_Component(void) *component, char *path) {
+    M7_ResourceBank *bank = ECS_Entity_GetComponent(self, component);
+    void *data = M7_ResourceBank_FindActual(self, component, path);
+
+    if (data)
+        return data;
+
+    data = bank->load(self, path);
+    M7_ResourceBank_Add(self, component, path, data);
+    return data;
+}
+
+/* Takes a reference to a resource if it's loaded, for banks whose resources are built by their users */
+void *M7_ResourceBank_FindActual(ECS_Handle *self, ECS_Component(void) *component, char *path) {
     M7_ResourceBank *bank = ECS_Entity_GetComponent(self, component);
     M7_Resource *resource = Strmap_GetAddress(bank->map, path);
 
-    if (resource) {
-        resource->refcount += 1;
-        return resource->data;
-    }
-    
+    if (!resource)
+        return nullptr;
+
+    resource->refcount += 1;
+    return resource->data;
+}
+
+/* Hands a resource to the bank, holding one reference to it */
+void M7_ResourceBank_Add(ECS_Handle *self, ECS_Component(void) *component, char *path, void *data) {
+    M7_ResourceBank *bank = ECS_Entity_GetComponent(self, component);
+
     M7_Resource new_resource = {
-        .data = bank->load(self, path),
+        .data = data,
         .refcount = 1
     };
 
     Strmap_Set(bank->map, path, new_resource);
-    return new_resource.data;
 }
 
 void M7_ResourceBank_Release(ECS_Handle *self, ECS_Component(void) *component, char *path) {
@@ -1,6 +1,7 @@
 #include <SDL3/SDL.h>
 #include <M7/ECS.h>
 #include <M7/M7_ECS.h>
+#include <M7/M7_Profile.h>
 #include <stdio.h>
 
 #define SDL_MAIN_USE_CALLBACKS
@@ -13,7 +14,6 @@
 #define FPS_CAP  60
 
 enum RenderBatches {
-    Sky,
     Opaque
 };
 
@@ -36,6 +36,7 @@ SDL_AppResult SDL_AppInit(void **appstate, int argc, char **argv) {
         }},
         { M7_Components.InputState, nullptr },
         { M7_Components.TextureBank, nullptr },
+        { M7_Components.MeshBank, nullptr },
         { M7_Components.Canvas, &(M7_Canvas){
             .width = WIDTH,
             .height = HEIGHT,
@@ -63,7 +64,8 @@ SDL_AppResult SDL_AppInit(void **appstate, int argc, char **argv) {
                             .project = SD_SELECT(M7_ProjectPerspective),
                             .scan = SD_SELECT(M7_ScanPerspective),
                             .near = 1,
-                            .parallelism = SDL_GetNumLogicalCPUCores()
+                            .parallelism = SDL_GetNumLogicalCPUCores(),
+                            .sky_background = true
                         }},
                         { M7_Components.Position, &(vec3){} },
                         { M7_Components.Basis, (mat3x3 []){mat3x3_identity} },
@@ -99,7 +101,7 @@ SDL_AppResult SDL_AppInit(void **appstate, int argc, char **argv) {
                         { M7_Components.Basis, (mat3x3 []){mat3x3_rotate(mat3x3_identity, vec3_i, SDL_PI_F / 2)} },
                         { M7_Components.MeshPrimitive, nullptr },
                         { M7_Components.Rect, &(M7_Rect) { .width=2000, .height=2000 } },
-                        { M7_Components.Model, &(M7_ModelArgs) { .get_mesh = M7_Rect_GetMesh }},
+                        { M7_Components.Model, &(M7_ModelArgs) { .get_mesh = M7_Rect_GetMesh, .occluder = true }},
                         { M7_Components.XformComposer, &(M7_XformComposer){M7_XformComposeDefault} }
                     ),
                     ECS_Children({ECS_Components(
@@ -119,7 +121,7 @@ SDL_AppResult SDL_AppInit(void **appstate, int argc, char **argv) {
                         }}
                     )})
                 },
-                { /* Light */
+                { /* Lights, placements of one sphere model that sits at the first of them */
                     ECS_Components(
                         { M7_Components.Position, &(vec3){ .x=-150, .y=-115, .z=400 } },
                         { M7_Components.Basis, (mat3x3 []){mat3x3_identity} },
@@ -129,99 +131,40 @@ SDL_AppResult SDL_AppInit(void **appstate, int argc, char **argv) {
                         { M7_Components.XformComposer, &(M7_XformComposer){M7_XformComposeDefault} },
                         { M7_Components.PointLight, &(M7_PointLight) { .col={{ 1.0, 0.8, 0.2 }}, .energy=20000 } }
                     ),
-                    ECS_Children({ECS_Components(
-                        { M7_Components.SolidColor, &(M7_SolidColor) { .r=1, .g=1, .b=1 }},
-                        { M7_Components.ModelInstance, &(M7_ModelInstanceArgs) {
-                            .shader_components = (ECS_Component(M7_ShaderComponent) *[]) { M7_Components.SolidColor },
-                            .nshaders = 1,
-                            .render_batch = Opaque,
-                            .flags = M7_RASTERIZER_CULL_BACKFACE
-                                   | M7_RASTERIZER_TEST_DEPTH
-                                   | M7_RASTERIZER_WRITE_DEPTH
-                        }}
-                    )})
-                },
-                { /* Light */
-                    ECS_Components(
-                        { M7_Components.Position, &(vec3){ .x=150, .y=-115, .z=400 } },
-                        { M7_Components.Basis, (mat3x3 []){mat3x3_identity} },
-                        { M7_Components.MeshPrimitive, nullptr },
-                        { M7_Components.Sphere, &(M7_Sphere) { .radius=32, .nrings=16, .ring_precision=16 } },
-                        { M7_Components.Model, &(M7_ModelArgs) { .get_mesh = M7_Sphere_GetMesh }},
-                        { M7_Components.XformComposer, &(M7_XformComposer){M7_XformComposeDefault} },
-                        { M7_Components.PointLight, &(M7_PointLight) { .col={{ 0.2, 1.0, 0.5 }}, .energy=20000 } }
-                    ),
-                    ECS_Children({ECS_Components(
-                        { M7_Components.SolidColor, &(M7_SolidColor) { .r=1, .g=1, .b=1 }},
-                        { M7_Components.ModelInstance, &(M7_ModelInstanceArgs) {
-                            .shader_components = (ECS_Component(M7_ShaderComponent) *[]) { M7_Components.SolidColor },
-                            .nshaders = 1,
-                            .render_batch = Opaque,
-                            .flags = M7_RASTERIZER_CULL_BACKFACE
-                                   | M7_RASTERIZER_TEST_DEPTH
-                                   | M7_RASTERIZER_WRITE_DEPTH
-                        }}
-                    )})
-                },
-                { /* Light */
-                    ECS_Components(
-                        { M7_Components.Position, &(vec3){ .x=-150, .y=-115, .z=800 } },
-                        { M7_Components.Basis, (mat3x3 []){mat3x3_identity} },
-                        { M7_Components.MeshPrimitive, nullptr },
-                        { M7_Components.Sphere, &(M7_Sphere) { .radius=32, .nrings=16, .ring_precision=16 } },
-                        { M7_Components.Model, &(M7_ModelArgs) { .get_mesh = M7_Sphere_GetMesh }},
-                        { M7_Components.XformComposer, &(M7_XformComposer){M7_XformComposeDefault} },
-                        { M7_Components.PointLight, &(M7_PointLight) { .col={{ 1.0, 0.2, 0.1 }}, .energy=20000 } }
-                    ),
-                    ECS_Children({ECS_Components(
-                        { M7_Components.SolidColor, &(M7_SolidColor) { .r=1, .g=1, .b=1 }},
-                        { M7_Components.ModelInstance, &(M7_ModelInstanceArgs) {
-                            .shader_components = (ECS_Component(M7_ShaderComponent) *[]) { M7_Components.SolidColor },
-                            .nshaders = 1,
-                            .render_batch = Opaque,
-                            .flags = M7_RASTERIZER_CULL_BACKFACE
-                                   | M7_RASTERIZER_TEST_DEPTH
-                                   | M7_RASTERIZER_WRITE_DEPTH
-                        }}
-                    )})
-                },
-                { /* Light */
-                    ECS_Components(
-                        { M7_Components.Position, &(vec3){ .x=150, .y=-115, .z=800 } },
-                        { M7_Components.Basis, (mat3x3 []){mat3x3_identity} },
-                        { M7_Components.MeshPrimitive, nullptr },
-                        { M7_Components.Sphere, &(M7_Sphere) { .radius=32, .nrings=16, .ring_precision=16 } },
-                        { M7_Components.Model, &(M7_ModelArgs) { .get_mesh = M7_Sphere_GetMesh }},
-                        { M7_Components.XformComposer, &(M7_XformComposer){M7_XformComposeDefault} },
-                        { M7_Components.PointLight, &(M7_PointLight) { .col={{ 0.9, 0.2, 1.0 }}, .energy=20000 } }
-                    ),
-                    ECS_Children({ECS_Components(
-                        { M7_Components.SolidColor, &(M7_SolidColor) { .r=1, .g=1, .b=1 }},
-                        { M7_Components.ModelInstance, &(M7_ModelInstanceArgs) {
-                            .shader_components = (ECS_Component(M7_ShaderComponent) *[]) { M7_Components.SolidColor },
-                            .nshaders = 1,
-                            .render_batch = Opaque,
-                            .flags = M7_RASTERIZER_CULL_BACKFACE
-                                   | M7_RASTERIZER_TEST_DEPTH
-                                   | M7_RASTERIZER_WRITE_DEPTH
-                        }}
-                    )})
-                },
-                { /* Skybox */
-                    ECS_Components(
-                        { M7_Components.MeshPrimitive, nullptr },
-                        { M7_Components.Cubemap, &(M7_Cubemap) { .scale=1000 } },
-                        { M7_Components.Model, &(M7_ModelArgs) { .get_mesh = M7_Cubemap_GetMesh } },
-                        { M7_Components.XformComposer, &(M7_XformComposer){M7_XformComposeCubemap} },
-                    ),
-                    ECS_Children({ECS_Components(
-                        { M7_Components.Sky, nullptr },
-                        { M7_Components.ModelInstance, &(M7_ModelInstanceArgs) {
-                            .shader_components = (ECS_Component(M7_ShaderComponent) *[]) { M7_Components.Sky },
-                            .nshaders = 1,
-                            .render_batch = Sky,
-                        }}
-                    )})
+                    ECS_Children(
+                        {ECS_Components(
+                            { M7_Components.SolidColor, &(M7_SolidColor) { .r=1, .g=1, .b=1 }},
+                            { M7_Components.ModelInstance, &(M7_ModelInstanceArgs) {
+                                .shader_components = (ECS_Component(M7_ShaderComponent) *[]) { M7_Components.SolidColor },
+                                .nshaders = 1,
+                                .render_batch = Opaque,
+                                .flags = M7_RASTERIZER_CULL_BACKFACE
+                                       | M7_RASTERIZER_TEST_DEPTH
+                                       | M7_RASTERIZER_WRITE_DEPTH
+                            }}
+                        )},
+                        {ECS_Components(
+                            { M7_Components.Position, &(vec3){ .x=300 } },
+                            { M7_Components.Basis, (mat3x3 []){mat3x3_identity} },
+                            { M7_Components.XformComposer, &(M7_XformComposer){M7_XformComposeDefault} },
+                            { M7_Components.Placement, nullptr },
+                            { M7_Components.PointLight, &(M7_PointLight) { .col={{ 0.2, 1.0, 0.5 }}, .energy=20000 } }
+                        )},
+                        {ECS_Components(
+                            { M7_Components.Position, &(vec3){ .z=400 } },
+                            { M7_Components.Basis, (mat3x3 []){mat3x3_identity} },
+                            { M7_Components.XformComposer, &(M7_XformComposer){M7_XformComposeDefault} },
+                            { M7_Components.Placement, nullptr },
+                            { M7_Components.PointLight, &(M7_PointLight) { .col={{ 1.0, 0.2, 0.1 }}, .energy=20000 } }
+                        )},
+                        {ECS_Components(
+                            { M7_Components.Position, &(vec3){ .x=300, .z=400 } },
+                            { M7_Components.Basis, (mat3x3 []){mat3x3_identity} },
+                            { M7_Components.XformComposer, &(M7_XformComposer){M7_XformComposeDefault} },
+                            { M7_Components.Placement, nullptr },
+                            { M7_Components.PointLight, &(M7_PointLight) { .col={{ 0.9, 0.2, 1.0 }}, .energy=20000 } }
+                        )}
+                    )
                 }
             )
         },
@@ -254,13 +197,18 @@ SDL_AppResult SDL_AppIterate(void *appstate) {
 
     printf("FPS: %li              \n\x1b[F", SDL_lround(1/delta));
 
+    M7_PROFILE_FRAME_BEGIN();
     ECS_SystemGroup_Process(M7_SystemGroups.Update, delta);
 
-    ECS_Update(ecs);
+    {
+        M7_PROFILE_SCOPE(M7_PROFILE_ECS_UPDATE);
+        ECS_Update(ecs);
+    }
 
     ECS_SystemGroup_Process(M7_SystemGroups.PostUpdate);
     ECS_SystemGroup_ProcessReverse(M7_SystemGroups.Render);
     ECS_SystemGroup_Process(M7_SystemGroups.RenderPresent);
+    M7_PROFILE_FRAME_END();
 
     return SDL_APP_CONTINUE;
 }